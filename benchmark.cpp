@@ -0,0 +1,239 @@
+/*
+ * benchmark [<json>] times the file system operations one at a time and
+ * writes the results to <json>, bench.json if not given, so that builds can
+ * be compared.
+ *
+ * Each benchmark repeats one operation on a freshly formatted disk, with
+ * whatever it needs set up beforehand and cleaned up afterwards outside the
+ * timing: format; create and cat at several file sizes; append; cp; mkdir
+ * and cd at several depths; ls on directories with few and with all entries
+ * in use. For each it reports operations per second, latency percentiles
+ * and the blocks read and written per operation. Command output goes into
+ * a discarded stream, so the terminal does not slow anything down.
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <cstdio>
+#include "fs.h"
+
+// operations per benchmark, fewer for large files, see ops_for()
+#define BENCH_OPS 500
+#define BENCH_MIN_OPS 20
+// bytes a benchmark on large files moves at most
+#define BENCH_BYTES (16 << 20)
+
+// the timings of one benchmark
+struct bench_result {
+    std::string name;
+    // the file size, depth or number of entries, 0 if none
+    unsigned param;
+    // latency of each operation in nanoseconds
+    std::vector<double> latencies;
+    double secs = 0;
+    unsigned long reads = 0;
+    unsigned long writes = 0;
+};
+
+static std::vector<bench_result> results;
+static FS *filesystem;
+static fs_session session;
+// where command output goes
+static std::ostringstream discard;
+// where create takes its data rows from
+static std::istringstream rows;
+
+// number of operations for a benchmark moving <bytes> per operation
+static int
+ops_for(unsigned bytes)
+{
+    if (bytes == 0)
+        return BENCH_OPS;
+    return std::max(BENCH_MIN_OPS, std::min(BENCH_OPS, (int)(BENCH_BYTES / bytes)));
+}
+
+// the data rows create reads for a file of <size> bytes, up to the empty row
+static std::string
+rows_for(unsigned size)
+{
+    std::string text;
+    while (text.size() + 64 <= size)
+        text += std::string(63, 'a' + text.size() / 64 % 26) + "\n";
+    if (text.size() < size)
+        text += std::string(size - text.size() - 1, 'z') + "\n";
+    return text + "\n";
+}
+
+// sets create up to read the rows of <text> again
+static void
+rewind_rows(const std::string &text)
+{
+    rows.str(text);
+    rows.clear();
+}
+
+// times <ops> calls of <op>, each after <before> and followed by <after>,
+// which are not timed
+static void
+bench(const std::string &name, unsigned param, int ops, const std::function<int()> &op,
+      const std::function<void()> &before = nullptr, const std::function<void()> &after = nullptr)
+{
+    bench_result r;
+    r.name = name;
+    r.param = param;
+    int failed = 0;
+    for (int i = 0; i < ops; ++i) {
+        if (before)
+            before();
+        discard.str("");
+        unsigned long reads = filesystem->get_no_reads();
+        unsigned long writes = filesystem->get_no_writes();
+        auto start = std::chrono::steady_clock::now();
+        if (op())
+            ++failed;
+        std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+        r.reads += filesystem->get_no_reads() - reads;
+        r.writes += filesystem->get_no_writes() - writes;
+        r.latencies.push_back(ns.count());
+        r.secs += ns.count() / 1e9;
+        if (after)
+            after();
+    }
+    if (failed)
+        std::cerr << "benchmark: " << name << " " << param << ": " << failed << " of " << ops
+                  << " operations failed\n";
+    std::cout << name << " " << param << ": " << (unsigned long)(ops / r.secs) << " ops/s\n";
+    results.push_back(r);
+}
+
+// the latency in microseconds below which fraction <p> of the operations stay
+static double
+percentile(const std::vector<double> &sorted, double p)
+{
+    size_t i = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+    return sorted[i] / 1000;
+}
+
+// writes the results to <path> as JSON; returns -1 if it cannot be written
+static int
+write_json(const char *path)
+{
+    std::ofstream out(path);
+    if (!out)
+        return -1;
+    out << "{\"block_size\":" << BLOCK_SIZE << ",\"benchmarks\":[";
+    char line[512];
+    for (size_t i = 0; i < results.size(); ++i) {
+        bench_result &r = results[i];
+        std::vector<double> sorted = r.latencies;
+        std::sort(sorted.begin(), sorted.end());
+        double ops = sorted.size();
+        std::snprintf(line, sizeof(line),
+                      "%s\n{\"name\":\"%s\",\"param\":%u,\"ops\":%zu,\"ops_per_sec\":%.1f,"
+                      "\"latency_us\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f},"
+                      "\"block_reads_per_op\":%.2f,\"block_writes_per_op\":%.2f}",
+                      i ? "," : "", r.name.c_str(), r.param, sorted.size(), ops / r.secs,
+                      percentile(sorted, 0.5), percentile(sorted, 0.9), percentile(sorted, 0.99),
+                      sorted.back() / 1000, r.reads / ops, r.writes / ops);
+        out << line;
+    }
+    out << "\n]}\n";
+    out.close();
+    return out.fail() ? -1 : 0;
+}
+
+// a path of <depth> directories below the root, "/" for depth 0
+static std::string
+dir_path(unsigned depth)
+{
+    std::string path;
+    for (unsigned i = 0; i < depth; ++i)
+        path += "/d";
+    return path.empty() ? "/" : path;
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *json = argc > 1 ? argv[1] : "bench.json";
+    if (argc > 2) {
+        std::cerr << "Usage: benchmark [<json>]\n";
+        return 1;
+    }
+    FS fs;
+    filesystem = &fs;
+    session.in = &rows;
+    session.out = &discard;
+    session.out_fd = -1;
+    fs.attach(session);
+
+    bench("format", 0, ops_for(0), [&]() { return fs.format(); });
+
+    const unsigned sizes[] = { 16, BLOCK_SIZE, 16 * BLOCK_SIZE, 256 * BLOCK_SIZE };
+    for (unsigned size : sizes) {
+        fs.format();
+        std::string text = rows_for(size);
+        bench("create", size, ops_for(size), [&]() { return fs.create("f"); },
+              [&]() { rewind_rows(text); }, [&]() { fs.rm("f"); });
+        rewind_rows(text);
+        fs.create("f");
+        bench("cat", size, ops_for(size), [&]() { return fs.cat("f"); });
+    }
+
+    const unsigned appended[] = { 16, BLOCK_SIZE };
+    for (unsigned size : appended) {
+        fs.format();
+        std::string text = rows_for(size);
+        rewind_rows(text);
+        fs.create("src");
+        rewind_rows("\n");
+        fs.create("dst");
+        bench("append", size, std::min(ops_for(size), (int)(BENCH_BYTES / 8 / size)),
+              [&]() { return fs.append("src", "dst"); });
+    }
+
+    fs.format();
+    std::string text = rows_for(16 * BLOCK_SIZE);
+    rewind_rows(text);
+    fs.create("src");
+    bench("cp", 16 * BLOCK_SIZE, ops_for(16 * BLOCK_SIZE), [&]() { return fs.cp("src", "dst"); },
+          nullptr, [&]() { fs.rm("dst"); });
+
+    const unsigned depths[] = { 1, 4, 16 };
+    for (unsigned depth : depths) {
+        fs.format();
+        for (unsigned i = 1; i < depth; ++i)
+            fs.mkdir(dir_path(i));
+        std::string path = dir_path(depth);
+        bench("mkdir", depth, ops_for(0), [&]() { return fs.mkdir(path); },
+              nullptr, [&]() { fs.rm_recursive(path); });
+        fs.mkdir(path);
+        bench("cd", depth, ops_for(0), [&]() { return fs.cd(path); },
+              nullptr, [&]() { fs.cd("/"); });
+    }
+
+    // a directory holds DIR_ENTRIES entries, one of them ".."
+    const unsigned entries[] = { 8, DIR_ENTRIES - 1 };
+    for (unsigned n : entries) {
+        fs.format();
+        fs.mkdir("d");
+        fs.cd("d");
+        for (unsigned i = 0; i < n; ++i)
+            fs.close(fs.open("f" + std::to_string(i), WRITE | CREATE));
+        bench("ls", n, ops_for(0), [&]() { return fs.ls(); });
+        fs.cd("/");
+    }
+
+    fs.detach(session);
+    if (write_json(json)) {
+        std::cerr << "benchmark: " << json << ": Cannot write results\n";
+        return 1;
+    }
+    std::cout << "Results written to " << json << "\n";
+    return 0;
+}
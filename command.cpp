@@ -0,0 +1,613 @@
+#include <iostream>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include "command.h"
+#include "fs.h"
+#include "trace.h"
+
+// a command line split into words, and where the command runs
+struct command_call {
+    FS &filesystem;
+    // the command name and its arguments, pointing into the line
+    std::vector<std::string_view> args;
+    std::ostream &out;
+    // ask for the data rows of create and write
+    bool prompts;
+    // the files of the host may be read and written
+    bool host_files;
+};
+
+// runs a command; returns false for quit
+typedef bool (*command_fn)(command_call &c);
+
+// parses a byte count or offset, returns false if <s> is not a number
+static bool
+parse_size(std::string_view s, uint32_t &n)
+{
+    std::from_chars_result res = std::from_chars(s.data(), s.data() + s.size(), n);
+    return !s.empty() && res.ec == std::errc() && res.ptr == s.data() + s.size();
+}
+
+static bool
+cmd_format(command_call &c)
+{
+    if (c.args.size() != 1) {
+        c.out << "Usage: format\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val = c.filesystem.format();
+    if (ret_val) {
+        c.out << "Error: format failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_create(command_call &c)
+{
+    if (c.args.size() != 2) {
+        c.out << "Usage: create <file>\n";
+        return true;
+    }
+    if (c.prompts)
+        c.out << "Enter data. Empty line to end.\n";
+    // check return value so everything is ok
+    int ret_val = c.filesystem.create(c.args[1]);
+    if (ret_val) {
+        c.out << "Error: create " << c.args[1];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_cat(command_call &c)
+{
+    if (c.args.size() != 2) {
+        c.out << "Usage: cat <file>\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val = c.filesystem.cat(c.args[1]);
+    if (ret_val) {
+        c.out << "Error: cat " << c.args[1];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+// head -c <n> <file> and tail -c <n> <file>
+static bool
+cmd_head_tail(command_call &c)
+{
+    uint32_t n;
+    if (c.args.size() != 4 || c.args[1] != "-c" || !parse_size(c.args[2], n)) {
+        c.out << "Usage: " << c.args[0] << " -c <bytes> <file>\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val;
+    if (c.args[0] == "head")
+        ret_val = c.filesystem.head(c.args[3], n);
+    else
+        ret_val = c.filesystem.tail(c.args[3], n);
+    if (ret_val) {
+        c.out << "Error: " << c.args[0] << " " << c.args[3];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_read(command_call &c)
+{
+    uint32_t offset, len;
+    if (c.args.size() != 4 || !parse_size(c.args[2], offset) ||
+        !parse_size(c.args[3], len)) {
+        c.out << "Usage: read <file> <offset> <len>\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val = c.filesystem.read_range(c.args[1], offset, len);
+    if (ret_val) {
+        c.out << "Error: read " << c.args[1];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_ls(command_call &c)
+{
+    if (c.args.size() != 1) {
+        c.out << "Usage: ls\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val = c.filesystem.ls();
+    if (ret_val) {
+        c.out << "Error: ls failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_cp(command_call &c)
+{
+    bool recursive = c.args.size() == 4 && c.args[1] == "-r";
+    if (c.args.size() != 3 && !recursive) {
+        c.out << "Usage: cp [-r] <oldfile> <newfile>\n";
+        return true;
+    }
+    std::string_view arg1 = c.args[c.args.size() - 2];
+    std::string_view arg2 = c.args[c.args.size() - 1];
+    // check return value so everything is ok
+    int ret_val;
+    if (recursive)
+        ret_val = c.filesystem.cp_recursive(arg1, arg2);
+    else
+        ret_val = c.filesystem.cp(arg1, arg2);
+    if (ret_val) {
+        c.out << "Error: cp " << arg1 << " " << arg2;
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_mv(command_call &c)
+{
+    if (c.args.size() != 3) {
+        c.out << "Usage: mv <sourcepath> <destpath>\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val = c.filesystem.mv(c.args[1], c.args[2]);
+    if (ret_val) {
+        c.out << "Error: mv " << c.args[1] << " " << c.args[2];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_rm(command_call &c)
+{
+    bool recursive = c.args.size() == 3 && c.args[1] == "-r";
+    if (c.args.size() != 2 && !recursive) {
+        c.out << "Usage: rm [-r] <file>\n";
+        return true;
+    }
+    std::string_view arg1 = c.args[c.args.size() - 1];
+    // check return value so everything is ok
+    int ret_val;
+    if (recursive)
+        ret_val = c.filesystem.rm_recursive(arg1);
+    else
+        ret_val = c.filesystem.rm(arg1);
+    if (ret_val) {
+        c.out << "Error: rm " << arg1;
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_append(command_call &c)
+{
+    if (c.args.size() != 3) {
+        c.out << "Usage: append <filepath1> <filepath2>\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val = c.filesystem.append(c.args[1], c.args[2]);
+    if (ret_val) {
+        c.out << "Error: append " << c.args[1] << " " << c.args[2];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_write(command_call &c)
+{
+    uint32_t offset;
+    if (c.args.size() != 3 || !parse_size(c.args[2], offset)) {
+        c.out << "Usage: write <file> <offset>\n";
+        return true;
+    }
+    if (c.prompts)
+        c.out << "Enter data. Empty line to end.\n";
+    // check return value so everything is ok
+    int ret_val = c.filesystem.write_at(c.args[1], offset);
+    if (ret_val) {
+        c.out << "Error: write " << c.args[1];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_truncate(command_call &c)
+{
+    uint32_t size;
+    if (c.args.size() != 3 || !parse_size(c.args[2], size)) {
+        c.out << "Usage: truncate <file> <size>\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val = c.filesystem.truncate(c.args[1], size);
+    if (ret_val) {
+        c.out << "Error: truncate " << c.args[1];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_mkdir(command_call &c)
+{
+    if (c.args.size() != 2) {
+        c.out << "Usage: mkdir <dirpath>\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val = c.filesystem.mkdir(c.args[1]);
+    if (ret_val) {
+        c.out << "Error: mkdir " << c.args[1];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_cd(command_call &c)
+{
+    if (c.args.size() != 2) {
+        c.out << "Usage: cd <dirpath>\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val = c.filesystem.cd(c.args[1]);
+    if (ret_val) {
+        c.out << "Error: cd " << c.args[1];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_pwd(command_call &c)
+{
+    if (c.args.size() != 1) {
+        c.out << "Usage: pwd\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val = c.filesystem.pwd();
+    if (ret_val) {
+        c.out << "Error: pwd failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_chmod(command_call &c)
+{
+    if (c.args.size() != 3) {
+        c.out << "Usage: chmod <accessrights> <filepath>\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val = c.filesystem.chmod(c.args[1], c.args[2]);
+    if (ret_val) {
+        c.out << "Error: chmod " << c.args[1] << " " << c.args[2];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+// find <dirpath> [-name <glob>] [-type f|d] [-perm <accessrights>]
+static bool
+cmd_find(command_call &c)
+{
+    std::string_view pattern = "*";
+    int type = -1, rights = 0;
+    bool usage = c.args.size() < 2 || c.args.size() % 2 != 0;
+    for (unsigned i = 2; !usage && i + 1 < c.args.size(); i += 2) {
+        std::string_view opt = c.args[i], val = c.args[i + 1];
+        if (opt == "-name")
+            pattern = val;
+        else if (opt == "-type" && (val == "f" || val == "d"))
+            type = val == "d" ? TYPE_DIR : TYPE_FILE;
+        else if (opt == "-perm" && val.size() == 1 && val[0] >= '0' && val[0] <= '7')
+            rights = val[0] - '0';
+        else
+            usage = true;
+    }
+    if (usage) {
+        c.out << "Usage: find <dirpath> [-name <glob>] [-type f|d] [-perm <accessrights>]\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val = c.filesystem.find(c.args[1], pattern, type, rights);
+    if (ret_val) {
+        c.out << "Error: find " << c.args[1];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+// refuses a command reaching files of the host when the caller may not;
+// returns true if it did
+static bool
+host_refused(command_call &c)
+{
+    if (c.host_files)
+        return false;
+    c.out << c.args[0] << ": Host files are not available to this session\n";
+    c.out << "Error: " << c.args[0] << " failed, error code -1\n";
+    return true;
+}
+
+static bool
+cmd_import(command_call &c)
+{
+    if (c.args.size() != 3) {
+        c.out << "Usage: import <hostpath> <filepath>\n";
+        return true;
+    }
+    if (host_refused(c))
+        return true;
+    // check return value so everything is ok
+    int ret_val = c.filesystem.import_file(c.args[1], c.args[2]);
+    if (ret_val) {
+        c.out << "Error: import " << c.args[1] << " " << c.args[2];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_export(command_call &c)
+{
+    if (c.args.size() != 3) {
+        c.out << "Usage: export <filepath> <hostpath>\n";
+        return true;
+    }
+    if (host_refused(c))
+        return true;
+    // check return value so everything is ok
+    int ret_val = c.filesystem.export_file(c.args[1], c.args[2]);
+    if (ret_val) {
+        c.out << "Error: export " << c.args[1] << " " << c.args[2];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+// compress <file> and uncompress <file>
+static bool
+cmd_compress(command_call &c)
+{
+    if (c.args.size() != 2) {
+        c.out << "Usage: " << c.args[0] << " <file>\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val = c.filesystem.compress(c.args[1], c.args[0] == "compress");
+    if (ret_val) {
+        c.out << "Error: " << c.args[0] << " " << c.args[1];
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_sync(command_call &c)
+{
+    if (c.args.size() != 1) {
+        c.out << "Usage: sync\n";
+        return true;
+    }
+    // waits until everything written so far is on the disk
+    int ret_val = c.filesystem.sync();
+    if (ret_val) {
+        c.out << "Error: sync failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_snapshot(command_call &c)
+{
+    bool remove = c.args.size() == 3 && c.args[1] == "-d";
+    if (c.args.size() > 2 && !remove) {
+        c.out << "Usage: snapshot [[-d] <name>]\n";
+        return true;
+    }
+    // check return value so everything is ok
+    std::string_view arg1;
+    int ret_val;
+    if (c.args.size() == 1) {
+        ret_val = c.filesystem.list_snapshots();
+    } else {
+        arg1 = c.args[c.args.size() - 1];
+        if (remove)
+            ret_val = c.filesystem.rm_snapshot(arg1);
+        else
+            ret_val = c.filesystem.snapshot(arg1);
+    }
+    if (ret_val) {
+        c.out << "Error: snapshot " << (remove ? "-d " : "") << arg1;
+        c.out << " failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+// trace start, trace stop <hostpath>
+static bool
+cmd_trace(command_call &c)
+{
+    bool start = c.args.size() == 2 && c.args[1] == "start";
+    bool stop = c.args.size() == 3 && c.args[1] == "stop";
+    if (!start && !stop) {
+        c.out << "Usage: trace start | trace stop <hostpath>\n";
+        return true;
+    }
+    // spans of every session are recorded, and only the console may write
+    // them out
+    if (host_refused(c))
+        return true;
+    if (start) {
+        trace_start();
+        return true;
+    }
+    // writes the spans recorded since trace start as Chrome trace-event JSON
+    if (trace_stop(c.args[2])) {
+        c.out << "trace: " << c.args[2] << ": Cannot write trace\n";
+        c.out << "Error: trace stop " << c.args[2] << " failed, error code -1\n";
+    }
+    return true;
+}
+
+static bool
+cmd_stats(command_call &c)
+{
+    if (c.args.size() != 1) {
+        c.out << "Usage: stats\n";
+        return true;
+    }
+    // check return value so everything is ok
+    int ret_val = c.filesystem.stats();
+    if (ret_val) {
+        c.out << "Error: stats failed, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool
+cmd_check(command_call &c)
+{
+    if (c.args.size() != 1) {
+        c.out << "Usage: check\n";
+        return true;
+    }
+    int ret_val = c.filesystem.check();
+    if (ret_val) {
+        c.out << "Error: check found problems, error code " << ret_val << "\n";
+    }
+    return true;
+}
+
+static bool cmd_help(command_call &c);
+
+static bool
+cmd_quit(command_call &)
+{
+    return false;
+}
+
+// a command name and what runs it
+struct command_def {
+    const char *name;
+    command_fn fn;
+};
+
+// every command, in the order help lists them
+static const command_def commands[] = {
+    { "format", cmd_format }, { "create", cmd_create }, { "cat", cmd_cat },
+    { "head", cmd_head_tail }, { "tail", cmd_head_tail }, { "read", cmd_read },
+    { "ls", cmd_ls }, { "cp", cmd_cp }, { "mv", cmd_mv }, { "rm", cmd_rm },
+    { "append", cmd_append }, { "write", cmd_write }, { "truncate", cmd_truncate },
+    { "mkdir", cmd_mkdir }, { "cd", cmd_cd }, { "pwd", cmd_pwd },
+    { "chmod", cmd_chmod }, { "find", cmd_find }, { "import", cmd_import },
+    { "export", cmd_export }, { "compress", cmd_compress }, { "uncompress", cmd_compress },
+    { "sync", cmd_sync }, { "snapshot", cmd_snapshot }, { "trace", cmd_trace },
+    { "stats", cmd_stats },
+    { "check", cmd_check }, { "help", cmd_help }, { "quit", cmd_quit }
+};
+
+static bool
+cmd_help(command_call &c)
+{
+    c.out << "Available commands:\n";
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i)
+        c.out << (i ? ", " : "") << commands[i].name;
+    c.out << "\n";
+    return true;
+}
+
+// the commands by name, built on first use
+static const std::unordered_map<std::string_view, const command_def*> &
+command_table()
+{
+    static const std::unordered_map<std::string_view, const command_def*> table = []() {
+        std::unordered_map<std::string_view, const command_def*> t;
+        for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i)
+            t.emplace(commands[i].name, &commands[i]);
+        return t;
+    }();
+    return table;
+}
+
+// splits <line> into <args> at blanks, skipping runs of them
+static void
+split(std::string_view line, std::vector<std::string_view> &args)
+{
+    for (;;) {
+        size_t start = line.find_first_not_of(' ');
+        if (start == std::string_view::npos)
+            break;
+        size_t end = line.find(' ', start);
+        args.push_back(line.substr(start, end - start));
+        if (end == std::string_view::npos)
+            break;
+        line.remove_prefix(end);
+    }
+}
+
+// true if the command <line> goes on to read data rows up to an empty row,
+// as create and write do when they are used right
+bool
+reads_rows(std::string_view line)
+{
+    std::vector<std::string_view> args;
+    split(line, args);
+    uint32_t offset;
+    return (args.size() == 2 && args[0] == "create") ||
+           (args.size() == 3 && args[0] == "write" && parse_size(args[2], offset));
+}
+
+// runs the command <line> on <filesystem>, writing messages to <out>;
+// returns false for quit. Rows starting with # or // are comments
+bool
+run_command(FS &filesystem, const std::string &line, std::ostream &out, bool prompts,
+            bool host_files)
+{
+    command_call c{filesystem, {}, out, prompts, host_files};
+    split(line, c.args);
+    if (c.args.empty())
+        return true;
+    std::string_view cmd = c.args[0];
+    if (cmd[0] == '#' || cmd.substr(0, 2) == "//")
+        return true;
+
+    if (DEBUG) {
+        out << "Line: " << line << "\n";
+        out << "cmd: " << cmd << "\n";
+        for (unsigned i = 0; i < c.args.size(); ++i)
+            out << "cmd/arg: " << c.args[i] << "\n";
+    }
+
+    auto it = command_table().find(cmd);
+    if (it == command_table().end())
+        return cmd_help(c);
+    // the whole command is one span, named after it
+    TraceSpan span(it->second->name);
+    return it->second->fn(c);
+}
@@ -0,0 +1,19 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include "fs.h"
+
+#ifndef __COMMAND_H__
+#define __COMMAND_H__
+
+// runs the command <line> on <filesystem>, writing messages to <out>;
+// returns false for quit. Rows starting with # or // are comments. Without
+// <prompts> create and write read their data rows without asking; without
+// <host_files> import, export and trace, which read or write files of the
+// host, are refused
+bool run_command(FS &filesystem, const std::string &line, std::ostream &out,
+                 bool prompts = true, bool host_files = true);
+// true if the command <line> goes on to read data rows up to an empty row
+bool reads_rows(std::string_view line);
+
+#endif // __COMMAND_H__
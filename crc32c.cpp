@@ -0,0 +1,125 @@
+#include <cstring>
+#include "crc32c.h"
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// reflected Castagnoli polynomial
+#define CRC32C_POLY 0x82f63b78
+
+static uint32_t crc_table[256];
+
+static void
+init_table()
+{
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k)
+            c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+// one byte at a time through a 256 entry table
+static uint32_t
+crc32c_table(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t*)data;
+    crc = ~crc;
+    while (len--)
+        crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+#if defined(__x86_64__)
+// length of each of the three streams the SSE4.2 version runs side by side;
+// three of them fill a block all but its last 16 bytes
+#define LANE 1360
+
+// shift_table[k][b]: CRC state of byte <b> at position <k> of the state
+// followed by LANE zero bytes, so that a state can be moved past a lane
+static uint32_t shift_table[4][256];
+
+// CRC state after <len> zero bytes, starting from state <crc>, one bit at a time
+static uint32_t
+zeros(uint32_t crc, size_t len)
+{
+    for (size_t i = 0; i < len * 8; ++i)
+        crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+    return crc;
+}
+
+static void
+init_shift_table()
+{
+    for (int k = 0; k < 4; ++k) {
+        for (uint32_t b = 0; b < 256; ++b)
+            shift_table[k][b] = zeros(b << (8 * k), LANE);
+    }
+}
+
+// the state <crc> moved past LANE zero bytes
+static inline uint32_t
+shift(uint32_t crc)
+{
+    return shift_table[0][crc & 0xff] ^ shift_table[1][(crc >> 8) & 0xff] ^
+           shift_table[2][(crc >> 16) & 0xff] ^ shift_table[3][crc >> 24];
+}
+
+// eight bytes per crc32 instruction. The instruction takes three cycles
+// but can start every cycle, so three independent streams are computed at
+// once and joined: the CRC of A followed by B is that of A moved past |B|
+// zero bytes, xor the CRC of B from a zero state.
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_sse42(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t*)data;
+    uint64_t c = ~crc;
+    for (; len >= 3 * LANE; len -= 3 * LANE, p += 3 * LANE) {
+        uint64_t c1 = 0, c2 = 0;
+        for (size_t i = 0; i < LANE; i += 8) {
+            uint64_t v0, v1, v2;
+            std::memcpy(&v0, p + i, sizeof(v0));
+            std::memcpy(&v1, p + LANE + i, sizeof(v1));
+            std::memcpy(&v2, p + 2 * LANE + i, sizeof(v2));
+            c = _mm_crc32_u64(c, v0);
+            c1 = _mm_crc32_u64(c1, v1);
+            c2 = _mm_crc32_u64(c2, v2);
+        }
+        c = shift(shift((uint32_t)c) ^ (uint32_t)c1) ^ (uint32_t)c2;
+    }
+    for (; len >= 8; len -= 8, p += 8) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        c = _mm_crc32_u64(c, v);
+    }
+    uint32_t c32 = c;
+    while (len--)
+        c32 = _mm_crc32_u8(c32, *p++);
+    return ~c32;
+}
+#endif
+
+typedef uint32_t (*crc_fn)(uint32_t, const void*, size_t);
+
+// picks the implementation once, on first use
+static crc_fn
+select_crc()
+{
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        init_shift_table();
+        return crc32c_sse42;
+    }
+#endif
+    init_table();
+    return crc32c_table;
+}
+
+// CRC32C (Castagnoli) of <len> bytes at <data>, continuing from <crc>
+uint32_t
+crc32c(uint32_t crc, const void *data, size_t len)
+{
+    static const crc_fn fn = select_crc();
+    return fn(crc, data, len);
+}
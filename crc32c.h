@@ -0,0 +1,12 @@
+#include <cstddef>
+#include <cstdint>
+
+#ifndef __CRC32C_H__
+#define __CRC32C_H__
+
+// CRC32C (Castagnoli) of <len> bytes at <data>, continuing from <crc>
+// (0 to start). Uses the SSE4.2 crc32 instruction when the CPU has it and
+// a table-driven version otherwise.
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+#endif // __CRC32C_H__
@@ -1,27 +1,360 @@
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
 #include "disk.h"
+#include "crc32c.h"
+#include "trace.h"
 
-Disk::Disk()
+Disk::Disk(bool read_only, const std::string &name, unsigned no_members,
+           unsigned stripe_blocks)
+    : stripe_blocks(stripe_blocks), read_only(read_only)
 {
-    // first check if the disk file exists, otherwise create it.
-    if (!disk_file_exists(DISKNAME)) {
-        std::cout << "No disk file found...\n";
-        std::cout << "Creating disk file: " << DISKNAME << std::endl;
-        std::ofstream f(DISKNAME, std::ios::binary | std::ios::out);
-        f.seekp((1<<23)-1);
-        f.write("", 1);
+    if (no_members == 0 || stripe_blocks == 0 || no_blocks % stripe_blocks) {
+        std::cerr << "ERROR: Bad stripe layout of diskfile: " << name << ", exiting..." << std::endl;
+        exit(-1);
+    }
+    // every member holds the same number of stripes, the last ones of some
+    // being unused
+    unsigned stripes = no_blocks / stripe_blocks;
+    off_t member_size = (off_t)((stripes + no_members - 1) / no_members) * stripe_blocks * BLOCK_SIZE;
+    for (unsigned i = 0; i < no_members; ++i) {
+        std::string file = no_members == 1 ? name : name + "." + std::to_string(i);
+        // first check if the disk file exists, otherwise create it.
+        if (!disk_file_exists(file)) {
+            std::cout << "No disk file found...\n";
+            std::cout << "Creating disk file: " << file << std::endl;
+            std::ofstream f(file, std::ios::binary | std::ios::out);
+            f.seekp(member_size - 1);
+            f.write("", 1);
+        }
+        // the disk is simulated as binary files
+        members.push_back(std::make_unique<disk_member>());
+        members.back()->fd = ::open(file.c_str(), read_only ? O_RDONLY : O_RDWR);
+        if (members.back()->fd < 0) {
+            std::cerr << "ERROR: Can't open diskfile: " << file << ", exiting..."<< std::endl;
+            exit(-1);
+        }
     }
-    // the disk is simulated as a binary file
-    diskfile.open(DISKNAME, std::ios::in | std::ios::out | std::ios::binary);
-    if (!diskfile.is_open()) {
-        std::cerr << "ERROR: Can't open diskfile: " << DISKNAME << ", exiting..."<< std::endl;
+    // the checksum table is kept in memory
+    std::vector<uint32_t> table(no_blocks);
+    size_t table_size = no_blocks * sizeof(uint32_t);
+    if (table_size != CHECKSUM_BLOCKS * BLOCK_SIZE ||
+        transfer(CHECKSUM_BLOCK, CHECKSUM_BLOCKS, (uint8_t*)table.data(), false)) {
+        std::cerr << "ERROR: Can't read checksum table of diskfile: " << name << std::endl;
         exit(-1);
     }
+    checksums = std::vector<std::atomic<uint32_t> >(no_blocks);
+    for (unsigned i = 0; i < no_blocks; ++i)
+        checksums[i] = table[i];
+    no_reads += CHECKSUM_BLOCKS;
+    for (int i = 0; i < CHECKSUM_BLOCKS; ++i) {
+        checksums_dirty[i] = false;
+        checksums_changed[i] = false;
+    }
+    // the first member is served by the thread asking, see run_members()
+    for (size_t i = 1; i < members.size(); ++i)
+        members[i]->worker = std::thread(&Disk::member_main, this, members[i].get());
+    if (!read_only)
+        flusher = std::thread(&Disk::flusher_main, this);
 }
 
 Disk::~Disk()
 {
-    diskfile.close();
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        stopping = true;
+        flush_wanted.notify_one();
+    }
+    if (flusher.joinable())
+        flusher.join();
+    sync();
+    for (size_t i = 0; i < members.size(); ++i) {
+        disk_member &m = *members[i];
+        {
+            std::lock_guard<std::mutex> guard(m.lock);
+            m.stopping = true;
+            m.wanted.notify_one();
+        }
+        if (m.worker.joinable())
+            m.worker.join();
+        ::close(m.fd);
+    }
+}
+
+// the member file holding block <block_no>
+disk_member &
+Disk::member_of(unsigned block_no)
+{
+    return *members[block_no / stripe_blocks % members.size()];
+}
+
+// the offset of block <block_no> in its member file
+off_t
+Disk::member_offset(unsigned block_no)
+{
+    unsigned stripe = block_no / stripe_blocks / members.size();
+    return ((off_t)stripe * stripe_blocks + block_no % stripe_blocks) * BLOCK_SIZE;
+}
+
+// the I/O thread of member <m>: runs the jobs handed to it by run_members()
+void
+Disk::member_main(disk_member *m)
+{
+    std::unique_lock<std::mutex> guard(m->lock);
+    while (true) {
+        m->wanted.wait(guard, [m]() { return m->stopping || !m->jobs.empty(); });
+        if (m->jobs.empty())
+            return;
+        std::function<void()> job = std::move(m->jobs.front());
+        m->jobs.pop_front();
+        guard.unlock();
+        job();
+        guard.lock();
+    }
+}
+
+// runs <jobs>, job i on member i, those after the first one on the member
+// threads while the calling thread runs the first; empty jobs are skipped.
+// Returns -1 if any of them failed
+int
+Disk::run_members(std::vector<std::function<int()> > &jobs)
+{
+    size_t first = 0;
+    while (first < jobs.size() && !jobs[first])
+        ++first;
+    std::mutex lock;
+    std::condition_variable done;
+    unsigned left = 0;
+    int ret = 0;
+    for (size_t i = first + 1; i < jobs.size(); ++i) {
+        if (!jobs[i])
+            continue;
+        ++left;
+        disk_member &m = *members[i];
+        std::lock_guard<std::mutex> guard(m.lock);
+        m.jobs.push_back([&, i]() {
+            int r = jobs[i]();
+            std::lock_guard<std::mutex> done_guard(lock);
+            if (r)
+                ret = -1;
+            if (--left == 0)
+                done.notify_one();
+        });
+        m.wanted.notify_one();
+    }
+    int r = first < jobs.size() ? jobs[first]() : 0;
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [&]() { return left == 0; });
+    return r ? -1 : ret;
+}
+
+// splits the <len> bytes starting at block <block_no> by member file and
+// calls <fn>(member, offset in it, pieces) for each member they are on
+int
+Disk::for_each_member(unsigned block_no, size_t len,
+                      const std::function<int(disk_member&, off_t,
+                          const std::vector<std::pair<size_t, size_t> >&)> &fn)
+{
+    std::vector<off_t> offsets(members.size());
+    std::vector<std::vector<std::pair<size_t, size_t> > > pieces(members.size());
+    for (size_t done = 0; done < len; ) {
+        unsigned b = block_no + done / BLOCK_SIZE;
+        size_t m = b / stripe_blocks % members.size();
+        // the rest of the stripe
+        size_t n = std::min<size_t>(len - done, (size_t)(stripe_blocks - b % stripe_blocks) * BLOCK_SIZE);
+        if (pieces[m].empty())
+            offsets[m] = member_offset(b);
+        // with one member the stripes follow each other in the range too
+        if (!pieces[m].empty() && pieces[m].back().first + pieces[m].back().second == done)
+            pieces[m].back().second += n;
+        else
+            pieces[m].push_back(std::make_pair(done, n));
+        done += n;
+    }
+    std::vector<std::function<int()> > jobs(members.size());
+    for (size_t m = 0; m < members.size(); ++m) {
+        if (!pieces[m].empty())
+            jobs[m] = [&, m]() { return fn(*members[m], offsets[m], pieces[m]); };
+    }
+    return run_members(jobs);
+}
+
+// reads (or with <write> writes) the <count> consecutive blocks starting at
+// <block_no> from (to) <buf>, one preadv() / pwritev() per member
+int
+Disk::transfer(unsigned block_no, unsigned count, uint8_t *buf, bool write)
+{
+    return for_each_member(block_no, (size_t)count * BLOCK_SIZE,
+                           [&](disk_member &m, off_t offset,
+                               const std::vector<std::pair<size_t, size_t> > &pieces) {
+        for (size_t i = 0; i < pieces.size(); i += IOV_MAX) {
+            size_t n = std::min<size_t>(pieces.size() - i, IOV_MAX);
+            std::vector<struct iovec> iov(n);
+            ssize_t want = 0;
+            for (size_t j = 0; j < n; ++j) {
+                iov[j].iov_base = buf + pieces[i + j].first;
+                iov[j].iov_len = pieces[i + j].second;
+                want += pieces[i + j].second;
+            }
+            ssize_t got = write ? pwritev(m.fd, iov.data(), n, offset)
+                                : preadv(m.fd, iov.data(), n, offset);
+            if (write)
+                ++no_device_writes;
+            if (got != want)
+                return -1;
+            offset += want;
+        }
+        return 0;
+    });
+}
+
+// the flusher thread: runs the flush hook, and writes the dirty blocks
+// when there are enough of them or the oldest has waited long enough
+void
+Disk::flusher_main()
+{
+    const std::chrono::milliseconds age(DIRTY_AGE_MS);
+    std::unique_lock<std::mutex> guard(cache_lock);
+    while (!stopping) {
+        flush_wanted.wait_for(guard, age / 4, [this]() {
+            return stopping || dirty.size() >= DIRTY_FLUSH_BLOCKS;
+        });
+        if (stopping)
+            continue;
+        guard.unlock();
+        {
+            std::lock_guard<std::mutex> hook_guard(hook_lock);
+            if (flush_hook)
+                flush_hook();
+        }
+        guard.lock();
+        if (dirty.empty())
+            continue;
+        bool due = dirty.size() >= DIRTY_FLUSH_BLOCKS;
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = dirty.begin(); !due && it != dirty.end(); ++it)
+            due = now - it->second.since >= age;
+        if (!due)
+            continue;
+        guard.unlock();
+        {
+            std::lock_guard<std::mutex> flush_guard(flush_lock);
+            flush_locked();
+        }
+        guard.lock();
+    }
+}
+
+// writes every dirty block and then the checksum table if it changed;
+// flush_lock is held. Runs of adjacent blocks go out in one pwritev() per
+// member file, to the members at once
+int
+Disk::flush_locked()
+{
+    TRACE_SPAN("Disk::flush");
+    // the blocks are copied, so that write() can go on meanwhile
+    std::vector<std::pair<unsigned, unsigned long> > blocks;
+    std::vector<uint8_t> data;
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        data.resize(dirty.size() * BLOCK_SIZE);
+        for (auto it = dirty.begin(); it != dirty.end(); ++it) {
+            std::memcpy(data.data() + blocks.size() * BLOCK_SIZE, it->second.data, BLOCK_SIZE);
+            blocks.push_back(std::make_pair(it->first, it->second.version));
+        }
+    }
+    int ret = 0;
+    for (size_t i = 0; i < blocks.size(); ) {
+        size_t run = 1;
+        while (i + run < blocks.size() && run < IOV_MAX &&
+               blocks[i + run].first == blocks[i].first + run)
+            ++run;
+        if (transfer(blocks[i].first, run, data.data() + i * BLOCK_SIZE, true)) {
+            // the run stays dirty
+            for (size_t j = 0; j < run; ++j)
+                blocks[i + j].second = ~0UL;
+            ret = -1;
+        }
+        i += run;
+    }
+    {
+        // blocks written again meanwhile stay dirty
+        std::lock_guard<std::mutex> guard(cache_lock);
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            auto it = dirty.find(blocks[i].first);
+            if (it != dirty.end() && it->second.version == blocks[i].second)
+                dirty.erase(it);
+        }
+        flushed.notify_all();
+    }
+
+    const unsigned per_block = BLOCK_SIZE / sizeof(uint32_t);
+    uint32_t table[per_block];
+    for (int i = 0; i < CHECKSUM_BLOCKS; ++i) {
+        // cleared first: a checksum changed while the block is written
+        // marks it dirty again
+        if (!checksums_dirty[i].exchange(false))
+            continue;
+        for (unsigned j = 0; j < per_block; ++j)
+            table[j] = checksums[i * per_block + j];
+        unsigned b = CHECKSUM_BLOCK + i;
+        if (pwrite(member_of(b).fd, table, BLOCK_SIZE, member_offset(b)) != BLOCK_SIZE) {
+            checksums_dirty[i] = true;
+            ret = -1;
+        }
+        ++no_device_writes;
+    }
+    return ret;
+}
+
+// records the checksum of block <block_no> holding <blk>
+void
+Disk::set_checksum(unsigned block_no, const uint8_t *blk)
+{
+    uint32_t crc = verify ? crc32c(0, blk, BLOCK_SIZE) : 0;
+    if (checksums[block_no] != crc) {
+        checksums[block_no] = crc;
+        checksums_dirty[block_no * sizeof(uint32_t) / BLOCK_SIZE] = true;
+        checksums_changed[block_no * sizeof(uint32_t) / BLOCK_SIZE] = true;
+    }
+}
+
+// forgets every checksum, for a newly formatted disk
+void
+Disk::clear_checksums()
+{
+    std::fill(checksums.begin(), checksums.end(), 0);
+    for (int i = 0; i < CHECKSUM_BLOCKS; ++i) {
+        checksums_dirty[i] = true;
+        checksums_changed[i] = true;
+    }
+}
+
+// writes back all dirty blocks and the checksum table, and waits for it
+int
+Disk::sync()
+{
+    std::lock_guard<std::mutex> guard(flush_lock);
+    int ret = flush_locked();
+    for (int i = 0; i < CHECKSUM_BLOCKS; ++i) {
+        if (checksums_changed[i].exchange(false))
+            ++no_writes;
+    }
+    return ret;
+}
+
+// has the flusher run <hook> each time it wakes up
+void
+Disk::set_flush_hook(std::function<void()> hook)
+{
+    std::lock_guard<std::mutex> guard(hook_lock);
+    flush_hook = std::move(hook);
 }
 
 bool
@@ -34,6 +367,7 @@ Disk::disk_file_exists (const std::string& name) {
 int
 Disk::write(unsigned block_no, uint8_t *blk)
 {
+    TRACE_SPAN("Disk::write");
     if (DEBUG)
         std::cout << "Disk::write(" << block_no << ")\n";
     // check if valid block number
@@ -41,10 +375,30 @@ Disk::write(unsigned block_no, uint8_t *blk)
         std::cout << "Disk::write - ERROR: Invalid block number (" << block_no << ")\n";
         return -1;
     }
-    unsigned offset = block_no * BLOCK_SIZE;
-    diskfile.seekp(offset, std::ios_base::beg);
-    diskfile.write((char*)blk, BLOCK_SIZE);
-    diskfile.flush();
+    if (read_only) {
+        std::cout << "Disk::write - ERROR: Disk is read-only (" << block_no << ")\n";
+        return -1;
+    }
+    set_checksum(block_no, blk);
+    // a write from the flush hook neither waits for the flusher nor counts
+    bool hook = std::this_thread::get_id() == flusher.get_id();
+    std::unique_lock<std::mutex> guard(cache_lock);
+    auto it = dirty.find(block_no);
+    if (it == dirty.end()) {
+        // too much waiting already: this write waits for the flusher
+        while (!hook && dirty.size() >= DIRTY_MAX_BLOCKS) {
+            flush_wanted.notify_one();
+            flushed.wait(guard);
+        }
+        it = dirty.emplace(block_no, dirty_block()).first;
+        it->second.since = std::chrono::steady_clock::now();
+    }
+    std::memcpy(it->second.data, blk, BLOCK_SIZE);
+    it->second.version = ++next_version;
+    if (dirty.size() >= DIRTY_FLUSH_BLOCKS)
+        flush_wanted.notify_one();
+    if (!hook)
+        ++no_writes;
     return 0;
 }
 
@@ -52,6 +406,7 @@ Disk::write(unsigned block_no, uint8_t *blk)
 int
 Disk::read(unsigned block_no, uint8_t *blk)
 {
+    TRACE_SPAN("Disk::read");
     if (DEBUG)
         std::cout << "Disk::read(" << block_no << ")\n";
     // check if valid block number
@@ -59,8 +414,215 @@ Disk::read(unsigned block_no, uint8_t *blk)
         std::cout << "Disk::write - ERROR: Invalid block number (" << block_no << ")\n";
         return -1;
     }
-    unsigned offset = block_no * BLOCK_SIZE;
-    diskfile.seekg(offset, std::ios_base::beg);
-    diskfile.read((char*)blk, BLOCK_SIZE);
+    {
+        // a block not yet flushed is read from memory
+        std::lock_guard<std::mutex> guard(cache_lock);
+        auto it = dirty.find(block_no);
+        if (it != dirty.end()) {
+            std::memcpy(blk, it->second.data, BLOCK_SIZE);
+            ++no_reads;
+            return 0;
+        }
+    }
+    if (pread(member_of(block_no).fd, blk, BLOCK_SIZE, member_offset(block_no)) != BLOCK_SIZE)
+        return -1;
+    ++no_reads;
+    if (verify && checksums[block_no] != 0 && crc32c(0, blk, BLOCK_SIZE) != checksums[block_no]) {
+        std::cout << "Disk::read - ERROR: Checksum mismatch in block " << block_no << "\n";
+        return -1;
+    }
+    return 0;
+}
+
+// reads the <count> consecutive blocks starting at <block_no>, from all the
+// member files they are on at once
+int
+Disk::read_blocks(unsigned block_no, unsigned count, uint8_t *blk)
+{
+    TRACE_SPAN("Disk::read_blocks");
+    if (DEBUG)
+        std::cout << "Disk::read_blocks(" << block_no << ", " << count << ")\n";
+    // check if valid block numbers
+    if (block_no + count > no_blocks) {
+        std::cout << "Disk::read - ERROR: Invalid block number (" << block_no + count - 1 << ")\n";
+        return -1;
+    }
+    bool cached;
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        auto it = dirty.lower_bound(block_no);
+        cached = it != dirty.end() && it->first < block_no + count;
+    }
+    // some of the blocks are not flushed yet: one at a time, from memory
+    // where they are there
+    if (cached || count == 1) {
+        for (unsigned i = 0; i < count; ++i) {
+            if (read(block_no + i, blk + (size_t)i * BLOCK_SIZE))
+                return -1;
+        }
+        return 0;
+    }
+    if (transfer(block_no, count, blk, false))
+        return -1;
+    no_reads += count;
+    for (unsigned i = 0; verify && i < count; ++i) {
+        unsigned b = block_no + i;
+        if (checksums[b] != 0 && crc32c(0, blk + (size_t)i * BLOCK_SIZE, BLOCK_SIZE) != checksums[b]) {
+            std::cout << "Disk::read - ERROR: Checksum mismatch in block " << b << "\n";
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// copies <len> bytes from <in> at <in_off> to <out> at <out_off>, in the
+// kernel with copy_file_range() if possible, otherwise through a buffer
+int
+Disk::copy_range(int in, off_t in_off, int out, off_t out_off, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = copy_file_range(in, &in_off, out, &out_off, len, 0);
+        if (n > 0) {
+            len -= n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n == 0 || (errno != EXDEV && errno != ENOSYS && errno != EINVAL &&
+                       errno != EOPNOTSUPP))
+            return -1;
+        // no in-kernel copy between these files, fall back to large reads and writes
+        std::vector<char> buf(std::min<size_t>(len, 1 << 20));
+        while (len > 0) {
+            ssize_t r = pread(in, buf.data(), std::min(len, buf.size()), in_off);
+            if (r <= 0)
+                return -1;
+            if (pwrite(out, buf.data(), r, out_off) != r)
+                return -1;
+            in_off += r;
+            out_off += r;
+            len -= r;
+        }
+    }
+    return 0;
+}
+
+// copies <len> bytes from the host file <fd> at <off> into the <count>
+// consecutive blocks starting at <block_no>, zero filling the last block
+int
+Disk::copy_in(unsigned block_no, unsigned count, int fd, off_t off, size_t len)
+{
+    TRACE_SPAN("Disk::copy_in");
+    if (read_only || block_no + count > no_blocks || len > (size_t)count * BLOCK_SIZE)
+        return -1;
+    // the blocks are written past the cache: older data of theirs still
+    // waiting for the flusher must not land on top
+    std::lock_guard<std::mutex> flush_guard(flush_lock);
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        dirty.erase(dirty.lower_bound(block_no), dirty.lower_bound(block_no + count));
+        flushed.notify_all();
+    }
+    uint8_t zero[BLOCK_SIZE];
+    std::memset(zero, 0, BLOCK_SIZE);
+    // each member copies its stripes of the range. With checksums the data
+    // passes through a buffer and each block is checksummed on the way, so
+    // that it is not read back from the disk; without them the kernel copies
+    int ret = for_each_member(block_no, (size_t)count * BLOCK_SIZE,
+                              [&](disk_member &m, off_t offset,
+                                  const std::vector<std::pair<size_t, size_t> > &pieces) {
+        std::vector<uint8_t> buf;
+        bool copied = false;
+        for (size_t i = 0; i < pieces.size(); ++i) {
+            size_t start = pieces[i].first, end = start + pieces[i].second;
+            size_t data_end = std::min(std::max(start, len), end);
+            if (verify) {
+                for (size_t pos = start; pos < end; ) {
+                    size_t n = std::min<size_t>(COPY_IN_CHUNK, end - pos);
+                    size_t data = data_end > pos ? std::min(n, data_end - pos) : 0;
+                    buf.assign(n, 0);
+                    if (data > 0 && pread(fd, buf.data(), data, off + pos) != (ssize_t)data)
+                        return -1;
+                    for (size_t k = 0; k < n; k += BLOCK_SIZE)
+                        set_checksum(block_no + (pos + k) / BLOCK_SIZE, buf.data() + k);
+                    if (pwrite(m.fd, buf.data(), n, offset + (pos - start)) != (ssize_t)n)
+                        return -1;
+                    pos += n;
+                }
+                copied = copied || data_end > start;
+                offset += end - start;
+                continue;
+            }
+            if (data_end > start) {
+                if (copy_range(fd, off + start, m.fd, offset, data_end - start))
+                    return -1;
+                copied = true;
+            }
+            for (size_t done = data_end; done < end; ) {
+                size_t pad = std::min<size_t>(BLOCK_SIZE, end - done);
+                if (pwrite(m.fd, zero, pad, offset + (done - start)) != (ssize_t)pad)
+                    return -1;
+                done += pad;
+            }
+            offset += end - start;
+        }
+        if (copied)
+            ++no_device_writes;
+        return 0;
+    });
+    if (ret)
+        return -1;
+    // blocks copied by the kernel have no checksum
+    for (unsigned i = 0; !verify && i < count; ++i)
+        set_checksum(block_no + i, zero);
+    no_writes += count;
+    return 0;
+}
+
+// copies the first <len> bytes of the <count> consecutive blocks starting
+// at <block_no> to the host file <fd> at <off>
+int
+Disk::copy_out(unsigned block_no, unsigned count, int fd, off_t off, size_t len)
+{
+    TRACE_SPAN("Disk::copy_out");
+    if (block_no + count > no_blocks || len > (size_t)count * BLOCK_SIZE)
+        return -1;
+    // the blocks are read past the cache, so their data must be on the disk files
+    std::lock_guard<std::mutex> flush_guard(flush_lock);
+    bool cached;
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        auto it = dirty.lower_bound(block_no);
+        cached = it != dirty.end() && it->first < block_no + count;
+    }
+    if (cached && flush_locked())
+        return -1;
+    // every block is checked before any of it is copied
+    uint8_t blk[BLOCK_SIZE];
+    for (unsigned i = 0; verify && i < count; ++i) {
+        unsigned b = block_no + i;
+        if (checksums[b] == 0)
+            continue;
+        if (pread(member_of(b).fd, blk, BLOCK_SIZE, member_offset(b)) != BLOCK_SIZE)
+            return -1;
+        if (crc32c(0, blk, BLOCK_SIZE) != checksums[b]) {
+            std::cout << "Disk::copy_out - ERROR: Checksum mismatch in block " << b << "\n";
+            return -1;
+        }
+    }
+    // each member copies its stripes of the range
+    int ret = for_each_member(block_no, len,
+                              [&](disk_member &m, off_t offset,
+                                  const std::vector<std::pair<size_t, size_t> > &pieces) {
+        for (size_t i = 0; i < pieces.size(); ++i) {
+            if (copy_range(m.fd, offset, fd, off + pieces[i].first, pieces[i].second))
+                return -1;
+            offset += pieces[i].second;
+        }
+        return 0;
+    });
+    if (ret)
+        return -1;
+    no_reads += count;
     return 0;
 }
@@ -1,5 +1,18 @@
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 #ifndef __DISK_H__
 #define __DISK_H__
@@ -7,22 +20,164 @@
 #define DISKNAME "diskfile.bin"
 #define BLOCK_SIZE 4096
 #define DEBUG false
+// blocks 2 and 3, right after the root directory and the FAT, hold the
+// checksum table: one CRC32C per block of the disk
+#define CHECKSUM_BLOCK 2
+#define CHECKSUM_BLOCKS 2
+// written blocks are kept in memory and written to the disk file by a
+// background thread once DIRTY_FLUSH_BLOCKS of them are waiting or the
+// oldest has waited DIRTY_AGE_MS; write() waits for the flusher when
+// DIRTY_MAX_BLOCKS are waiting
+#define DIRTY_FLUSH_BLOCKS 64
+#define DIRTY_MAX_BLOCKS 256
+#define DIRTY_AGE_MS 500
+// copy_in() with checksums reads the host file COPY_IN_CHUNK bytes at a time
+#define COPY_IN_CHUNK (256 * BLOCK_SIZE)
+// The disk may be striped across DISK_MEMBERS files, named DISKNAME.0,
+// DISKNAME.1, ...; with one member it is the single file DISKNAME. Runs of
+// STRIPE_BLOCKS blocks go to the members in turn, and a multi-block request
+// reaches every member it touches at once
+#ifndef DISK_MEMBERS
+#define DISK_MEMBERS 1
+#endif
+#ifndef STRIPE_BLOCKS
+#define STRIPE_BLOCKS 4
+#endif
 
+// a written block not yet on the disk file
+struct dirty_block {
+    uint8_t data[BLOCK_SIZE];
+    std::chrono::steady_clock::time_point since;
+    // changes with every write of the block, so that the flusher only
+    // forgets the data it has written
+    unsigned long version;
+};
+
+// One file of a striped disk, with the thread doing the I/O of
+// multi-block requests on it
+struct disk_member {
+    // accessed with pread() / pwrite()
+    int fd = -1;
+    std::mutex lock;
+    std::condition_variable wanted;
+    std::deque<std::function<void()> > jobs;
+    bool stopping = false;
+    std::thread worker;
+};
+
+// Blocks may be read and written from several threads at once; the same
+// block is not accessed concurrently, the callers see to that.
 class Disk {
 private:
-    std::fstream diskfile;
+    // the disk files; block b is in stripe b / stripe_blocks, which is
+    // stripe (b / stripe_blocks) / members.size() of member file
+    // (b / stripe_blocks) % members.size()
+    std::vector<std::unique_ptr<disk_member> > members;
+    unsigned stripe_blocks;
+    // opened for reading only: writes fail and there is no flusher
+    bool read_only;
     const unsigned no_blocks = 2048;
     const unsigned disk_size = BLOCK_SIZE * no_blocks;
+    // number of blocks read / written since the disk was opened; a block of
+    // the checksum table counts once per sync() in which it changed, and
+    // blocks written by the flush hook are not counted, as when it runs
+    // depends on the flusher
+    std::atomic<unsigned long> no_reads{0};
+    std::atomic<unsigned long> no_writes{0};
+    // number of writes to the disk files, a run of adjacent blocks of one
+    // file being one
+    std::atomic<unsigned long> no_device_writes{0};
+    // CRC32C of every block, 0 if not recorded; written back with the
+    // dirty blocks. <checksums_changed> is what sync() counts
+    std::vector<std::atomic<uint32_t> > checksums;
+    std::atomic<bool> checksums_dirty[CHECKSUM_BLOCKS];
+    std::atomic<bool> checksums_changed[CHECKSUM_BLOCKS];
+    // blocks waiting for the flusher, by block number
+    std::map<unsigned, dirty_block> dirty;
+    unsigned long next_version = 0;
+    std::mutex cache_lock;
+    std::condition_variable flush_wanted, flushed;
+    // one flush at a time; also keeps the flusher out of copy_in/copy_out
+    std::mutex flush_lock;
+    std::thread flusher;
+    bool stopping = false;
+    // run by the flusher each time it wakes up, see set_flush_hook(); the
+    // lock is held while it runs
+    std::function<void()> flush_hook;
+    std::mutex hook_lock;
+    void flusher_main();
+    // writes every dirty block and then the checksum table if it changed;
+    // flush_lock is held
+    int flush_locked();
+    // compute checksums on write and check them on read
+    std::atomic<bool> verify{true};
+    // records the checksum of block <block_no> holding <blk>
+    void set_checksum(unsigned block_no, const uint8_t *blk);
     bool disk_file_exists (const std::string& name);
+    // the member file holding block <block_no>, and the offset of the block in it
+    disk_member &member_of(unsigned block_no);
+    off_t member_offset(unsigned block_no);
+    // the I/O thread of member <m>
+    void member_main(disk_member *m);
+    // runs <jobs>, job i on member i, those after the first one on the
+    // member threads; returns -1 if any of them failed
+    int run_members(std::vector<std::function<int()> > &jobs);
+    // reads (or with <write> writes) the <count> consecutive blocks starting
+    // at <block_no> from (to) <buf>, one preadv() / pwritev() per member,
+    // without the cache, checksums or counters
+    int transfer(unsigned block_no, unsigned count, uint8_t *buf, bool write);
+    // splits the <len> bytes starting at block <block_no> by member file and
+    // calls <fn>(member, offset in it, pieces) for each member they are on,
+    // as in run_members(); the pieces, (offset in the range, length), follow
+    // each other in the member file from that offset
+    int for_each_member(unsigned block_no, size_t len,
+                        const std::function<int(disk_member&, off_t,
+                            const std::vector<std::pair<size_t, size_t> >&)> &fn);
+    // copies <len> bytes from <in> at <in_off> to <out> at <out_off>
+    int copy_range(int in, off_t in_off, int out, off_t out_off, size_t len);
 public:
-    Disk();
+    // opens the disk file <name>, or with several members the files
+    // <name>.0, <name>.1, ..., creating them if they do not exist
+    Disk(bool read_only = false, const std::string &name = DISKNAME,
+         unsigned no_members = DISK_MEMBERS, unsigned stripe_blocks = STRIPE_BLOCKS);
     ~Disk();
     unsigned get_no_blocks() { return no_blocks; }
+    unsigned get_no_members() { return members.size(); }
+    unsigned get_stripe_blocks() { return stripe_blocks; }
     unsigned get_disk_size() { return disk_size; }
-    // writes one block to the disk
+    unsigned long get_no_reads() { return no_reads; }
+    unsigned long get_no_writes() { return no_writes; }
+    unsigned long get_no_device_writes() { return no_device_writes; }
+    // turns checksums on or off; blocks written while they are off are not
+    // checked later
+    void set_checksums(bool on) { verify = on; }
+    // checksum of block <block_no>, 0 if none is recorded
+    uint32_t get_checksum(unsigned block_no) { return checksums[block_no]; }
+    // forgets every checksum, for a newly formatted disk
+    void clear_checksums();
+    // writes back all dirty blocks and the checksum table, and waits for it
+    int sync();
+    // has the flusher run <hook> each time it wakes up, so that blocks the
+    // caller keeps in memory are written with write() on the same schedule
+    // as the others; <hook> must not wait for locks held while writing. An
+    // empty <hook> removes it, after waiting for a run of it to end
+    void set_flush_hook(std::function<void()> hook);
+    // writes one block to the disk; it reaches the disk file later, see
+    // DIRTY_FLUSH_BLOCKS
     int write(unsigned block_no, uint8_t *blk);
-    // reads one block from the disk
+    // reads one block from the disk, failing if it does not match its checksum
     int read(unsigned block_no, uint8_t *blk);
+    // reads the <count> consecutive blocks starting at <block_no>, from all
+    // the member files they are on at once
+    int read_blocks(unsigned block_no, unsigned count, uint8_t *blk);
+    // copies <len> bytes from the host file <fd> at <off> into the <count>
+    // consecutive blocks starting at <block_no>, zero filling the last block.
+    // With checksums the data is read once and checksummed on the way;
+    // without them the kernel copies it where it can
+    int copy_in(unsigned block_no, unsigned count, int fd, off_t off, size_t len);
+    // copies the first <len> bytes of the <count> consecutive blocks starting
+    // at <block_no> to the host file <fd> at <off>
+    int copy_out(unsigned block_no, unsigned count, int fd, off_t off, size_t len);
 };
 
 #endif // __DISK_H__
@@ -1,114 +1,1473 @@
 #include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <thread>
+#include <condition_variable>
 #include "fs.h"
+#include "glob.h"
+#include "lz.h"
+#include "trace.h"
 
-FS::FS()
+// the session the calling thread runs commands for, nullptr for the console
+static thread_local fs_session *current_session = nullptr;
+
+// where messages of the calling thread go
+static std::ostream &
+messages()
+{
+    return current_session ? *current_session->out : std::cout;
+}
+
+// prints an error message for command <cmd> on <path> and returns -1
+static int
+fs_error(const char *cmd, std::string_view path, const char *msg)
+{
+    messages() << cmd << ": " << path << ": " << msg << "\n";
+    return -1;
+}
+
+static bool
+entry_used(const dir_entry& e)
+{
+    return e.file_name[0] != '\0';
+}
+
+static bool
+entry_is_parent(const dir_entry& e)
+{
+    return std::strcmp(e.file_name, "..") == 0;
+}
+
+static bool
+block_is_zero(const uint8_t *buf)
+{
+    return buf[0] == 0 && std::memcmp(buf, buf + 1, BLOCK_SIZE - 1) == 0;
+}
+
+// prints a problem found by check() in block <blk> and counts it
+static void
+check_error(unsigned &problems, unsigned blk, const char *msg)
+{
+    messages() << "check: block " << blk << ": " << msg << "\n";
+    ++problems;
+}
+
+FS::FS() : read_only(false), root_blk(ROOT_BLOCK)
 {
     std::cout << "FS::FS()... Creating file system\n";
+    // the FAT is kept in memory; commands changing directories write it
+    // back, changes made through handles are written by the flusher, see
+    // write_back(), or by the next sync
+    disk.read(FAT_BLOCK, (uint8_t*)fat);
+    fat_dirty = false;
+    for (int i = 0; i < HOLE_BLOCKS; ++i)
+        disk.read(HOLE_BLOCK + i, (uint8_t*)holes + i * BLOCK_SIZE);
+    holes_dirty = false;
+    console.cwd = ROOT_BLOCK;
+    console.in = &std::cin;
+    console.out = &std::cout;
+    console.out_fd = STDOUT_FILENO;
+    for (int i = 0; i < MAX_OPEN_FILES; ++i)
+        handles[i].used = false;
+    // block references are not stored on the disk, they are counted anew
+    std::memset(refs, 0, sizeof(refs));
+    if (fat[ROOT_BLOCK] == FAT_EOF) {
+        std::vector<bool> seen(disk.get_no_blocks());
+        scan_refs(ROOT_BLOCK, seen);
+        // the files of snapshots share blocks with the live ones
+        snapshot_entry table[SNAPSHOT_ENTRIES];
+        if (fat[SNAPSHOT_BLOCK] == FAT_EOF && disk.read(SNAPSHOT_BLOCK, (uint8_t*)table) == 0) {
+            for (unsigned i = 0; i < SNAPSHOT_ENTRIES; ++i) {
+                if (table[i].name[0] != '\0' && table[i].root_blk < disk.get_no_blocks())
+                    scan_refs(table[i].root_blk, seen);
+            }
+        }
+    }
+    disk.set_flush_hook([this]() { write_back(); });
+}
+
+// mounts snapshot <snapshot> read-only, with the FAT and hole table frozen
+// when it was taken; the disk file is not written
+FS::FS(std::string_view snapshot) : disk(true), read_only(true), root_blk(disk.get_no_blocks())
+{
+    std::cout << "FS::FS()... Mounting snapshot " << snapshot << " read-only\n";
+    std::memset(fat, 0, sizeof(fat));
+    fat_dirty = false;
+    std::memset(holes, 0, sizeof(holes));
+    holes_dirty = false;
+    console.in = &std::cin;
+    console.out = &std::cout;
+    console.out_fd = STDOUT_FILENO;
+    for (int i = 0; i < MAX_OPEN_FILES; ++i)
+        handles[i].used = false;
+    std::memset(refs, 0, sizeof(refs));
+    snapshot_entry table[SNAPSHOT_ENTRIES];
+    int idx = find_snapshot(table, Name(snapshot));
+    bool ok = idx >= 0 && disk.read(table[idx].fat_blk, (uint8_t*)fat) == 0;
+    for (int i = 0; ok && i < HOLE_BLOCKS; ++i)
+        ok = disk.read(table[idx].hole_blks[i], (uint8_t*)holes + i * BLOCK_SIZE) == 0;
+    if (!ok) {
+        // every command fails, see mounted()
+        std::cout << "FS::FS()... Cannot mount snapshot " << snapshot << "\n";
+        std::memset(fat, 0, sizeof(fat));
+        console.cwd = root_blk;
+        return;
+    }
+    root_blk = table[idx].root_blk;
+    console.cwd = root_blk;
+    std::vector<bool> seen(disk.get_no_blocks());
+    scan_refs(root_blk, seen);
+}
+
+// the session of the calling thread
+fs_session &
+FS::session()
+{
+    return current_session ? *current_session : console;
+}
+
+// attach makes the calling thread run commands for session <s>, which
+// starts in the root directory
+void
+FS::attach(fs_session &s)
+{
+    std::unique_lock<std::shared_mutex> tree(tree_lock);
+    s.cwd = root_blk;
+    sessions.push_back(&s);
+    current_session = &s;
+}
+
+// detach returns the calling thread to the console
+void
+FS::detach(fs_session &s)
+{
+    std::unique_lock<std::shared_mutex> tree(tree_lock);
+    sessions.erase(std::find(sessions.begin(), sessions.end(), &s));
+    current_session = nullptr;
+}
+
+// resume makes the calling thread run commands for the attached session <s>
+// again, in its current directory
+void
+FS::resume(fs_session &s)
+{
+    current_session = &s;
+}
+
+// suspend returns the calling thread to the console
+void
+FS::suspend()
+{
+    current_session = nullptr;
 }
 
 FS::~FS()
 {
+    disk.set_flush_hook(nullptr);
+    for (int i = 0; i < MAX_OPEN_FILES; ++i) {
+        if (handles[i].used)
+            close(i);
+    }
+    sync();
+}
+
+// fails with an error for command <cmd> on <path> if the file system is a
+// mounted snapshot
+int
+FS::writable(const char *cmd, std::string_view path)
+{
+    return read_only ? fs_error(cmd, path, "Read-only file system") : 0;
+}
+
+// reads one directory block
+int
+FS::read_dir(uint16_t blk, dir_entry *dir)
+{
+    return disk.read(blk, (uint8_t*)dir);
+}
+
+// writes one directory block
+int
+FS::write_dir(uint16_t blk, dir_entry *dir)
+{
+    return disk.write(blk, (uint8_t*)dir);
+}
+
+// writes the in-memory FAT to the FAT block, and the hole table if changed
+int
+FS::write_fat()
+{
+    TRACE_SPAN("FS::write_fat");
+    fat_dirty = false;
+    if (disk.write(FAT_BLOCK, (uint8_t*)fat))
+        return -1;
+    if (holes_dirty) {
+        holes_dirty = false;
+        for (int i = 0; i < HOLE_BLOCKS; ++i) {
+            if (disk.write(HOLE_BLOCK + i, (uint8_t*)holes + i * BLOCK_SIZE))
+                return -1;
+        }
+    }
+    return 0;
+}
+
+// the flush hook of the disk: writes the FAT and the hole table if they
+// changed. A command holding them is not waited for, as it may itself be
+// waiting for the flusher; the next run of the hook writes them
+void
+FS::write_back()
+{
+    std::unique_lock<std::shared_mutex> fat_guard(fat_lock, std::try_to_lock);
+    if (fat_guard.owns_lock() && (fat_dirty || holes_dirty))
+        write_fat();
+}
+
+// sets the number of hole blocks following block <blk>
+void
+FS::set_holes(uint16_t blk, uint32_t n)
+{
+    if (holes[blk] != n) {
+        holes[blk] = n;
+        holes_dirty = true;
+    }
+}
+
+// returns the index of <name> in <dir>, or -1 if there is no such entry
+int
+FS::find_entry(dir_entry *dir, const Name& name)
+{
+    for (unsigned i = 0; i < DIR_ENTRIES; ++i) {
+        if (entry_used(dir[i]) && name.matches(dir[i].file_name))
+            return i;
+    }
+    return -1;
+}
+
+// returns the index of the first unused entry in <dir>, or -1 if full
+int
+FS::free_entry(dir_entry *dir)
+{
+    for (unsigned i = 0; i < DIR_ENTRIES; ++i) {
+        if (!entry_used(dir[i]))
+            return i;
+    }
+    return -1;
+}
+
+// resolves <path> (absolute or relative) to the block of a directory
+int
+FS::resolve_dir(std::string_view path, uint16_t &blk)
+{
+    TRACE_SPAN("FS::lookup");
+    dir_entry dir[DIR_ENTRIES];
+    PathTokenizer tok(path);
+    uint16_t cur = tok.absolute() ? root_blk : session().cwd;
+    std::string_view comp;
+    while (tok.next(comp)) {
+        if (comp == ".." && cur == root_blk)
+            continue;
+        std::shared_lock<std::shared_mutex> guard(dir_lock(cur));
+        if (read_dir(cur, dir))
+            return -1;
+        // ".." is always the first entry of a sub-directory
+        int i = find_entry(dir, Name(comp));
+        if (i < 0 || dir[i].type != TYPE_DIR)
+            return -1;
+        cur = dir[i].first_blk;
+    }
+    blk = cur;
+    return 0;
+}
+
+// splits <path> into the block of its parent directory and its last component
+int
+FS::resolve_parent(std::string_view path, uint16_t &parent, Name &name)
+{
+    while (path.size() > 1 && path.back() == '/')
+        path.remove_suffix(1);
+    size_t slash = path.rfind('/');
+    if (slash == std::string_view::npos) {
+        parent = session().cwd;
+        name.assign(path);
+        return 0;
+    }
+    name.assign(path.substr(slash + 1));
+    return resolve_dir(slash == 0 ? "/" : path.substr(0, slash), parent);
+}
+
+// resolves the destination of cp / mv: an existing directory <destpath> means
+// "inside it, keeping <name>", otherwise <destpath> names the new entry
+int
+FS::resolve_dest(std::string_view destpath, const char *name,
+                 uint16_t &parent, Name &destname)
+{
+    uint16_t blk;
+    if (resolve_dir(destpath, blk) == 0) {
+        parent = blk;
+        destname.assign(name);
+        return 0;
+    }
+    return resolve_parent(destpath, parent, destname);
+}
+
+// locks directories <a> and <b>, which may be the same, exclusively
+void
+FS::lock_dirs(uint16_t a, uint16_t b, std::unique_lock<std::shared_mutex> &la,
+              std::unique_lock<std::shared_mutex> &lb)
+{
+    std::shared_mutex *ma = &dir_lock(a), *mb = &dir_lock(b);
+    if (ma == mb) {
+        la = std::unique_lock<std::shared_mutex>(*ma);
+        return;
+    }
+    if (ma > mb) {
+        lb = std::unique_lock<std::shared_mutex>(*mb);
+        la = std::unique_lock<std::shared_mutex>(*ma);
+    } else {
+        la = std::unique_lock<std::shared_mutex>(*ma);
+        lb = std::unique_lock<std::shared_mutex>(*mb);
+    }
+}
+
+// returns true if directory <blk> is <ancestor> or lies somewhere below it
+bool
+FS::is_below(uint16_t blk, uint16_t ancestor)
+{
+    dir_entry dir[DIR_ENTRIES];
+    for (unsigned depth = 0; depth < disk.get_no_blocks(); ++depth) {
+        if (blk == ancestor)
+            return true;
+        if (blk == root_blk || read_dir(blk, dir))
+            return false;
+        blk = dir[0].first_blk;
+    }
+    return false;
+}
+
+// number of blocks needed to store <size> bytes (at least one)
+unsigned
+FS::blocks_for(uint32_t size)
+{
+    return size == 0 ? 1 : (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+// finds <n> free blocks in a single pass over the FAT and reserves them
+int
+FS::alloc_blocks(unsigned n, std::vector<uint16_t> &blocks)
+{
+    TRACE_SPAN("FS::allocate");
+    blocks.clear();
+    blocks.reserve(n);
+    for (unsigned i = 0; i < disk.get_no_blocks() && blocks.size() < n; ++i) {
+        if (fat[i] == FAT_FREE)
+            blocks.push_back(i);
+    }
+    if (blocks.size() < n) {
+        blocks.clear();
+        return -1;
+    }
+    for (size_t i = 0; i < blocks.size(); ++i)
+        fat[blocks[i]] = FAT_EOF;
+    return 0;
+}
+
+// reserves one free block, searching from <hint> onwards, or returns -1
+int
+FS::alloc_block(uint16_t hint)
+{
+    TRACE_SPAN("FS::allocate");
+    unsigned n = disk.get_no_blocks();
+    for (unsigned i = 0; i < n; ++i) {
+        unsigned blk = (hint + i) % n;
+        if (fat[blk] == FAT_FREE) {
+            fat[blk] = FAT_EOF;
+            return blk;
+        }
+    }
+    return -1;
+}
+
+// links <blocks> into one chain in the FAT, terminated by FAT_EOF
+void
+FS::link_chain(const std::vector<uint16_t> &blocks)
+{
+    for (size_t i = 0; i < blocks.size(); ++i)
+        fat[blocks[i]] = i + 1 < blocks.size() ? blocks[i + 1] : FAT_EOF;
+}
+
+// appends every block of the chain starting at <first> to <blocks>
+void
+FS::collect_chain(uint16_t first, std::vector<uint16_t> &blocks)
+{
+    int16_t blk = first;
+    for (unsigned n = 0; blk != FAT_EOF && n < disk.get_no_blocks(); ++n) {
+        blocks.push_back(blk);
+        blk = fat[blk];
+    }
+}
+
+// number of blocks in the chain starting at <first>
+unsigned
+FS::chain_length(uint16_t first)
+{
+    unsigned n = 0;
+    for (int16_t blk = first; blk != FAT_EOF && n < disk.get_no_blocks(); blk = fat[blk])
+        ++n;
+    return n;
+}
+
+// drops one reference to the chain starting at <first>, freeing the
+// blocks no other file uses
+void
+FS::release_chain(uint16_t first)
+{
+    int16_t blk = first;
+    for (unsigned n = 0; blk != FAT_EOF && n < disk.get_no_blocks(); ++n) {
+        if (refs[blk] > 1) {
+            // the rest of the chain belongs to another file as well
+            --refs[blk];
+            return;
+        }
+        int16_t next = fat[blk];
+        auto it = dedup_index.find(dedup_key(blk, next));
+        if (it != dedup_index.end() && it->second == blk)
+            dedup_index.erase(it);
+        refs[blk] = 0;
+        fat[blk] = FAT_FREE;
+        set_holes(blk, 0);
+        blk = next;
+    }
+}
+
+// counts the references to every file block below directory <blk> and
+// adds the blocks to the dedup index
+void
+FS::scan_refs(uint16_t blk, std::vector<bool> &seen)
+{
+    dir_entry dir[DIR_ENTRIES];
+    seen[blk] = true;
+    if (read_dir(blk, dir))
+        return;
+    for (unsigned i = 0; i < DIR_ENTRIES; ++i) {
+        if (!entry_used(dir[i]) || entry_is_parent(dir[i]))
+            continue;
+        uint16_t first = dir[i].first_blk;
+        if (first >= disk.get_no_blocks() || fat[first] == FAT_FREE)
+            continue;
+        if (dir[i].type == TYPE_DIR) {
+            if (!seen[first])
+                scan_refs(first, seen);
+            continue;
+        }
+        // a block reached before is the start of a shared tail, whose
+        // references further on are counted already
+        ++refs[first];
+        for (int16_t b = first; !seen[b]; b = fat[b]) {
+            seen[b] = true;
+            index_block(b, fat[b]);
+            if (fat[b] == FAT_EOF || fat[b] == FAT_FREE)
+                break;
+            ++refs[fat[b]];
+        }
+    }
+}
+
+// blocks are matched by checksum, successor and the hole in between; equal
+// keys are only a hint, the content is compared before a block is shared
+uint64_t
+FS::dedup_key(uint16_t blk, int16_t next)
+{
+    return (uint64_t)disk.get_checksum(blk) << 32 | (uint64_t)(uint16_t)holes[blk] << 16 |
+           (uint16_t)next;
+}
+
+void
+FS::index_block(uint16_t blk, int16_t next)
+{
+    // blocks written with checksums off have none and are not shared
+    if (disk.get_checksum(blk) != 0)
+        dedup_index[dedup_key(blk, next)] = blk;
+}
+
+// returns a file block other than <blk> with the same content and
+// successor <next>, or -1
+int
+FS::find_duplicate(uint16_t blk, int16_t next)
+{
+    if (disk.get_checksum(blk) == 0)
+        return -1;
+    auto it = dedup_index.find(dedup_key(blk, next));
+    if (it == dedup_index.end() || it->second == blk)
+        return -1;
+    uint16_t dup = it->second;
+    if (refs[dup] == 0 || fat[dup] != next || holes[dup] != holes[blk] ||
+        disk.get_checksum(dup) != disk.get_checksum(blk)) {
+        // the block was freed or rewritten since it was indexed
+        dedup_index.erase(it);
+        return -1;
+    }
+    uint8_t a[BLOCK_SIZE], b[BLOCK_SIZE];
+    if (disk.read(blk, a) || disk.read(dup, b) || std::memcmp(a, b, BLOCK_SIZE))
+        return -1;
+    return dup;
+}
+
+// replaces the blocks of the chain starting at <first>, from the end
+// back to block <from>, by identical blocks found in the dedup index
+int
+FS::dedup_chain(uint16_t &first, uint32_t from)
+{
+    std::vector<uint16_t> chain;
+    collect_chain(first, chain);
+    // <from> counts holes as blocks, start is its place in the chain
+    size_t start = 0;
+    for (uint32_t pos = 0; start < chain.size() && pos < from; ++start)
+        pos += 1 + holes[chain[start]];
+    int16_t next = FAT_EOF;
+    bool shared = false;
+    for (size_t i = chain.size(); i-- > 0; ) {
+        uint16_t blk = chain[i];
+        if (refs[blk] > 1) {
+            // a shared tail already
+            next = blk;
+            continue;
+        }
+        int dup = find_duplicate(blk, next);
+        if (dup < 0) {
+            // nothing else links to this block, so no block in front of it
+            // can match another one; the blocks written are indexed
+            index_block(blk, next);
+            for (size_t j = i; j-- > start; )
+                index_block(chain[j], chain[j + 1]);
+            break;
+        }
+        if (i == 0)
+            first = dup;
+        else
+            fat[chain[i - 1]] = dup;
+        ++refs[dup];
+        if (next != FAT_EOF)
+            --refs[next];
+        refs[blk] = 0;
+        fat[blk] = FAT_FREE;
+        set_holes(blk, 0);
+        fat_dirty = true;
+        shared = true;
+        next = dup;
+    }
+    if (shared)
+        chains_shared();
+    return shared;
+}
+
+// a shared chain was created: no handle may assume its blocks are private
+void
+FS::chains_shared()
+{
+    for (int i = 0; i < MAX_OPEN_FILES; ++i)
+        handles[i].private_upto = 0;
+}
 
+// the chain of the file of <h> was cut or re-pointed, or its entry changed:
+// the other handles on the file drop their cached chain position and block,
+// and take over its first block and size. They only read, see open_at(), so
+// nothing of theirs is lost. A compressed file is as long as its chunks
+// written so far
+void
+FS::refresh_handles(open_file &h)
+{
+    for (int i = 0; i < MAX_OPEN_FILES; ++i) {
+        open_file &o = handles[i];
+        if (&o == &h || !o.used || o.dir_blk != h.dir_blk || o.dir_idx != h.dir_idx)
+            continue;
+        o.first_blk = h.first_blk;
+        o.size = h.size;
+        o.private_upto = 0;
+        o.chain_idx = 0;
+        o.chain_blk = o.first_blk;
+        o.buf_idx = -1;
+        if (o.compressed) {
+            std::memcpy(o.index, h.index, sizeof(o.index));
+            o.size = std::min(o.size, o.index[0] ? o.index[o.index[0]] : 0);
+            o.raw_idx = -1;
+        }
+    }
+}
+
+// copies block src[i] to dst[i] for the first <n> blocks. A reader thread
+// fills a ring of COPY_RING_BLOCKS buffers while this thread writes them
+// out, so that reads and writes overlap
+int
+FS::copy_blocks(const std::vector<uint16_t> &src, const std::vector<uint16_t> &dst, size_t n)
+{
+    if (!pipelined_copy || n < COPY_PIPELINE_MIN) {
+        uint8_t data[BLOCK_SIZE];
+        for (size_t i = 0; i < n; ++i) {
+            if (disk.read(src[i], data) || disk.write(dst[i], data))
+                return -1;
+        }
+        return 0;
+    }
+    std::vector<uint8_t> ring(COPY_RING_BLOCKS * BLOCK_SIZE);
+    std::mutex lock;
+    std::condition_variable changed;
+    // blocks read into the ring, blocks written from it
+    size_t filled = 0, drained = 0;
+    bool failed = false;
+    std::thread reader([&]() {
+        for (size_t i = 0; i < n; ++i) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&]() { return failed || i - drained < COPY_RING_BLOCKS; });
+                if (failed)
+                    return;
+            }
+            int ret = disk.read(src[i], &ring[i % COPY_RING_BLOCKS * BLOCK_SIZE]);
+            std::lock_guard<std::mutex> guard(lock);
+            if (ret)
+                failed = true;
+            else
+                filled = i + 1;
+            changed.notify_all();
+            if (ret)
+                return;
+        }
+    });
+    int ret = 0;
+    for (size_t i = 0; i < n && ret == 0; ++i) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return failed || filled > i; });
+            if (failed) {
+                ret = -1;
+                break;
+            }
+        }
+        if (disk.write(dst[i], &ring[i % COPY_RING_BLOCKS * BLOCK_SIZE]))
+            ret = -1;
+        std::lock_guard<std::mutex> guard(lock);
+        drained = i + 1;
+        failed = failed || ret;
+        changed.notify_all();
+    }
+    reader.join();
+    return ret;
+}
+
+// copies shared blocks up to block <idx> of <h> so that they can be
+// changed; <whole> means block <idx> is overwritten and not copied
+int
+FS::make_private(open_file &h, uint32_t idx, bool whole)
+{
+    TRACE_SPAN("FS::make_private");
+    if (idx < h.private_upto)
+        return 0;
+    uint32_t pos = 0;
+    int prev = -1;
+    int16_t blk = h.first_blk;
+    if (h.private_upto > 0) {
+        // the last block in front of private_upto, which may be in a hole
+        if (seek_chain(h, h.private_upto - 1, false) < 0)
+            return -1;
+        prev = h.chain_blk;
+        pos = h.chain_idx + 1 + holes[prev];
+        blk = fat[prev];
+    }
+    // find the first shared block; the blocks after it are shared as well
+    for (;;) {
+        if (blk == FAT_EOF || pos > idx)
+            return -1;
+        if (refs[blk] > 1 || pos == idx)
+            break;
+        prev = blk;
+        pos += 1 + holes[blk];
+        blk = fat[blk];
+    }
+    if (refs[blk] > 1) {
+        std::vector<uint16_t> src, dst;
+        for (int16_t b = blk; ; b = fat[b]) {
+            if (b == FAT_EOF || pos > idx)
+                return -1;
+            src.push_back(b);
+            if (pos == idx)
+                break;
+            pos += 1 + holes[b];
+        }
+        // the copies are allocated together, so that they are adjacent
+        // where the free space allows it
+        if (alloc_blocks(src.size(), dst))
+            return -1;
+        if (copy_blocks(src, dst, whole ? src.size() - 1 : src.size())) {
+            for (size_t i = 0; i < dst.size(); ++i)
+                fat[dst[i]] = FAT_FREE;
+            return -1;
+        }
+        // the copies take the place of the shared blocks in this chain
+        // only: the first of those loses a reference, the block after the
+        // last gains one
+        for (size_t i = 0; i < dst.size(); ++i) {
+            fat[dst[i]] = i + 1 < dst.size() ? dst[i + 1] : fat[src.back()];
+            set_holes(dst[i], holes[src[i]]);
+            refs[dst[i]] = 1;
+        }
+        if (fat[src.back()] != FAT_EOF)
+            ++refs[fat[src.back()]];
+        --refs[src[0]];
+        if (prev < 0) {
+            h.first_blk = dst[0];
+            h.entry_dirty = true;
+        } else {
+            fat[prev] = dst[0];
+        }
+        fat_dirty = true;
+        blk = dst.back();
+        refresh_handles(h);
+    }
+    h.private_upto = idx + 1;
+    h.chain_idx = idx;
+    h.chain_blk = blk;
+    return 0;
 }
 
 // formats the disk, i.e., creates an empty file system
 int
 FS::format()
 {
-    std::cout << "FS::format()\n";
-    this->fat[0] = ROOT_BLOCK;
-    this->fat[1] = FAT_BLOCK;
+    if (DEBUG)
+        std::cout << "FS::format()\n";
+    if (read_only) {
+        messages() << "format: Read-only file system\n";
+        return -1;
+    }
+    dir_entry root[DIR_ENTRIES];
+    std::unique_lock<std::shared_mutex> tree(tree_lock);
+    std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
 
+    this->fat[ROOT_BLOCK] = FAT_EOF;
+    this->fat[FAT_BLOCK] = FAT_EOF;
     for (int i = 2; i < BLOCK_SIZE / 2; ++i)
     {
         this->fat[i] = FAT_FREE;
     }
+    // the checksum table starts out empty, its blocks are never allocated
+    for (int i = 0; i < CHECKSUM_BLOCKS; ++i)
+        this->fat[CHECKSUM_BLOCK + i] = FAT_EOF;
+    for (int i = 0; i < HOLE_BLOCKS; ++i)
+        this->fat[HOLE_BLOCK + i] = FAT_EOF;
+    this->fat[SNAPSHOT_BLOCK] = FAT_EOF;
+    std::memset(holes, 0, sizeof(holes));
+    holes_dirty = true;
+    disk.clear_checksums();
+    std::memset(refs, 0, sizeof(refs));
+    dedup_index.clear();
 
+    // an empty root directory and an empty snapshot table
+    std::memset(root, 0, sizeof(root));
+    if (write_dir(ROOT_BLOCK, root) || disk.write(SNAPSHOT_BLOCK, (uint8_t*)root) || write_fat())
+        return -1;
+    console.cwd = ROOT_BLOCK;
+    for (size_t i = 0; i < sessions.size(); ++i)
+        sessions[i]->cwd = ROOT_BLOCK;
     return 0;
 }
 
 // create <filepath> creates a new file on the disk, the data content is
 // written on the following rows (ended with an empty row)
 int
-FS::create(std::string filepath)
+FS::create(std::string_view filepath)
 {
-    std::cout << "FS::create(" << filepath << ")\n";
-    
-    int i = 0;
+    if (DEBUG)
+        std::cout << "FS::create(" << filepath << ")\n";
+    int fd = open_path("create", filepath, WRITE | CREATE);
+    if (fd < 0)
+        return -1;
+    int ret = write_rows("create", filepath, fd);
+    if (close(fd))
+        ret = -1;
+    if (ret)
+        rm(filepath);
+    return ret;
+}
 
-    while(i < BLOCK_SIZE / 2)
-    {
+// writes the rows read from the input of the session, up to an empty row,
+// at the offset of <fd>; with <fd> -1 the rows are only consumed
+int
+FS::write_rows(const char *cmd, std::string_view filepath, int fd)
+{
+    std::istream &in = *session().in;
+    // the input may have hit end-of-file in an earlier create
+    in.clear();
+    if (&in == &std::cin)
+        clearerr(stdin);
+    // the data is streamed in chunks of at most one block, each handed to
+    // the open file as it is read, so memory use does not grow with the file.
+    // getline() never reads past the end of the empty row. All data rows are
+    // consumed even after an error, so that they are not taken for commands.
+    char buf[BLOCK_SIZE];
+    bool line_start = true;
+    int ret = fd < 0 ? -1 : 0;
+    while (in.getline(buf, sizeof(buf)) || in.gcount() > 0) {
+        size_t n = in.gcount();
+        // a full buffer stops getline() in the middle of a row
+        bool full = in.fail() && !in.eof();
+        bool row_end = !in.eof() && !full;
+        if (full)
+            in.clear();
+        if (line_start && row_end && n == 1)
+            break;
+        line_start = row_end;
+        if (row_end)
+            buf[n - 1] = '\n';
+        if (ret == 0 && n > 0 && write(fd, buf, n) < 0)
+            ret = fs_error(cmd, filepath, "No space left on disk");
+        if (in.eof())
+            break;
+    }
+    // the last row ended at end-of-file without a newline
+    if (!line_start && ret == 0 && write(fd, "\n", 1) < 0)
+        ret = fs_error(cmd, filepath, "No space left on disk");
+    return ret;
+}
 
+// write <filepath> <offset> writes the following rows (ended with an empty
+// row) over the file from <offset> on, extending it if they reach past its
+// end; only the blocks written change
+int
+FS::write_at(std::string_view filepath, uint32_t offset)
+{
+    if (DEBUG)
+        std::cout << "FS::write_at(" << filepath << "," << offset << ")\n";
+    int fd = open_path("write", filepath, WRITE);
+    if (fd >= 0 && handles[fd].compressed && offset < handles[fd].size) {
+        // compressed data can only be added to
+        fs_error("write", filepath, "Compressed file, uncompress it first");
+        close(fd);
+        fd = -1;
     }
+    if (fd >= 0)
+        seek(fd, offset);
+    int ret = write_rows("write", filepath, fd);
+    if (fd >= 0 && close(fd))
+        ret = -1;
+    return ret;
+}
 
-    return 0;
+// truncate <filepath> <size> cuts the file to <size> bytes, or extends it
+// with zeros, which take no blocks
+int
+FS::truncate(std::string_view filepath, uint32_t size)
+{
+    if (DEBUG)
+        std::cout << "FS::truncate(" << filepath << "," << size << ")\n";
+    int fd = open_path("truncate", filepath, WRITE);
+    if (fd < 0)
+        return -1;
+    int ret;
+    {
+        std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+        ret = resize(handles[fd], size);
+    }
+    if (ret)
+        fs_error("truncate", filepath, "No space left on disk");
+    if (close(fd))
+        ret = -1;
+    return ret;
 }
 
 // cat <filepath> reads the content of a file and prints it on the screen
 int
-FS::cat(std::string filepath)
+FS::cat(std::string_view filepath)
 {
-    std::cout << "FS::cat(" << filepath << ")\n";
-    return 0;
+    if (DEBUG)
+        std::cout << "FS::cat(" << filepath << ")\n";
+    int fd = open_path("cat", filepath, READ);
+    if (fd < 0)
+        return -1;
+
+    // blocks are read straight into the output buffer, a buffer full at a
+    // time, which is written out when full and once more at the end
+    Output out(session().out_fd, *session().out);
+    int n;
+    while ((n = read(fd, out.reserve(OUTPUT_BUFFER_SIZE), OUTPUT_BUFFER_SIZE)) > 0)
+        out.commit(n);
+    close(fd);
+    out.flush();
+    return n < 0 ? -1 : 0;
+}
+
+// prints <len> bytes of <filepath> starting at <offset>, or with <from_end>
+// starting <offset> bytes before the end of the file
+int
+FS::print_range(const char *cmd, std::string_view filepath, uint32_t offset,
+                uint32_t len, bool from_end)
+{
+    int fd = open_path(cmd, filepath, READ);
+    if (fd < 0)
+        return -1;
+    // the chain is followed in the in-memory FAT, so only the blocks in
+    // the range are read
+    uint32_t size = handles[fd].size;
+    if (from_end)
+        offset = size > offset ? size - offset : 0;
+    Output out(session().out_fd, *session().out);
+    int n = 0;
+    if (seek(fd, offset) == 0) {
+        while (len > 0) {
+            uint32_t want = std::min<uint32_t>(len, BLOCK_SIZE);
+            if ((n = read(fd, out.reserve(want), want)) <= 0)
+                break;
+            out.commit(n);
+            len -= n;
+        }
+    }
+    close(fd);
+    out.flush();
+    return n < 0 ? -1 : 0;
+}
+
+// head -c <n> <filepath> prints the first <n> bytes of a file
+int
+FS::head(std::string_view filepath, uint32_t n)
+{
+    if (DEBUG)
+        std::cout << "FS::head(" << filepath << "," << n << ")\n";
+    return print_range("head", filepath, 0, n, false);
+}
+
+// tail -c <n> <filepath> prints the last <n> bytes of a file
+int
+FS::tail(std::string_view filepath, uint32_t n)
+{
+    if (DEBUG)
+        std::cout << "FS::tail(" << filepath << "," << n << ")\n";
+    return print_range("tail", filepath, n, n, true);
+}
+
+// read <filepath> <offset> <len> prints <len> bytes of a file starting at
+// <offset>
+int
+FS::read_range(std::string_view filepath, uint32_t offset, uint32_t len)
+{
+    if (DEBUG)
+        std::cout << "FS::read_range(" << filepath << "," << offset << "," << len << ")\n";
+    return print_range("read", filepath, offset, len, false);
 }
 
 // ls lists the content in the currect directory (files and sub-directories)
 int
 FS::ls()
 {
-    std::cout << "FS::ls()\n";
-    return 0;
+    if (DEBUG)
+        std::cout << "FS::ls()\n";
+    dir_entry dir[DIR_ENTRIES];
+    const dir_entry *entries[DIR_ENTRIES];
+    unsigned count = 0;
+
+    {
+        std::shared_lock<std::shared_mutex> tree(tree_lock);
+        uint16_t blk = session().cwd;
+        std::shared_lock<std::shared_mutex> guard(dir_lock(blk));
+        if (read_dir(blk, dir))
+            return -1;
+    }
+    for (unsigned i = 0; i < DIR_ENTRIES; ++i) {
+        if (entry_used(dir[i]) && !entry_is_parent(dir[i]))
+            entries[count++] = &dir[i];
+    }
+    std::sort(entries, entries + count,
+              [](const dir_entry *a, const dir_entry *b) {
+                  return std::strcmp(a->file_name, b->file_name) < 0;
+              });
+
+    Output out(session().out_fd, *session().out);
+    out.put("name\t type\t accessrights\t size\n");
+    for (unsigned i = 0; i < count; ++i) {
+        const dir_entry *e = entries[i];
+        out.put(e->file_name);
+        out.put(e->type == TYPE_DIR ? "\t dir\t " : "\t file\t ");
+        out.put(e->access_rights & READ ? 'r' : '-');
+        out.put(e->access_rights & WRITE ? 'w' : '-');
+        out.put(e->access_rights & EXECUTE ? 'x' : '-');
+        out.put("\t ");
+        if (e->type == TYPE_DIR)
+            out.put("-\n");
+        else {
+            out.put(e->size);
+            out.put('\n');
+        }
+    }
+    return out.flush();
 }
 
 // cp <sourcepath> <destpath> makes an exact copy of the file
-// <sourcepath> to a new file <destpath>
+// <sourcepath> to a new file <destpath>. The copy gets blocks of its own:
+// a chain shared with the original would have to be copied up to the
+// block written by the first write to either file, all of it for an append
 int
-FS::cp(std::string sourcepath, std::string destpath)
+FS::cp(std::string_view sourcepath, std::string_view destpath)
 {
-    std::cout << "FS::cp(" << sourcepath << "," << destpath << ")\n";
+    if (DEBUG)
+        std::cout << "FS::cp(" << sourcepath << "," << destpath << ")\n";
+    if (writable("cp", destpath))
+        return -1;
+    std::shared_lock<std::shared_mutex> tree(tree_lock);
+    return cp_file(sourcepath, destpath);
+}
+
+// cp of a single file, with the tree lock held
+int
+FS::cp_file(std::string_view sourcepath, std::string_view destpath)
+{
+    dir_entry sdir[DIR_ENTRIES], ddir[DIR_ENTRIES];
+    uint16_t sparent, dparent;
+    Name sname, dname;
+
+    if (resolve_parent(sourcepath, sparent, sname))
+        return fs_error("cp", sourcepath, "No such file");
+    // both directories are looked up before either is locked
+    bool no_dest = resolve_dest(destpath, sname.c_str(), dparent, dname) != 0;
+    std::unique_lock<std::shared_mutex> slock, dlock;
+    lock_dirs(sparent, no_dest ? sparent : dparent, slock, dlock);
+    if (read_dir(sparent, sdir))
+        return fs_error("cp", sourcepath, "No such file");
+    int sidx = find_entry(sdir, sname);
+    if (sidx < 0 || entry_is_parent(sdir[sidx]))
+        return fs_error("cp", sourcepath, "No such file");
+    if (sdir[sidx].type != TYPE_FILE)
+        return fs_error("cp", sourcepath, "Is a directory");
+    if (!(sdir[sidx].access_rights & READ))
+        return fs_error("cp", sourcepath, "Permission denied");
+    if (no_dest)
+        return fs_error("cp", destpath, "No such directory");
+    // the destination may be the source's own directory block
+    dir_entry *dir = sdir;
+    if (dparent != sparent) {
+        if (read_dir(dparent, ddir))
+            return fs_error("cp", destpath, "No such directory");
+        dir = ddir;
+    }
+    if (!dname.valid())
+        return fs_error("cp", destpath, "Invalid file name");
+    if (find_entry(dir, dname) >= 0)
+        return fs_error("cp", destpath, "File exists");
+    int didx = free_entry(dir);
+    if (didx < 0)
+        return fs_error("cp", destpath, "Directory is full");
+
+    // the copy keeps the access rights (and compression) of the original
+    dir[didx] = sdir[sidx];
+    dname.copy_to(dir[didx].file_name);
+    std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+    std::vector<uint16_t> src, dst;
+    collect_chain(sdir[sidx].first_blk, src);
+    // the copies are allocated together, so that they are adjacent where
+    // the free space allows it
+    if (alloc_blocks(src.size(), dst))
+        return fs_error("cp", destpath, "No space left on disk");
+    if (copy_blocks(src, dst, dst.size())) {
+        for (size_t i = 0; i < dst.size(); ++i)
+            fat[dst[i]] = FAT_FREE;
+        return -1;
+    }
+    link_chain(dst);
+    for (size_t i = 0; i < dst.size(); ++i) {
+        set_holes(dst[i], holes[src[i]]);
+        refs[dst[i]] = 1;
+    }
+    dir[didx].first_blk = dst[0];
+    if (write_fat() || write_dir(dparent, dir))
+        return -1;
     return 0;
 }
 
 // mv <sourcepath> <destpath> renames the file <sourcepath> to the name <destpath>,
 // or moves the file <sourcepath> to the directory <destpath> (if dest is a directory)
 int
-FS::mv(std::string sourcepath, std::string destpath)
+FS::mv(std::string_view sourcepath, std::string_view destpath)
 {
-    std::cout << "FS::mv(" << sourcepath << "," << destpath << ")\n";
+    if (DEBUG)
+        std::cout << "FS::mv(" << sourcepath << "," << destpath << ")\n";
+    if (writable("mv", sourcepath))
+        return -1;
+    dir_entry sdir[DIR_ENTRIES], ddir[DIR_ENTRIES];
+    uint16_t sparent, dparent;
+    Name sname, dname;
+    // a directory may be moved, which changes the paths below it
+    std::unique_lock<std::shared_mutex> tree(tree_lock);
+
+    if (resolve_parent(sourcepath, sparent, sname) || read_dir(sparent, sdir))
+        return fs_error("mv", sourcepath, "No such file");
+    int sidx = find_entry(sdir, sname);
+    if (sidx < 0 || entry_is_parent(sdir[sidx]))
+        return fs_error("mv", sourcepath, "No such file");
+    dir_entry entry = sdir[sidx];
+    // close() writes the size back to where the entry was
+    if (entry.type == TYPE_FILE && is_open(sparent, sidx, READ | WRITE))
+        return fs_error("mv", sourcepath, "File is open");
+
+    if (resolve_dest(destpath, sdir[sidx].file_name, dparent, dname))
+        return fs_error("mv", destpath, "No such directory");
+    if (!dname.valid())
+        return fs_error("mv", destpath, "Invalid file name");
+    if (entry.type == TYPE_DIR && is_below(dparent, entry.first_blk))
+        return fs_error("mv", destpath, "Cannot move a directory into itself");
+
+    if (dparent == sparent) {
+        if (find_entry(sdir, dname) >= 0)
+            return fs_error("mv", destpath, "File exists");
+        dname.copy_to(sdir[sidx].file_name);
+        return write_dir(sparent, sdir);
+    }
+
+    if (read_dir(dparent, ddir))
+        return -1;
+    if (find_entry(ddir, dname) >= 0)
+        return fs_error("mv", destpath, "File exists");
+    int didx = free_entry(ddir);
+    if (didx < 0)
+        return fs_error("mv", destpath, "Directory is full");
+
+    ddir[didx] = entry;
+    dname.copy_to(ddir[didx].file_name);
+    std::memset(&sdir[sidx], 0, sizeof(dir_entry));
+    if (write_dir(dparent, ddir) || write_dir(sparent, sdir))
+        return -1;
+    if (entry.type == TYPE_DIR) {
+        // the moved directory gets a new parent
+        dir_entry moved[DIR_ENTRIES];
+        if (read_dir(entry.first_blk, moved))
+            return -1;
+        moved[0].first_blk = dparent;
+        return write_dir(entry.first_blk, moved);
+    }
     return 0;
 }
 
 // rm <filepath> removes / deletes the file <filepath>
 int
-FS::rm(std::string filepath)
+FS::rm(std::string_view filepath)
+{
+    if (DEBUG)
+        std::cout << "FS::rm(" << filepath << ")\n";
+    if (writable("rm", filepath))
+        return -1;
+    std::shared_lock<std::shared_mutex> tree(tree_lock);
+    return rm_file(filepath);
+}
+
+// rm of a single file, with the tree lock held
+int
+FS::rm_file(std::string_view filepath)
 {
-    std::cout << "FS::rm(" << filepath << ")\n";
+    dir_entry dir[DIR_ENTRIES];
+    uint16_t parent;
+    Name name;
+
+    if (resolve_parent(filepath, parent, name))
+        return fs_error("rm", filepath, "No such file");
+    std::unique_lock<std::shared_mutex> guard(dir_lock(parent));
+    if (read_dir(parent, dir))
+        return fs_error("rm", filepath, "No such file");
+    int idx = find_entry(dir, name);
+    if (idx < 0 || entry_is_parent(dir[idx]))
+        return fs_error("rm", filepath, "No such file");
+    if (dir[idx].type != TYPE_FILE)
+        return fs_error("rm", filepath, "Is a directory (use rm -r)");
+    std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+    if (is_open(parent, idx, READ | WRITE))
+        return fs_error("rm", filepath, "File is open");
+
+    release_chain(dir[idx].first_blk);
+    std::memset(&dir[idx], 0, sizeof(dir_entry));
+    if (write_fat() || write_dir(parent, dir))
+        return -1;
     return 0;
 }
 
 // append <filepath1> <filepath2> appends the contents of file <filepath1> to
 // the end of file <filepath2>. The file <filepath1> is unchanged.
 int
-FS::append(std::string filepath1, std::string filepath2)
+FS::append(std::string_view filepath1, std::string_view filepath2)
+{
+    if (DEBUG)
+        std::cout << "FS::append(" << filepath1 << "," << filepath2 << ")\n";
+    int sfd = open_path("append", filepath1, READ);
+    if (sfd < 0)
+        return -1;
+    int dfd = open_path("append", filepath2, WRITE);
+    if (dfd < 0) {
+        close(sfd);
+        return -1;
+    }
+
+    // the offset starts at the end of the destination, so only its last
+    // block is read back before new blocks are chained on
+    seek(dfd, handles[dfd].size);
+    uint8_t blk[BLOCK_SIZE];
+    int n, ret = 0;
+    while ((n = read(sfd, blk, BLOCK_SIZE)) > 0) {
+        if (write(dfd, blk, n) < 0) {
+            ret = fs_error("append", filepath2, "No space left on disk");
+            break;
+        }
+    }
+    if (n < 0)
+        ret = -1;
+    close(sfd);
+    if (close(dfd))
+        ret = -1;
+    return ret;
+}
+
+// recursively reads every directory block of the tree rooted at <blk> into
+// <dirs> (pre-order) and counts the directory blocks a copy of it needs;
+// with <need_read> every file must be readable
+int
+FS::plan_tree(uint16_t blk, std::vector<std::vector<dir_entry> > &dirs, unsigned &nblocks,
+              bool need_read)
+{
+    size_t me = dirs.size();
+    dirs.push_back(std::vector<dir_entry>(DIR_ENTRIES));
+    if (read_dir(blk, &dirs[me][0]))
+        return -1;
+    nblocks += 1;
+    for (unsigned i = 0; i < DIR_ENTRIES; ++i) {
+        // copy, since recursion may reallocate <dirs>
+        dir_entry e = dirs[me][i];
+        if (!entry_used(e) || entry_is_parent(e))
+            continue;
+        if (e.type == TYPE_DIR) {
+            if (plan_tree(e.first_blk, dirs, nblocks, need_read))
+                return -1;
+        } else {
+            if (need_read && !(e.access_rights & READ))
+                return fs_error("cp", e.file_name, "Permission denied");
+        }
+    }
+    return 0;
+}
+
+// copies the planned directory <dirs>[<next_dir>] and everything below it to
+// <dest_blk>, taking directory blocks from the preallocated <blocks>; the
+// files share the blocks of the originals
+int
+FS::copy_tree(std::vector<std::vector<dir_entry> > &dirs, size_t &next_dir,
+              uint16_t dest_blk, uint16_t dest_parent,
+              const std::vector<uint16_t> &blocks, size_t &next_blk)
+{
+    dir_entry out[DIR_ENTRIES];
+    std::memcpy(out, &dirs[next_dir++][0], sizeof(out));
+
+    for (unsigned i = 0; i < DIR_ENTRIES; ++i) {
+        if (!entry_used(out[i]))
+            continue;
+        if (entry_is_parent(out[i])) {
+            out[i].first_blk = dest_parent;
+        } else if (out[i].type == TYPE_DIR) {
+            uint16_t child = blocks[next_blk++];
+            out[i].first_blk = child;
+            if (copy_tree(dirs, next_dir, child, dest_blk, blocks, next_blk))
+                return -1;
+        } else {
+            ++refs[out[i].first_blk];
+        }
+    }
+    return write_dir(dest_blk, out);
+}
+
+// appends every directory block of the tree rooted at <blk> to <blocks>,
+// and the first block of every file in it to <files>
+int
+FS::collect_tree(uint16_t blk, std::vector<uint16_t> &blocks, std::vector<uint16_t> &files)
+{
+    dir_entry dir[DIR_ENTRIES];
+    if (read_dir(blk, dir))
+        return -1;
+    blocks.push_back(blk);
+    for (unsigned i = 0; i < DIR_ENTRIES; ++i) {
+        if (!entry_used(dir[i]) || entry_is_parent(dir[i]))
+            continue;
+        if (dir[i].type == TYPE_DIR) {
+            if (collect_tree(dir[i].first_blk, blocks, files))
+                return -1;
+        } else {
+            files.push_back(dir[i].first_blk);
+        }
+    }
+    return 0;
+}
+
+// cp -r <sourcepath> <destpath> copies the directory tree <sourcepath>
+// to <destpath>; directory blocks are allocated up front, files are
+// shared, and the FAT is written once
+int
+FS::cp_recursive(std::string_view sourcepath, std::string_view destpath)
+{
+    if (DEBUG)
+        std::cout << "FS::cp_recursive(" << sourcepath << "," << destpath << ")\n";
+    if (writable("cp", destpath))
+        return -1;
+    dir_entry sdir[DIR_ENTRIES], ddir[DIR_ENTRIES];
+    uint16_t sparent, dparent;
+    Name sname, dname;
+    // the source tree must not change while it is copied
+    std::unique_lock<std::shared_mutex> tree(tree_lock);
+
+    if (resolve_parent(sourcepath, sparent, sname) || read_dir(sparent, sdir))
+        return fs_error("cp", sourcepath, "No such file or directory");
+    int sidx = find_entry(sdir, sname);
+    if (sidx < 0 || entry_is_parent(sdir[sidx]))
+        return fs_error("cp", sourcepath, "No such file or directory");
+    if (sdir[sidx].type == TYPE_FILE)
+        return cp_file(sourcepath, destpath);
+    uint16_t src_blk = sdir[sidx].first_blk;
+
+    if (resolve_dest(destpath, sdir[sidx].file_name, dparent, dname) || read_dir(dparent, ddir))
+        return fs_error("cp", destpath, "No such directory");
+    if (!dname.valid())
+        return fs_error("cp", destpath, "Invalid file name");
+    if (is_below(dparent, src_blk))
+        return fs_error("cp", destpath, "Cannot copy a directory into itself");
+    if (find_entry(ddir, dname) >= 0)
+        return fs_error("cp", destpath, "File exists");
+    int didx = free_entry(ddir);
+    if (didx < 0)
+        return fs_error("cp", destpath, "Directory is full");
+
+    // read the whole source tree once, then reserve the directory blocks
+    std::vector<std::vector<dir_entry> > dirs;
+    std::vector<uint16_t> blocks;
+    unsigned nblocks = 0;
+    if (plan_tree(src_blk, dirs, nblocks, true))
+        return -1;
+    std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+    if (alloc_blocks(nblocks, blocks))
+        return fs_error("cp", destpath, "No space left on disk");
+
+    size_t next_dir = 0, next_blk = 1;
+    if (copy_tree(dirs, next_dir, blocks[0], dparent, blocks, next_blk))
+        return -1;
+    chains_shared();
+
+    ddir[didx] = sdir[sidx];
+    dname.copy_to(ddir[didx].file_name);
+    ddir[didx].first_blk = blocks[0];
+    if (write_fat() || write_dir(dparent, ddir))
+        return -1;
+    return 0;
+}
+
+// rm -r <path> removes the directory tree <path>; all blocks are freed
+// in one pass and the FAT is written once
+int
+FS::rm_recursive(std::string_view path)
 {
-    std::cout << "FS::append(" << filepath1 << "," << filepath2 << ")\n";
+    if (DEBUG)
+        std::cout << "FS::rm_recursive(" << path << ")\n";
+    if (writable("rm", path))
+        return -1;
+    dir_entry dir[DIR_ENTRIES];
+    uint16_t parent;
+    Name name;
+    std::unique_lock<std::shared_mutex> tree(tree_lock);
+
+    if (resolve_parent(path, parent, name) || read_dir(parent, dir))
+        return fs_error("rm", path, "No such file or directory");
+    int idx = find_entry(dir, name);
+    if (idx < 0 || entry_is_parent(dir[idx]))
+        return fs_error("rm", path, "No such file or directory");
+    if (dir[idx].type == TYPE_FILE)
+        return rm_file(path);
+    if (is_below(session().cwd, dir[idx].first_blk))
+        return fs_error("rm", path, "Cannot remove the current directory");
+    bool in_use = is_below(console.cwd, dir[idx].first_blk);
+    for (size_t i = 0; i < sessions.size(); ++i)
+        in_use = in_use || is_below(sessions[i]->cwd, dir[idx].first_blk);
+    if (in_use)
+        return fs_error("rm", path, "Directory is in use");
+
+    std::vector<uint16_t> blocks, files;
+    if (collect_tree(dir[idx].first_blk, blocks, files))
+        return -1;
+    std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+    if (any_open(blocks))
+        return fs_error("rm", path, "File is open");
+    for (size_t i = 0; i < blocks.size(); ++i)
+        fat[blocks[i]] = FAT_FREE;
+    for (size_t i = 0; i < files.size(); ++i)
+        release_chain(files[i]);
+    std::memset(&dir[idx], 0, sizeof(dir_entry));
+    if (write_fat() || write_dir(parent, dir))
+        return -1;
     return 0;
 }
 
 // mkdir <dirpath> creates a new sub-directory with the name <dirpath>
 // in the current directory
 int
-FS::mkdir(std::string dirpath)
+FS::mkdir(std::string_view dirpath)
 {
-    std::cout << "FS::mkdir(" << dirpath << ")\n";
+    if (DEBUG)
+        std::cout << "FS::mkdir(" << dirpath << ")\n";
+    if (writable("mkdir", dirpath))
+        return -1;
+    dir_entry dir[DIR_ENTRIES], sub[DIR_ENTRIES];
+    uint16_t parent;
+    Name name;
+    std::shared_lock<std::shared_mutex> tree(tree_lock);
+
+    if (resolve_parent(dirpath, parent, name))
+        return fs_error("mkdir", dirpath, "No such directory");
+    std::unique_lock<std::shared_mutex> guard(dir_lock(parent));
+    if (read_dir(parent, dir))
+        return fs_error("mkdir", dirpath, "No such directory");
+    if (!name.valid())
+        return fs_error("mkdir", dirpath, "Invalid directory name");
+    if (find_entry(dir, name) >= 0)
+        return fs_error("mkdir", dirpath, "File exists");
+    int idx = free_entry(dir);
+    if (idx < 0)
+        return fs_error("mkdir", dirpath, "Directory is full");
+
+    std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+    std::vector<uint16_t> blocks;
+    if (alloc_blocks(1, blocks))
+        return fs_error("mkdir", dirpath, "No space left on disk");
+
+    // every sub-directory starts with a ".." entry pointing to its parent
+    std::memset(sub, 0, sizeof(sub));
+    Name("..").copy_to(sub[0].file_name);
+    sub[0].first_blk = parent;
+    sub[0].type = TYPE_DIR;
+    sub[0].access_rights = READ | WRITE | EXECUTE;
+    if (write_dir(blocks[0], sub))
+        return -1;
+
+    name.copy_to(dir[idx].file_name);
+    dir[idx].size = 0;
+    dir[idx].first_blk = blocks[0];
+    dir[idx].type = TYPE_DIR;
+    dir[idx].access_rights = READ | WRITE | EXECUTE;
+    if (write_fat() || write_dir(parent, dir))
+        return -1;
     return 0;
 }
 
 // cd <dirpath> changes the current (working) directory to the directory named <dirpath>
 int
-FS::cd(std::string dirpath)
+FS::cd(std::string_view dirpath)
 {
-    std::cout << "FS::cd(" << dirpath << ")\n";
+    if (DEBUG)
+        std::cout << "FS::cd(" << dirpath << ")\n";
+    uint16_t blk;
+    std::shared_lock<std::shared_mutex> tree(tree_lock);
+    if (resolve_dir(dirpath, blk))
+        return fs_error("cd", dirpath, "No such directory");
+    session().cwd = blk;
     return 0;
 }
 
@@ -117,15 +1476,1358 @@ FS::cd(std::string dirpath)
 int
 FS::pwd()
 {
-    std::cout << "FS::pwd()\n";
+    if (DEBUG)
+        std::cout << "FS::pwd()\n";
+    dir_entry dir[DIR_ENTRIES];
+    std::string path;
+    std::shared_lock<std::shared_mutex> tree(tree_lock);
+    uint16_t blk = session().cwd;
+
+    // walk the ".." entries up to the root, looking up each name in its parent
+    while (blk != root_blk) {
+        std::shared_lock<std::shared_mutex> guard(dir_lock(blk));
+        if (read_dir(blk, dir))
+            return -1;
+        uint16_t parent = dir[0].first_blk;
+        guard.unlock();
+        guard = std::shared_lock<std::shared_mutex>(dir_lock(parent));
+        if (read_dir(parent, dir))
+            return -1;
+        int i;
+        for (i = 0; i < (int)DIR_ENTRIES; ++i) {
+            if (entry_used(dir[i]) && !entry_is_parent(dir[i]) &&
+                dir[i].type == TYPE_DIR && dir[i].first_blk == blk)
+                break;
+        }
+        if (i == (int)DIR_ENTRIES)
+            return -1;
+        path = "/" + std::string(dir[i].file_name) + path;
+        blk = parent;
+    }
+    *session().out << (path.empty() ? "/" : path) << "\n";
     return 0;
 }
 
 // chmod <accessrights> <filepath> changes the access rights for the
 // file <filepath> to <accessrights>.
 int
-FS::chmod(std::string accessrights, std::string filepath)
+FS::chmod(std::string_view accessrights, std::string_view filepath)
+{
+    if (DEBUG)
+        std::cout << "FS::chmod(" << accessrights << "," << filepath << ")\n";
+    if (writable("chmod", filepath))
+        return -1;
+    dir_entry dir[DIR_ENTRIES];
+    uint16_t parent;
+    Name name;
+
+    if (accessrights.size() != 1 || accessrights[0] < '0' || accessrights[0] > '7')
+        return fs_error("chmod", accessrights, "Invalid access rights");
+    std::shared_lock<std::shared_mutex> tree(tree_lock);
+    if (resolve_parent(filepath, parent, name))
+        return fs_error("chmod", filepath, "No such file");
+    std::unique_lock<std::shared_mutex> guard(dir_lock(parent));
+    if (read_dir(parent, dir))
+        return fs_error("chmod", filepath, "No such file");
+    int idx = find_entry(dir, name);
+    if (idx < 0 || entry_is_parent(dir[idx]))
+        return fs_error("chmod", filepath, "No such file");
+    dir[idx].access_rights = (dir[idx].access_rights & COMPRESSED) | (accessrights[0] - '0');
+    return write_dir(parent, dir);
+}
+
+// import <hostpath> <filepath> copies the host file <hostpath> into the
+// new file <filepath>; runs of consecutive blocks are copied in one go
+int
+FS::import_file(std::string_view hostpath, std::string_view filepath)
+{
+    if (DEBUG)
+        std::cout << "FS::import_file(" << hostpath << "," << filepath << ")\n";
+    if (writable("import", filepath))
+        return -1;
+    dir_entry dir[DIR_ENTRIES];
+    uint16_t parent;
+    Name name;
+    std::shared_lock<std::shared_mutex> tree(tree_lock);
+
+    if (resolve_parent(filepath, parent, name))
+        return fs_error("import", filepath, "No such directory");
+    std::unique_lock<std::shared_mutex> guard(dir_lock(parent));
+    if (read_dir(parent, dir))
+        return fs_error("import", filepath, "No such directory");
+    if (!name.valid())
+        return fs_error("import", filepath, "Invalid file name");
+    if (find_entry(dir, name) >= 0)
+        return fs_error("import", filepath, "File exists");
+    int idx = free_entry(dir);
+    if (idx < 0)
+        return fs_error("import", filepath, "Directory is full");
+
+    int fd = ::open(std::string(hostpath).c_str(), O_RDONLY);
+    if (fd < 0)
+        return fs_error("import", hostpath, "Cannot open host file");
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size > UINT32_MAX) {
+        ::close(fd);
+        return fs_error("import", hostpath, "Not a regular file or too large");
+    }
+    uint32_t size = st.st_size;
+
+    // all blocks are reserved in one pass, in ascending order, so that free
+    // space that is contiguous on the disk gives long runs
+    std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+    std::vector<uint16_t> blocks;
+    if (alloc_blocks(blocks_for(size), blocks)) {
+        ::close(fd);
+        return fs_error("import", filepath, "No space left on disk");
+    }
+    link_chain(blocks);
+    for (size_t b = 0; b < blocks.size(); ++b)
+        refs[blocks[b]] = 1;
+    uint32_t done = 0;
+    for (size_t i = 0; i < blocks.size(); ) {
+        size_t run = 1;
+        while (i + run < blocks.size() && blocks[i + run] == blocks[i] + run)
+            ++run;
+        uint32_t len = std::min<uint64_t>((uint64_t)run * BLOCK_SIZE, size - done);
+        if (disk.copy_in(blocks[i], run, fd, done, len)) {
+            release_chain(blocks[0]);
+            ::close(fd);
+            return fs_error("import", hostpath, "Read error");
+        }
+        done += len;
+        i += run;
+    }
+    ::close(fd);
+    uint16_t first = blocks[0];
+    dedup_chain(first, 0);
+
+    name.copy_to(dir[idx].file_name);
+    dir[idx].size = size;
+    dir[idx].first_blk = first;
+    dir[idx].type = TYPE_FILE;
+    dir[idx].access_rights = READ | WRITE;
+    if (write_fat() || write_dir(parent, dir))
+        return -1;
+    return 0;
+}
+
+// export <filepath> <hostpath> copies the file <filepath> to the host
+// file <hostpath>, replacing it if it exists
+int
+FS::export_file(std::string_view filepath, std::string_view hostpath)
+{
+    if (DEBUG)
+        std::cout << "FS::export_file(" << filepath << "," << hostpath << ")\n";
+    dir_entry dir[DIR_ENTRIES];
+    uint16_t parent;
+    Name name;
+    std::shared_lock<std::shared_mutex> tree(tree_lock);
+
+    if (resolve_parent(filepath, parent, name))
+        return fs_error("export", filepath, "No such file");
+    // the file may not change while it is copied
+    std::shared_lock<std::shared_mutex> guard(dir_lock(parent));
+    std::shared_lock<std::shared_mutex> fat_guard(fat_lock);
+    if (read_dir(parent, dir))
+        return fs_error("export", filepath, "No such file");
+    int idx = find_entry(dir, name);
+    if (idx < 0 || entry_is_parent(dir[idx]))
+        return fs_error("export", filepath, "No such file");
+    if (dir[idx].type != TYPE_FILE)
+        return fs_error("export", filepath, "Is a directory");
+    if (!(dir[idx].access_rights & READ))
+        return fs_error("export", filepath, "Permission denied");
+
+    int fd = ::open(std::string(hostpath).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return fs_error("export", hostpath, "Cannot open host file");
+    if ((dir[idx].access_rights & COMPRESSED) ||
+        chain_length(dir[idx].first_blk) < blocks_for(dir[idx].size)) {
+        // the blocks do not hold the data as is: it is decoded on the way,
+        // or holes are filled in with zeros
+        int sfd = new_handle(parent, idx, dir[idx], READ);
+        if (sfd < 0) {
+            ::close(fd);
+            return fs_error("export", filepath, "Too many open files");
+        }
+        uint8_t buf[CHUNK_RAW_MAX];
+        int n, ret = 0;
+        while ((n = read_handle(handles[sfd], buf, sizeof(buf))) > 0) {
+            if (::write(fd, buf, n) != n) {
+                ret = fs_error("export", hostpath, "Write error");
+                break;
+            }
+        }
+        if (n < 0)
+            ret = -1;
+        close_handle(handles[sfd]);
+        ::close(fd);
+        return ret;
+    }
+    std::vector<uint16_t> chain;
+    collect_chain(dir[idx].first_blk, chain);
+    uint32_t size = dir[idx].size, done = 0;
+    for (size_t i = 0; i < chain.size() && done < size; ) {
+        size_t run = 1;
+        while (i + run < chain.size() && chain[i + run] == chain[i] + run)
+            ++run;
+        uint32_t len = std::min<uint64_t>((uint64_t)run * BLOCK_SIZE, size - done);
+        if (disk.copy_out(chain[i], run, fd, done, len)) {
+            ::close(fd);
+            return fs_error("export", hostpath, "Write error");
+        }
+        done += len;
+        i += run;
+    }
+    ::close(fd);
+    return 0;
+}
+
+// compress <filepath> / uncompress <filepath> rewrites the file stored
+// compressed or plain; the content does not change
+int
+FS::compress(std::string_view filepath, bool on)
+{
+    if (DEBUG)
+        std::cout << "FS::compress(" << filepath << "," << on << ")\n";
+    const char *cmd = on ? "compress" : "uncompress";
+    if (writable(cmd, filepath))
+        return -1;
+    dir_entry dir[DIR_ENTRIES];
+    uint16_t parent;
+    Name name;
+    std::shared_lock<std::shared_mutex> tree(tree_lock);
+
+    if (resolve_parent(filepath, parent, name))
+        return fs_error(cmd, filepath, "No such file");
+    std::unique_lock<std::shared_mutex> guard(dir_lock(parent));
+    if (read_dir(parent, dir))
+        return fs_error(cmd, filepath, "No such file");
+    int idx = find_entry(dir, name);
+    if (idx < 0 || entry_is_parent(dir[idx]))
+        return fs_error(cmd, filepath, "No such file");
+    if (dir[idx].type != TYPE_FILE)
+        return fs_error(cmd, filepath, "Is a directory");
+    if ((bool)(dir[idx].access_rights & COMPRESSED) == on)
+        return 0;
+    uint16_t old_first = dir[idx].first_blk;
+    std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+    if (is_open(parent, idx, READ | WRITE))
+        return fs_error(cmd, filepath, "File is open");
+
+    // the data is copied to a new chain through a second handle; its
+    // dir_entry does not point at that chain, so close() leaves it alone
+    int blk = alloc_block(parent);
+    if (blk < 0)
+        return fs_error(cmd, filepath, "No space left on disk");
+    refs[blk] = 1;
+    dir_entry e = dir[idx];
+    e.size = 0;
+    e.first_blk = blk;
+    e.access_rights ^= COMPRESSED;
+    int sfd = new_handle(parent, idx, dir[idx], READ);
+    int dfd = new_handle(parent, idx, e, WRITE | CREATE);
+    if (sfd < 0 || dfd < 0) {
+        if (sfd >= 0)
+            close_handle(handles[sfd]);
+        release_chain(blk);
+        return fs_error(cmd, filepath, "Too many open files");
+    }
+    uint8_t buf[BLOCK_SIZE];
+    int n, ret = 0;
+    while ((n = read_handle(handles[sfd], buf, BLOCK_SIZE)) > 0) {
+        if (write_handle(handles[dfd], buf, n) < 0) {
+            ret = fs_error(cmd, filepath, "No space left on disk");
+            break;
+        }
+    }
+    if (n < 0)
+        ret = -1;
+    // the source goes first: close() of the second handle hands its chain
+    // to the other handles on the entry
+    close_handle(handles[sfd]);
+    if (close_handle(handles[dfd]))
+        ret = -1;
+    // close may have replaced the first block by an identical one
+    uint16_t new_first = handles[dfd].first_blk;
+
+    // whichever chain is not used any more is released
+    release_chain(ret ? new_first : old_first);
+    if (ret == 0) {
+        dir[idx].first_blk = new_first;
+        dir[idx].access_rights ^= COMPRESSED;
+        if (write_dir(parent, dir))
+            ret = -1;
+    }
+    if (write_fat())
+        ret = -1;
+    return ret;
+}
+
+// reads the snapshot table into <table> and returns the index of snapshot
+// <name>, or -1 if there is none
+int
+FS::find_snapshot(snapshot_entry *table, const Name &name)
+{
+    if (disk.read(SNAPSHOT_BLOCK, (uint8_t*)table))
+        return -1;
+    for (unsigned i = 0; i < SNAPSHOT_ENTRIES; ++i) {
+        if (table[i].name[0] != '\0' && name.matches(table[i].name))
+            return i;
+    }
+    return -1;
+}
+
+// fills <frozen> and <frozen_holes> with the FAT entries and holes of the
+// file chains in <dirs>; the snapshot's directory blocks, the first
+// <dirs>.size() of <blocks>, are marked in use. Everything else is free
+void
+FS::freeze_fat(const std::vector<std::vector<dir_entry> > &dirs,
+               const std::vector<uint16_t> &blocks, int16_t *frozen, uint32_t *frozen_holes)
+{
+    std::memset(frozen, 0, BLOCK_SIZE);
+    std::memset(frozen_holes, 0, HOLE_BLOCKS * BLOCK_SIZE);
+    for (unsigned b = 0; b < FIRST_DATA_BLOCK; ++b)
+        frozen[b] = FAT_EOF;
+    for (size_t i = 0; i < dirs.size(); ++i)
+        frozen[blocks[i]] = FAT_EOF;
+    for (size_t d = 0; d < dirs.size(); ++d) {
+        for (unsigned i = 0; i < DIR_ENTRIES; ++i) {
+            const dir_entry &e = dirs[d][i];
+            if (!entry_used(e) || entry_is_parent(e) || e.type != TYPE_FILE)
+                continue;
+            // a shared tail is frozen once
+            for (int16_t b = e.first_blk; frozen[b] == FAT_FREE; b = fat[b]) {
+                frozen[b] = fat[b];
+                frozen_holes[b] = holes[b];
+                if (fat[b] == FAT_EOF || fat[b] == FAT_FREE)
+                    break;
+            }
+        }
+    }
+}
+
+// snapshot <name> takes a read-only snapshot of the whole file system: the
+// directory blocks are copied, the FAT and hole table frozen, and the files
+// share their blocks with the live ones. It is on the disk when this returns
+int
+FS::snapshot(std::string_view name)
+{
+    if (DEBUG)
+        std::cout << "FS::snapshot(" << name << ")\n";
+    if (writable("snapshot", name))
+        return -1;
+    Name sname(name);
+    if (!sname.valid())
+        return fs_error("snapshot", name, "Invalid snapshot name");
+    snapshot_entry table[SNAPSHOT_ENTRIES];
+    {
+        // nothing may change while the tree is frozen
+        std::unique_lock<std::shared_mutex> tree(tree_lock);
+        if (find_snapshot(table, sname) >= 0)
+            return fs_error("snapshot", name, "Snapshot exists");
+        unsigned idx = 0;
+        while (idx < SNAPSHOT_ENTRIES && table[idx].name[0] != '\0')
+            ++idx;
+        if (idx == SNAPSHOT_ENTRIES)
+            return fs_error("snapshot", name, "Snapshot table is full");
+
+        std::vector<std::vector<dir_entry> > dirs;
+        std::vector<uint16_t> blocks;
+        unsigned nblocks = 0;
+        if (plan_tree(root_blk, dirs, nblocks, false))
+            return -1;
+        std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+        // the directory blocks, then the frozen FAT and hole table
+        if (alloc_blocks(nblocks + 1 + HOLE_BLOCKS, blocks))
+            return fs_error("snapshot", name, "No space left on disk");
+        size_t next_dir = 0, next_blk = 1;
+        if (copy_tree(dirs, next_dir, blocks[0], blocks[0], blocks, next_blk))
+            return -1;
+        chains_shared();
+
+        int16_t frozen[BLOCK_SIZE/2];
+        uint32_t frozen_holes[BLOCK_SIZE/2];
+        freeze_fat(dirs, blocks, frozen, frozen_holes);
+        snapshot_entry &e = table[idx];
+        sname.copy_to(e.name);
+        e.root_blk = blocks[0];
+        e.fat_blk = blocks[nblocks];
+        if (disk.write(e.fat_blk, (uint8_t*)frozen))
+            return -1;
+        for (int i = 0; i < HOLE_BLOCKS; ++i) {
+            e.hole_blks[i] = blocks[nblocks + 1 + i];
+            if (disk.write(e.hole_blks[i], (uint8_t*)frozen_holes + i * BLOCK_SIZE))
+                return -1;
+        }
+        if (disk.write(SNAPSHOT_BLOCK, (uint8_t*)table) || write_fat())
+            return -1;
+    }
+    // so that another FS can mount it
+    return sync();
+}
+
+// snapshot -d <name> removes snapshot <name>, freeing the blocks only it uses
+int
+FS::rm_snapshot(std::string_view name)
+{
+    if (DEBUG)
+        std::cout << "FS::rm_snapshot(" << name << ")\n";
+    if (writable("snapshot", name))
+        return -1;
+    snapshot_entry table[SNAPSHOT_ENTRIES];
+    std::unique_lock<std::shared_mutex> tree(tree_lock);
+    int idx = find_snapshot(table, Name(name));
+    if (idx < 0)
+        return fs_error("snapshot", name, "No such snapshot");
+    snapshot_entry &e = table[idx];
+    std::vector<uint16_t> blocks, files;
+    if (collect_tree(e.root_blk, blocks, files))
+        return -1;
+    std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+    for (size_t i = 0; i < blocks.size(); ++i)
+        fat[blocks[i]] = FAT_FREE;
+    for (size_t i = 0; i < files.size(); ++i)
+        release_chain(files[i]);
+    fat[e.fat_blk] = FAT_FREE;
+    for (int i = 0; i < HOLE_BLOCKS; ++i)
+        fat[e.hole_blks[i]] = FAT_FREE;
+    std::memset(&e, 0, sizeof(e));
+    if (disk.write(SNAPSHOT_BLOCK, (uint8_t*)table) || write_fat())
+        return -1;
+    return 0;
+}
+
+// snapshot lists the snapshots, one name per row
+int
+FS::list_snapshots()
+{
+    if (DEBUG)
+        std::cout << "FS::list_snapshots()\n";
+    snapshot_entry table[SNAPSHOT_ENTRIES];
+    std::shared_lock<std::shared_mutex> tree(tree_lock);
+    if (read_only) {
+        messages() << "snapshot: Read-only file system\n";
+        return -1;
+    }
+    if (disk.read(SNAPSHOT_BLOCK, (uint8_t*)table))
+        return -1;
+    Output out(session().out_fd, *session().out);
+    for (unsigned i = 0; i < SNAPSHOT_ENTRIES; ++i) {
+        if (table[i].name[0] == '\0')
+            continue;
+        out.put(table[i].name);
+        out.put('\n');
+    }
+    return out.flush();
+}
+
+// sync writes back the FAT and waits until every block written so far,
+// and its checksum, is on the disk
+int
+FS::sync()
+{
+    TRACE_SPAN("FS::sync");
+    if (DEBUG)
+        std::cout << "FS::sync()\n";
+    int ret = 0;
+    {
+        std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+        if ((fat_dirty || holes_dirty) && write_fat())
+            ret = -1;
+    }
+    // other commands go on while the blocks are written
+    if (disk.sync())
+        ret = -1;
+    return ret;
+}
+
+// blocks of all files added up, and blocks actually used by files
+void
+FS::dedup_counts(uint32_t &logical, uint32_t &physical)
+{
+    std::shared_lock<std::shared_mutex> fat_guard(fat_lock);
+    count_blocks(logical, physical);
+}
+
+// dedup_counts() with the FAT lock held
+void
+FS::count_blocks(uint32_t &logical, uint32_t &physical)
+{
+    // a block referenced more often than it has predecessors in the FAT is
+    // the first block of that many files
+    uint16_t preds[BLOCK_SIZE/2];
+    std::memset(preds, 0, sizeof(preds));
+    physical = 0;
+    for (unsigned b = 0; b < disk.get_no_blocks(); ++b) {
+        if (refs[b] == 0)
+            continue;
+        ++physical;
+        if (fat[b] != FAT_EOF)
+            ++preds[fat[b]];
+    }
+    logical = 0;
+    for (unsigned b = 0; b < disk.get_no_blocks(); ++b) {
+        if (refs[b] > preds[b])
+            logical += (refs[b] - preds[b]) * chain_length(b);
+    }
+}
+
+// stats prints how many blocks are in use and the block I/O done so far
+int
+FS::stats()
+{
+    if (DEBUG)
+        std::cout << "FS::stats()\n";
+    Output out(session().out_fd, *session().out);
+    std::shared_lock<std::shared_mutex> fat_guard(fat_lock);
+    uint32_t used = 0;
+    for (unsigned i = 0; i < disk.get_no_blocks(); ++i) {
+        if (fat[i] != FAT_FREE)
+            ++used;
+    }
+    out.put("blocks: ");
+    out.put((uint32_t)disk.get_no_blocks());
+    out.put(" total, ");
+    out.put(used);
+    out.put(" used, ");
+    out.put((uint32_t)(disk.get_no_blocks() - used));
+    out.put(" free\nblock reads: ");
+    out.put((uint32_t)disk.get_no_reads());
+    out.put(", block writes: ");
+    out.put((uint32_t)disk.get_no_writes());
+    uint32_t logical, physical;
+    count_blocks(logical, physical);
+    uint32_t ratio = physical ? logical * 100 / physical : 100;
+    // node: key, value and next pointer; plus one pointer per bucket
+    uint32_t index_bytes = dedup_index.size() * (sizeof(uint64_t) + 2 * sizeof(void*)) +
+                           dedup_index.bucket_count() * sizeof(void*);
+    out.put("\nfile blocks: ");
+    out.put(logical);
+    out.put(" in files, ");
+    out.put(physical);
+    out.put(" on disk, dedup ratio ");
+    out.put(ratio / 100);
+    out.put('.');
+    out.put((char)('0' + ratio / 10 % 10));
+    out.put((char)('0' + ratio % 10));
+    out.put("\ndedup index: ");
+    out.put((uint32_t)dedup_index.size());
+    out.put(" entries, ");
+    out.put(index_bytes);
+    out.put(" bytes\n");
+    return out.flush();
+}
+
+// opens (or with CREATE creates) <name> in directory <parent>; errors are
+// reported for command <cmd> on <path>. The caller holds the locks
+int
+FS::open_at(const char *cmd, std::string_view path, uint16_t parent,
+            const Name &name, int mode)
+{
+    dir_entry dir[DIR_ENTRIES];
+    int fd;
+
+    for (fd = 0; fd < MAX_OPEN_FILES && handles[fd].used; ++fd)
+        ;
+    if (fd == MAX_OPEN_FILES)
+        return fs_error(cmd, path, "Too many open files");
+    if (read_dir(parent, dir))
+        return fs_error(cmd, path, "No such directory");
+    int idx = find_entry(dir, name);
+
+    if (mode & CREATE) {
+        if (!name.valid())
+            return fs_error(cmd, path, "Invalid file name");
+        if (idx >= 0)
+            return fs_error(cmd, path, "File exists");
+        idx = free_entry(dir);
+        if (idx < 0)
+            return fs_error(cmd, path, "Directory is full");
+        // every file owns at least one block
+        int blk = alloc_block(parent);
+        if (blk < 0)
+            return fs_error(cmd, path, "No space left on disk");
+        refs[blk] = 1;
+        name.copy_to(dir[idx].file_name);
+        dir[idx].size = 0;
+        dir[idx].first_blk = blk;
+        dir[idx].type = TYPE_FILE;
+        dir[idx].access_rights = READ | WRITE;
+        if (mode & COMPRESS)
+            dir[idx].access_rights |= COMPRESSED;
+        if (write_fat() || write_dir(parent, dir))
+            return -1;
+    } else {
+        if (idx < 0 || entry_is_parent(dir[idx]))
+            return fs_error(cmd, path, "No such file");
+        if (dir[idx].type != TYPE_FILE)
+            return fs_error(cmd, path, "Is a directory");
+        if ((mode & (READ | WRITE)) & ~dir[idx].access_rights)
+            return fs_error(cmd, path, "Permission denied");
+        // one handle at a time writes a file: close() of one would undo
+        // the size and chain written back by another
+        if ((mode & WRITE) && is_open(parent, idx, WRITE))
+            return fs_error(cmd, path, "File is open");
+    }
+
+    return new_handle(parent, idx, dir[idx], mode);
+}
+
+// takes a free handle for the file described by <e>, entry <idx> of
+// directory <parent>; returns the handle, or -1 if all are in use
+int
+FS::new_handle(uint16_t parent, int idx, const dir_entry &e, int mode)
+{
+    int fd;
+    {
+        std::lock_guard<std::mutex> guard(handle_lock);
+        for (fd = 0; fd < MAX_OPEN_FILES && handles[fd].used; ++fd)
+            ;
+        if (fd == MAX_OPEN_FILES)
+            return -1;
+        handles[fd].used = true;
+        handles[fd].entry_first = e.first_blk;
+    }
+
+    open_file &h = handles[fd];
+    h.mode = mode;
+    h.dir_blk = parent;
+    h.dir_idx = idx;
+    h.first_blk = e.first_blk;
+    h.size = e.size;
+    h.access_rights = e.access_rights;
+    h.entry_dirty = false;
+    h.private_upto = 0;
+    h.dirty_from = UINT32_MAX;
+    h.pos = 0;
+    h.chain_idx = 0;
+    h.chain_blk = h.first_blk;
+    h.buf_idx = -1;
+    h.buf_dirty = false;
+    h.compressed = e.access_rights & COMPRESSED;
+    h.index_dirty = false;
+    h.raw_idx = -1;
+    h.raw_len = 0;
+    if (h.compressed) {
+        if (mode & CREATE) {
+            // a new file: its first block becomes the empty index
+            std::memset(h.index, 0, sizeof(h.index));
+            h.index_dirty = true;
+        } else if (disk.read(h.first_blk, (uint8_t*)h.index)) {
+            std::lock_guard<std::mutex> guard(handle_lock);
+            h.used = false;
+            return -1;
+        }
+    }
+    return fd;
+}
+
+// returns the open handle <fd>, or nullptr
+open_file *
+FS::get_handle(int fd)
+{
+    if (fd < 0 || fd >= MAX_OPEN_FILES || !handles[fd].used)
+        return nullptr;
+    return &handles[fd];
+}
+
+// true if entry <dir_idx> of directory <dir_blk> is open with any of the
+// mode bits <mode>
+bool
+FS::is_open(uint16_t dir_blk, uint16_t dir_idx, int mode)
+{
+    std::lock_guard<std::mutex> guard(handle_lock);
+    for (int i = 0; i < MAX_OPEN_FILES; ++i) {
+        if (handles[i].used && handles[i].dir_blk == dir_blk && handles[i].dir_idx == dir_idx &&
+            (handles[i].mode & mode))
+            return true;
+    }
+    return false;
+}
+
+// true if a file in one of the directories <dirs> is open
+bool
+FS::any_open(const std::vector<uint16_t> &dirs)
+{
+    std::lock_guard<std::mutex> guard(handle_lock);
+    for (int i = 0; i < MAX_OPEN_FILES; ++i) {
+        if (handles[i].used && std::find(dirs.begin(), dirs.end(), handles[i].dir_blk) != dirs.end())
+            return true;
+    }
+    return false;
+}
+
+// moves the cached chain position of <h> to block <idx> of the file;
+// returns 1 if that block is a hole, unless <grow> allocates it. In a hole
+// the position stays at the last block in front of it
+int
+FS::seek_chain(open_file &h, uint32_t idx, bool grow)
+{
+    if (idx < h.chain_idx) {
+        h.chain_idx = 0;
+        h.chain_blk = h.first_blk;
+    }
+    while (h.chain_idx < idx) {
+        int16_t next = fat[h.chain_blk];
+        uint32_t next_idx = h.chain_idx + 1 + holes[h.chain_blk];
+        if (next != FAT_EOF && next_idx <= idx) {
+            h.chain_blk = next;
+            h.chain_idx = next_idx;
+            continue;
+        }
+        if (!grow)
+            return 1;
+        // the block in front of the hole gets a new successor, which other
+        // files must not see
+        if (make_private(h, h.chain_idx, false))
+            return -1;
+        int blk = alloc_block(h.chain_blk);
+        if (blk < 0)
+            return -1;
+        // the new block splits the hole in two
+        fat[blk] = fat[h.chain_blk];
+        set_holes(blk, next == FAT_EOF ? 0 : next_idx - idx - 1);
+        fat[h.chain_blk] = blk;
+        set_holes(h.chain_blk, idx - h.chain_idx - 1);
+        refs[blk] = 1;
+        fat_dirty = true;
+        h.chain_blk = blk;
+        h.chain_idx = idx;
+    }
+    return 0;
+}
+
+// makes block <idx> of the file the buffered block of <h>; <whole> means
+// the caller overwrites all of it, so its old content is not read
+int
+FS::load_block(open_file &h, uint32_t idx, bool whole)
+{
+    if (h.buf_idx == (int32_t)idx)
+        return 0;
+    if (flush_block(h))
+        return -1;
+    // nothing of the file is stored past its end, nor in a hole
+    int hole = whole || (uint64_t)idx * BLOCK_SIZE >= h.size ? 1 : seek_chain(h, idx, false);
+    if (hole < 0)
+        return -1;
+    if (hole)
+        std::memset(h.buf, 0, BLOCK_SIZE);
+    else if (disk.read(h.chain_blk, h.buf))
+        return -1;
+    h.buf_idx = idx;
+    return 0;
+}
+
+// writes the buffered block of <h> if it was modified; zeros written into a
+// hole leave it a hole
+int
+FS::flush_block(open_file &h)
+{
+    TRACE_SPAN("FS::flush_block");
+    if (!h.buf_dirty)
+        return 0;
+    // the chain position may have moved on since the block was loaded
+    int hole = seek_chain(h, h.buf_idx, false);
+    if (hole < 0)
+        return -1;
+    if (hole && block_is_zero(h.buf)) {
+        h.buf_dirty = false;
+        return 0;
+    }
+    // blocks are allocated only now, when there is data to store
+    if ((hole && seek_chain(h, h.buf_idx, true)) || make_private(h, h.buf_idx, true) ||
+        disk.write(h.chain_blk, h.buf))
+        return -1;
+    h.dirty_from = std::min(h.dirty_from, (uint32_t)h.buf_idx);
+    h.buf_dirty = false;
+    return 0;
+}
+
+// frees the blocks of <h> from block <keep> of the file on; block 0 is
+// always kept
+int
+FS::cut_chain(open_file &h, uint32_t keep)
 {
-    std::cout << "FS::chmod(" << accessrights << "," << filepath << ")\n";
+    if (seek_chain(h, keep - 1, false) < 0)
+        return -1;
+    int16_t rest = fat[h.chain_blk];
+    if (rest == FAT_EOF && holes[h.chain_blk] == 0)
+        return 0;
+    // the new last block must not end the chain of other files as well
+    if (make_private(h, h.chain_idx, false))
+        return -1;
+    rest = fat[h.chain_blk];
+    fat[h.chain_blk] = FAT_EOF;
+    set_holes(h.chain_blk, 0);
+    fat_dirty = true;
+    if (rest != FAT_EOF)
+        release_chain(rest);
+    refresh_handles(h);
+    // it may now match another last block
+    h.dirty_from = std::min(h.dirty_from, h.chain_idx);
+    return 0;
+}
+
+// sets the size of the file of <h> to <size>: blocks past the new end are
+// freed, and a longer file ends in a hole
+int
+FS::resize(open_file &h, uint32_t size)
+{
+    if (h.compressed)
+        return resize_compressed(h, size);
+    if (flush_block(h))
+        return -1;
+    if (size < h.size) {
+        uint32_t keep = blocks_for(size);
+        h.buf_idx = -1;
+        if (cut_chain(h, keep))
+            return -1;
+        // what is left of the old data in the new last block is cleared,
+        // as it would be in a new block
+        uint32_t off = size % BLOCK_SIZE;
+        if (off != 0 || size == 0) {
+            if (load_block(h, keep - 1, false))
+                return -1;
+            std::memset(h.buf + off, 0, BLOCK_SIZE - off);
+            h.buf_dirty = true;
+            if (flush_block(h))
+                return -1;
+        }
+    }
+    h.size = size;
+    h.entry_dirty = true;
+    return 0;
+}
+
+// resize() of a compressed file: the chunk holding the new end becomes the
+// not yet compressed end of the file, and later chunks are freed; a longer
+// file gets zeros added, which compress well
+int
+FS::resize_compressed(open_file &h, uint32_t size)
+{
+    if (size >= h.size) {
+        uint8_t zeros[BLOCK_SIZE];
+        std::memset(zeros, 0, sizeof(zeros));
+        uint32_t pos = h.pos;
+        h.pos = h.size;
+        while (h.size < size) {
+            if (write_compressed(h, zeros, std::min<uint32_t>(size - h.size, BLOCK_SIZE)) < 0)
+                return -1;
+        }
+        h.pos = pos;
+        return 0;
+    }
+    if (flush_tail(h, true))
+        return -1;
+    uint32_t nchunks = h.index[0];
+    uint32_t k = size == 0 ? 0 :
+        std::upper_bound(h.index + 1, h.index + 1 + nchunks, size - 1) - (h.index + 1);
+    if (k < nchunks) {
+        if (load_chunk(h, k) || cut_chain(h, k + 1))
+            return -1;
+        uint32_t start = k ? h.index[k] : 0;
+        h.raw_len = size - start;
+        h.index[0] = k;
+        h.index_dirty = true;
+    }
+    h.size = size;
+    h.entry_dirty = true;
+    return 0;
+}
+
+// compressed files: decodes chunk <k> into the raw buffer of <h>
+int
+FS::load_chunk(open_file &h, uint32_t k)
+{
+    if (h.raw_idx == (int32_t)k)
+        return 0;
+    h.raw_idx = -1;
+    if (seek_chain(h, k + 1, false) != 0 || disk.read(h.chain_blk, h.buf))
+        return -1;
+    uint16_t hdr[2];
+    std::memcpy(hdr, h.buf, sizeof(hdr));
+    if (hdr[1] > BLOCK_SIZE - CHUNK_HEADER)
+        return -1;
+    long len = lz_decompress(h.buf + CHUNK_HEADER, hdr[1], h.raw, CHUNK_RAW_MAX);
+    uint32_t start = k ? h.index[k] : 0;
+    if (len != hdr[0] || start + len != h.index[k + 1])
+        return -1;
+    h.raw_idx = k;
+    h.raw_len = len;
+    return 0;
+}
+
+// compressed files: packs the not yet compressed end of the file into
+// chunk blocks, once the raw buffer is full or with <all> until it is empty
+int
+FS::flush_tail(open_file &h, bool all)
+{
+    while (h.raw_idx == (int32_t)h.index[0] && h.raw_len > 0 &&
+           (all || h.raw_len == CHUNK_RAW_MAX)) {
+        uint32_t k = h.index[0];
+        if (k + 1 >= INDEX_ENTRIES)
+            return -1;
+        size_t used;
+        size_t len = lz_compress(h.raw, h.raw_len, h.buf + CHUNK_HEADER,
+                                 BLOCK_SIZE - CHUNK_HEADER, used);
+        uint16_t hdr[2] = { (uint16_t)used, (uint16_t)len };
+        std::memcpy(h.buf, hdr, sizeof(hdr));
+        std::memset(h.buf + CHUNK_HEADER + len, 0, BLOCK_SIZE - CHUNK_HEADER - len);
+        if (seek_chain(h, k + 1, true) || make_private(h, k + 1, true) ||
+            disk.write(h.chain_blk, h.buf))
+            return -1;
+        h.dirty_from = std::min(h.dirty_from, k + 1);
+        h.index[k + 1] = (k ? h.index[k] : 0) + used;
+        h.index[0] = k + 1;
+        h.index_dirty = true;
+        std::memmove(h.raw, h.raw + used, h.raw_len - used);
+        h.raw_len -= used;
+        h.raw_idx = k + 1;
+    }
+    return 0;
+}
+
+// read() of a compressed file: each chunk is decoded once, on first use
+int
+FS::read_compressed(open_file &h, uint8_t *buf, uint32_t n)
+{
+    uint32_t done = 0;
+    while (done < n && h.pos < h.size) {
+        uint32_t nchunks = h.index[0];
+        uint32_t k, start;
+        if (h.raw_idx == (int32_t)nchunks && h.pos >= (nchunks ? h.index[nchunks] : 0)) {
+            // in the end of the file still held in raw
+            k = nchunks;
+        } else {
+            // a chunk block is read, so the held end of the file goes out first
+            if (flush_tail(h, true))
+                return -1;
+            nchunks = h.index[0];
+            k = std::upper_bound(h.index + 1, h.index + 1 + nchunks, h.pos) - (h.index + 1);
+            if (k >= nchunks || load_chunk(h, k))
+                return -1;
+        }
+        start = k ? h.index[k] : 0;
+        uint32_t off = h.pos - start;
+        uint32_t len = std::min(std::min(h.raw_len - off, n - done), h.size - h.pos);
+        std::memcpy(buf + done, h.raw + off, len);
+        done += len;
+        h.pos += len;
+    }
+    return done;
+}
+
+// write() of a compressed file: data is only added at the end, collected in
+// the raw buffer and compressed a block at a time
+int
+FS::write_compressed(open_file &h, const uint8_t *buf, uint32_t n)
+{
+    if (h.pos < h.size)
+        return -1;
+    // a gap is filled in with zeros
+    if (h.pos > h.size && resize_compressed(h, h.pos))
+        return -1;
+    uint32_t nchunks = h.index[0];
+    if (h.raw_idx != (int32_t)nchunks) {
+        // the last chunk may have room left, it is packed again together
+        // with the new data
+        if (nchunks > 0) {
+            if (load_chunk(h, nchunks - 1))
+                return -1;
+            h.index[0] = nchunks - 1;
+            h.index_dirty = true;
+        } else {
+            h.raw_idx = 0;
+            h.raw_len = 0;
+        }
+    }
+    uint32_t done = 0;
+    while (done < n) {
+        uint32_t len = std::min(n - done, CHUNK_RAW_MAX - h.raw_len);
+        std::memcpy(h.raw + h.raw_len, buf + done, len);
+        h.raw_len += len;
+        done += len;
+        h.pos += len;
+        h.size = h.pos;
+        h.entry_dirty = true;
+        if (flush_tail(h, false))
+            return -1;
+    }
+    return n;
+}
+
+// open <filepath> with <mode> (READ and/or WRITE, CREATE to create a new
+// file) returns a handle >= 0, or -1 on error
+int
+FS::open(std::string_view filepath, int mode)
+{
+    if (DEBUG)
+        std::cout << "FS::open(" << filepath << "," << mode << ")\n";
+    return open_path("open", filepath, mode);
+}
+
+// open() for command <cmd>, taking the locks it needs
+int
+FS::open_path(const char *cmd, std::string_view path, int mode)
+{
+    if ((mode & (WRITE | CREATE)) && writable(cmd, path))
+        return -1;
+    uint16_t parent;
+    Name name;
+    std::shared_lock<std::shared_mutex> tree(tree_lock);
+
+    if (resolve_parent(path, parent, name))
+        return fs_error(cmd, path, (mode & CREATE) ? "No such directory" : "No such file");
+    // creating a file changes the directory and the FAT
+    if (mode & CREATE) {
+        std::unique_lock<std::shared_mutex> guard(dir_lock(parent));
+        std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+        return open_at(cmd, path, parent, name, mode);
+    }
+    // the exclusive directory lock keeps a second writer out until the
+    // handle is taken
+    if (mode & WRITE) {
+        std::unique_lock<std::shared_mutex> guard(dir_lock(parent));
+        std::shared_lock<std::shared_mutex> fat_guard(fat_lock);
+        return open_at(cmd, path, parent, name, mode);
+    }
+    std::shared_lock<std::shared_mutex> guard(dir_lock(parent));
+    std::shared_lock<std::shared_mutex> fat_guard(fat_lock);
+    return open_at(cmd, path, parent, name, mode);
+}
+
+// read reads up to <n> bytes at the current offset of <fd> into <buf>,
+// returns the number of bytes read (0 at end of file), or -1 on error
+int
+FS::read(int fd, void *buf, uint32_t n)
+{
+    open_file *h = get_handle(fd);
+    if (!h || !(h->mode & READ))
+        return -1;
+    // reading only changes the FAT when buffered writes are flushed
+    if (h->mode & WRITE) {
+        std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+        return read_handle(*h, (uint8_t*)buf, n);
+    }
+    std::shared_lock<std::shared_mutex> fat_guard(fat_lock);
+    return read_handle(*h, (uint8_t*)buf, n);
+}
+
+// read() with the FAT lock held
+int
+FS::read_handle(open_file &h, uint8_t *buf, uint32_t n)
+{
+    TRACE_SPAN("FS::read_chain");
+    if (h.compressed)
+        return read_compressed(h, buf, n);
+    uint8_t *out = buf;
+    uint32_t done = 0;
+    while (done < n && h.pos < h.size) {
+        uint32_t idx = h.pos / BLOCK_SIZE;
+        uint32_t off = h.pos % BLOCK_SIZE;
+        if (off == 0 && n - done >= BLOCK_SIZE && h.size - h.pos >= BLOCK_SIZE &&
+            h.buf_idx != (int32_t)idx) {
+            // whole blocks go straight into the caller's buffer, a run of
+            // them that follow each other on the disk in one request
+            int hole = seek_chain(h, idx, false);
+            if (hole < 0)
+                return -1;
+            if (hole) {
+                std::memset(out + done, 0, BLOCK_SIZE);
+                done += BLOCK_SIZE;
+                h.pos += BLOCK_SIZE;
+                continue;
+            }
+            uint32_t count = 1;
+            while (n - done >= (count + 1) * BLOCK_SIZE && h.size - h.pos >= (count + 1) * BLOCK_SIZE &&
+                   h.buf_idx != (int32_t)(idx + count) && fat[h.chain_blk] == h.chain_blk + 1 &&
+                   holes[h.chain_blk] == 0) {
+                h.chain_blk = fat[h.chain_blk];
+                ++h.chain_idx;
+                ++count;
+            }
+            if (disk.read_blocks(h.chain_blk + 1 - count, count, out + done))
+                return -1;
+            done += count * BLOCK_SIZE;
+            h.pos += count * BLOCK_SIZE;
+            continue;
+        }
+        if (load_block(h, idx, false))
+            return -1;
+        uint32_t len = std::min(std::min(BLOCK_SIZE - off, n - done), h.size - h.pos);
+        std::memcpy(out + done, h.buf + off, len);
+        done += len;
+        h.pos += len;
+    }
+    return done;
+}
+
+// write writes <n> bytes at the current offset of <fd>, extending the
+// file when writing past its end; returns <n>, or -1 on error
+int
+FS::write(int fd, const void *buf, uint32_t n)
+{
+    open_file *h = get_handle(fd);
+    if (!h || !(h->mode & WRITE))
+        return -1;
+    std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+    return write_handle(*h, (const uint8_t*)buf, n);
+}
+
+// write() with the FAT lock held
+int
+FS::write_handle(open_file &h, const uint8_t *buf, uint32_t n)
+{
+    TRACE_SPAN("FS::write_chain");
+    if (h.compressed)
+        return write_compressed(h, buf, n);
+    const uint8_t *in = buf;
+    uint32_t done = 0;
+    while (done < n) {
+        uint32_t off = h.pos % BLOCK_SIZE;
+        uint32_t len = std::min(BLOCK_SIZE - off, n - done);
+        bool whole = off == 0 && len == BLOCK_SIZE;
+        if (load_block(h, h.pos / BLOCK_SIZE, whole))
+            return -1;
+        std::memcpy(h.buf + off, in + done, len);
+        h.buf_dirty = true;
+        done += len;
+        h.pos += len;
+        if (h.pos > h.size) {
+            h.size = h.pos;
+            h.entry_dirty = true;
+        }
+    }
+    return n;
+}
+
+// seek moves the offset of <fd> to <pos>; data written past the end of the
+// file leaves a hole, which reads as zeros and takes no blocks
+int
+FS::seek(int fd, uint32_t pos)
+{
+    open_file *h = get_handle(fd);
+    if (!h)
+        return -1;
+    h->pos = pos;
+    return 0;
+}
+
+// close writes back buffered data and the file size, and releases the
+// handle <fd>; the FAT is written by the flusher or the next sync
+int
+FS::close(int fd)
+{
+    open_file *h = get_handle(fd);
+    if (!h)
+        return -1;
+    std::shared_lock<std::shared_mutex> tree(tree_lock);
+    std::unique_lock<std::shared_mutex> guard(dir_lock(h->dir_blk));
+    std::unique_lock<std::shared_mutex> fat_guard(fat_lock);
+    return close_handle(*h);
+}
+
+// close() with the locks held
+int
+FS::close_handle(open_file &h)
+{
+    TRACE_SPAN("FS::close");
+    int ret = flush_block(h);
+    if (h.compressed) {
+        if (flush_tail(h, true))
+            ret = -1;
+        if (h.index_dirty) {
+            if (make_private(h, 0, true) || disk.write(h.first_blk, (uint8_t*)h.index))
+                ret = -1;
+            h.dirty_from = 0;
+        }
+    }
+    // blocks written through the handle may exist elsewhere already
+    if (ret == 0 && h.dirty_from != UINT32_MAX && dedup_chain(h.first_blk, h.dirty_from) > 0)
+        h.entry_dirty = true;
+    if (h.entry_dirty) {
+        dir_entry dir[DIR_ENTRIES];
+        if (read_dir(h.dir_blk, dir) == 0 && dir[h.dir_idx].first_blk == h.entry_first) {
+            dir[h.dir_idx].size = h.size;
+            dir[h.dir_idx].access_rights = h.access_rights;
+            dir[h.dir_idx].first_blk = h.first_blk;
+            if (write_dir(h.dir_blk, dir))
+                ret = -1;
+        }
+        refresh_handles(h);
+    }
+    std::lock_guard<std::mutex> lock(handle_lock);
+    h.used = false;
+    return ret;
+}
+
+// check walks the whole file system and reports directories, chains,
+// reference counts and blocks that do not add up; returns -1 if any
+int
+FS::check()
+{
+    if (DEBUG)
+        std::cout << "FS::check()\n";
+    dir_entry dir[DIR_ENTRIES];
+    std::unique_lock<std::shared_mutex> tree(tree_lock);
+    std::shared_lock<std::shared_mutex> fat_guard(fat_lock);
+    unsigned nblocks = disk.get_no_blocks();
+    // what each block was reached as, and the references it should have
+    enum { UNREACHED, DIRECTORY, FILE_BLOCK, FROZEN_TABLE };
+    std::vector<uint8_t> kind(nblocks, UNREACHED);
+    std::vector<uint32_t> expect(nblocks, 0);
+    unsigned problems = 0, ndirs = 0, nfiles = 0;
+
+    // directories are walked from the root, each with the block of its
+    // parent; a root is its own parent
+    std::vector<std::pair<uint16_t, uint16_t> > pending;
+    pending.push_back(std::make_pair(root_blk, root_blk));
+    // the trees of the snapshots, whose frozen tables are in use as well
+    snapshot_entry table[SNAPSHOT_ENTRIES];
+    if (!read_only && disk.read(SNAPSHOT_BLOCK, (uint8_t*)table) == 0) {
+        for (unsigned i = 0; i < SNAPSHOT_ENTRIES; ++i) {
+            if (table[i].name[0] == '\0')
+                continue;
+            std::vector<uint16_t> frozen(table[i].hole_blks, table[i].hole_blks + HOLE_BLOCKS);
+            frozen.push_back(table[i].fat_blk);
+            frozen.push_back(table[i].root_blk);
+            bool bad = false;
+            for (size_t j = 0; j < frozen.size(); ++j)
+                bad = bad || frozen[j] < FIRST_DATA_BLOCK || frozen[j] >= nblocks;
+            if (bad) {
+                check_error(problems, SNAPSHOT_BLOCK, "snapshot points outside the data blocks");
+                continue;
+            }
+            pending.push_back(std::make_pair(table[i].root_blk, table[i].root_blk));
+            for (size_t j = 0; j + 1 < frozen.size(); ++j) {
+                if (kind[frozen[j]] != UNREACHED)
+                    check_error(problems, frozen[j], "frozen table reached twice");
+                kind[frozen[j]] = FROZEN_TABLE;
+                if (fat[frozen[j]] != FAT_EOF)
+                    check_error(problems, frozen[j], "frozen table not marked in the FAT");
+            }
+        }
+    }
+    while (!pending.empty()) {
+        uint16_t blk = pending.back().first, parent = pending.back().second;
+        pending.pop_back();
+        if (kind[blk] != UNREACHED) {
+            check_error(problems, blk, "directory reached twice");
+            continue;
+        }
+        kind[blk] = DIRECTORY;
+        ++ndirs;
+        if (fat[blk] != FAT_EOF)
+            check_error(problems, blk, "directory block not marked in the FAT");
+        if (read_dir(blk, dir)) {
+            check_error(problems, blk, "cannot read directory");
+            continue;
+        }
+        if (blk != parent && (!entry_is_parent(dir[0]) || dir[0].first_blk != parent))
+            check_error(problems, blk, "\"..\" does not point to the parent");
+        for (unsigned i = 0; i < DIR_ENTRIES; ++i) {
+            if (!entry_used(dir[i]) || entry_is_parent(dir[i]))
+                continue;
+            uint16_t first = dir[i].first_blk;
+            if (first >= nblocks || first < FIRST_DATA_BLOCK) {
+                check_error(problems, blk, "entry points outside the data blocks");
+                continue;
+            }
+            if (dir[i].type == TYPE_DIR) {
+                pending.push_back(std::make_pair(first, blk));
+                continue;
+            }
+            ++nfiles;
+            ++expect[first];
+            // a block reached before is the start of a shared tail, which
+            // has been checked already
+            uint32_t pos = 0;
+            for (int16_t b = first; kind[b] != FILE_BLOCK; ) {
+                if (kind[b] != UNREACHED || fat[b] == FAT_FREE) {
+                    check_error(problems, b, kind[b] == DIRECTORY ? "file block is a directory" :
+                                             kind[b] == FROZEN_TABLE ? "file block is a frozen table"
+                                                                     : "file block is free");
+                    break;
+                }
+                kind[b] = FILE_BLOCK;
+                if (!(dir[i].access_rights & COMPRESSED) && pos >= blocks_for(dir[i].size))
+                    check_error(problems, b, "file block past the end of the file");
+                if (fat[b] == FAT_EOF)
+                    break;
+                if (fat[b] < FIRST_DATA_BLOCK || fat[b] >= (int)nblocks) {
+                    check_error(problems, b, "FAT link outside the data blocks");
+                    break;
+                }
+                pos += 1 + holes[b];
+                b = fat[b];
+                ++expect[b];
+            }
+        }
+    }
+
+    for (unsigned b = FIRST_DATA_BLOCK; b < nblocks; ++b) {
+        if (kind[b] == UNREACHED && fat[b] != FAT_FREE)
+            check_error(problems, b, "block in use but not reachable");
+        if (kind[b] != DIRECTORY && refs[b] != expect[b])
+            check_error(problems, b, "wrong reference count");
+        if (holes[b] && (fat[b] == FAT_FREE || fat[b] == FAT_EOF))
+            check_error(problems, b, "hole after the last block of a chain");
+    }
+    messages() << "check: " << ndirs << " directories, " << nfiles << " files, "
+              << problems << " problems\n";
+    return problems ? -1 : 0;
+}
+
+// find <dirpath> [-name <glob>] [-type f|d] [-perm <accessrights>] prints the
+// path of every file and sub-directory below <dirpath> matching all filters
+int
+FS::find(std::string_view dirpath, std::string_view pattern, int type, int rights)
+{
+    if (DEBUG)
+        std::cout << "FS::find(" << dirpath << "," << pattern << ")\n";
+    dir_entry dir[DIR_ENTRIES];
+    uint16_t root;
+    std::shared_lock<std::shared_mutex> tree(tree_lock);
+
+    if (resolve_dir(dirpath, root))
+        return fs_error("find", dirpath, "No such directory");
+    Glob glob(pattern);
+
+    // iterative depth-first walk; matches are printed as soon as they are
+    // found, in directory order. Disk reads with pread(), so threads could
+    // read directory blocks side by side, but a directory block takes about
+    // a microsecond to read and match, less than starting a thread, and
+    // even a full disk has at most a few thousand of them
+    std::string prefix(dirpath);
+    while (prefix.size() > 1 && prefix[prefix.size() - 1] == '/')
+        prefix.erase(prefix.size() - 1);
+    if (prefix == "/")
+        prefix.clear();
+    std::vector<std::pair<uint16_t, std::string> > pending, subdirs;
+    pending.push_back(std::make_pair(root, prefix));
+    while (!pending.empty()) {
+        std::pair<uint16_t, std::string> cur = pending.back();
+        pending.pop_back();
+        std::shared_lock<std::shared_mutex> guard(dir_lock(cur.first));
+        if (read_dir(cur.first, dir))
+            return -1;
+        guard.unlock();
+        subdirs.clear();
+        for (unsigned i = 0; i < DIR_ENTRIES; ++i) {
+            if (!entry_used(dir[i]) || entry_is_parent(dir[i]))
+                continue;
+            std::string path = cur.second + "/" + dir[i].file_name;
+            if ((type < 0 || dir[i].type == type) &&
+                (dir[i].access_rights & rights) == rights &&
+                glob.match(dir[i].file_name))
+                *session().out << path << "\n";
+            if (dir[i].type == TYPE_DIR)
+                subdirs.push_back(std::make_pair(dir[i].first_blk, path));
+        }
+        // visit sub-directories in directory order
+        pending.insert(pending.end(), subdirs.rbegin(), subdirs.rend());
+    }
     return 0;
 }
@@ -1,6 +1,15 @@
 #include <iostream>
 #include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
 #include "disk.h"
+#include "path.h"
+#include "output.h"
 
 #ifndef __FS_H__
 #define __FS_H__
@@ -9,12 +18,23 @@
 #define FAT_BLOCK 1
 #define FAT_FREE 0
 #define FAT_EOF -1
+// The hole table follows the checksum table. Entry b is the number of file
+// blocks of zeros, not stored anywhere, between block b and its successor
+// in the FAT. Blocks past the end of a chain are zeros as well.
+#define HOLE_BLOCK (CHECKSUM_BLOCK + CHECKSUM_BLOCKS)
+#define HOLE_BLOCKS 2
+// The snapshot table follows the hole table, one snapshot_entry per
+// snapshot. File blocks start after it.
+#define SNAPSHOT_BLOCK (HOLE_BLOCK + HOLE_BLOCKS)
+#define FIRST_DATA_BLOCK (SNAPSHOT_BLOCK + 1)
 
 #define TYPE_FILE 0
 #define TYPE_DIR 1
 #define READ 0b100
 #define WRITE 0b10
 #define EXECUTE 0b1
+// access_rights flag: the file data is stored compressed, see open_file
+#define COMPRESSED 0b10000000
 
 struct dir_entry {
     char file_name[56]; // name of the file / sub-directory
@@ -24,49 +44,416 @@ struct dir_entry {
     uint8_t access_rights; // read (0x04), write (0x02), execute (0x01)
 };
 
+// A snapshot is a read-only copy of the directory tree together with the
+// FAT and hole table as they were when it was taken. Its files share their
+// blocks with the live ones, which are copied before they change, so taking
+// one costs a block per directory and the frozen tables.
+struct snapshot_entry {
+    char name[56]; // name of the snapshot, empty if the entry is unused
+    uint16_t root_blk; // root directory of the frozen tree
+    uint16_t fat_blk; // frozen FAT
+    uint16_t hole_blks[HOLE_BLOCKS]; // frozen hole table
+};
+
+// number of snapshots that fit in the snapshot table
+#define SNAPSHOT_ENTRIES (BLOCK_SIZE / sizeof(snapshot_entry))
+
+// maximum number of files open at the same time
+#define MAX_OPEN_FILES 16
+// open() mode bit, in addition to READ and WRITE: create a new, empty file
+#define CREATE 0b1000
+// open() mode bit, with CREATE: the new file is stored compressed
+#define COMPRESS 0b10000
+
+// A compressed file starts with an index block, followed by one block per
+// chunk. A chunk block holds a CHUNK_HEADER and the LZ compressed data of as
+// many raw bytes as fit, at most CHUNK_RAW_MAX, and decodes on its own.
+// Entry 0 of the index is the number of chunks, entry k + 1 the raw offset
+// at which chunk k ends.
+#define CHUNK_HEADER 4
+#define CHUNK_RAW_MAX (8 * BLOCK_SIZE)
+#define INDEX_ENTRIES (BLOCK_SIZE / 4)
+
+// an open file: where its dir_entry lives, the current offset, a cached
+// position in its FAT chain and a buffer holding one block of the file
+struct open_file {
+    std::atomic<bool> used;
+    int mode; // READ, WRITE, CREATE as given to open()
+    uint16_t dir_blk; // directory block holding the file's dir_entry
+    uint16_t dir_idx; // index of the dir_entry in that block
+    uint16_t first_blk;
+    uint16_t entry_first; // first_blk of the dir_entry when it was opened
+    uint32_t size;
+    uint8_t access_rights;
+    bool entry_dirty; // size, access_rights or first_blk changed since open
+    uint32_t private_upto; // blocks before this one are not shared
+    uint32_t dirty_from; // first block written since open, UINT32_MAX if none
+    uint32_t pos; // current offset in the file
+    uint32_t chain_idx; // cached chain position: block number <chain_idx>
+    uint16_t chain_blk; // of the file is disk block <chain_blk>
+    int32_t buf_idx; // block number (in the file) held in buf, -1 if none
+    bool buf_dirty;
+    uint8_t buf[BLOCK_SIZE];
+    // compressed files only: the index block and one chunk of raw data.
+    // raw_idx is the chunk decoded in raw, -1 if none; raw_idx equal to
+    // index[0] means raw holds the end of the file not yet compressed
+    bool compressed;
+    bool index_dirty;
+    uint32_t index[INDEX_ENTRIES];
+    int32_t raw_idx;
+    uint32_t raw_len;
+    uint8_t raw[CHUNK_RAW_MAX];
+};
+
+// A client of the file system: its current directory, where command output
+// goes and where the data rows of create and write come from. FS::attach()
+// sets the session a thread runs commands for; without one it works for
+// the console, that is stdin and stdout.
+struct fs_session {
+    uint16_t cwd;
+    std::istream *in;
+    std::ostream *out;
+    int out_fd; // the file descriptor <out> writes to, for Output
+};
+
+// Shared blocks are copied by a reader thread and a writer thread passing
+// the data through a ring of COPY_RING_BLOCKS block buffers; runs shorter
+// than COPY_PIPELINE_MIN are copied by one thread
+#define COPY_RING_BLOCKS 16
+#define COPY_PIPELINE_MIN 8
+
+// number of directory locks; directory block b is guarded by lock b % DIR_LOCKS
+#define DIR_LOCKS 64
+
+// number of directory entries that fit in one directory block
+#define DIR_ENTRIES (BLOCK_SIZE / sizeof(dir_entry))
+static_assert(sizeof(((dir_entry*)0)->file_name) == NAME_CAPACITY,
+              "Name must match dir_entry::file_name");
+static_assert(sizeof(((snapshot_entry*)0)->name) == NAME_CAPACITY,
+              "Name must match snapshot_entry::name");
+
+// FS may be used from several threads at once. The locks are taken in
+// this order:
+// - tree_lock: shared by every command, exclusive for those that move or
+//   remove directories (mv, rm -r, cp -r, format), so that a path resolved
+//   under the shared lock stays valid
+// - dir_locks: shared to read a directory block, exclusive to change it;
+//   two of them are taken in index order
+// - fat_lock: the FAT, hole table, refs, dedup index and the data blocks of
+//   files; shared to follow chains and read data, exclusive to change them
+// - handle_lock: taking and releasing handles
+// A handle or session is used by one thread at a time; the current
+// directories of other sessions are only looked at with tree_lock held
+// exclusively. Disk guards its own state.
 class FS {
 private:
     Disk disk;
     // size of a FAT entry is 2 bytes
     int16_t fat[BLOCK_SIZE/2];
+    // a mounted snapshot is read-only; its root directory is not ROOT_BLOCK
+    bool read_only;
+    uint16_t root_blk;
+    // the console and the sessions attached to the file system; each has
+    // its own current (working) directory
+    fs_session console;
+    std::vector<fs_session*> sessions;
+    // the session of the calling thread
+    fs_session &session();
+    // open files, indexed by the handle returned from open()
+    open_file handles[MAX_OPEN_FILES];
+    // the in-memory FAT has changes not yet written by write_fat()
+    bool fat_dirty;
+    // holes in file chains, see HOLE_BLOCK; written together with the FAT
+    uint32_t holes[BLOCK_SIZE/2];
+    bool holes_dirty;
+    std::shared_mutex tree_lock;
+    std::shared_mutex dir_locks[DIR_LOCKS];
+    std::shared_mutex fat_lock;
+    std::mutex handle_lock;
+    // number of references to each file block: directory entries pointing
+    // at it and FAT links from other file blocks. Identical chain tails are
+    // shared, so a block may be referenced more than once; free blocks and
+    // directory blocks have 0
+    uint16_t refs[BLOCK_SIZE/2];
+    // file blocks by checksum and successor in the FAT, see dedup_key()
+    std::unordered_map<uint64_t, uint16_t> dedup_index;
+
+    // reads / writes one directory block
+    int read_dir(uint16_t blk, dir_entry *dir);
+    int write_dir(uint16_t blk, dir_entry *dir);
+    // writes the in-memory FAT to the FAT block, and the hole table if changed
+    int write_fat();
+    // the flush hook of the disk: write_fat() if the FAT or the hole table
+    // changed and no command is using them
+    void write_back();
+    // sets the number of hole blocks following block <blk>
+    void set_holes(uint16_t blk, uint32_t n);
+    // returns the index of <name> in <dir>, or -1 if there is no such entry
+    int find_entry(dir_entry *dir, const Name& name);
+    // returns the index of the first unused entry in <dir>, or -1 if full
+    int free_entry(dir_entry *dir);
+    // resolves <path> (absolute or relative) to the block of a directory
+    int resolve_dir(std::string_view path, uint16_t &blk);
+    // splits <path> into the block of its parent directory and its last component
+    int resolve_parent(std::string_view path, uint16_t &parent, Name &name);
+    // resolves the destination of cp / mv to a parent directory and entry name
+    int resolve_dest(std::string_view destpath, const char *name,
+                     uint16_t &parent, Name &destname);
+    // returns true if directory <blk> is <ancestor> or lies somewhere below it
+    bool is_below(uint16_t blk, uint16_t ancestor);
+    // number of blocks needed to store <size> bytes (at least one)
+    unsigned blocks_for(uint32_t size);
+    // finds <n> free blocks in a single pass over the FAT and reserves them
+    int alloc_blocks(unsigned n, std::vector<uint16_t> &blocks);
+    // reserves one free block, searching from <hint> onwards, or returns -1
+    int alloc_block(uint16_t hint);
+    // links <blocks> into one chain in the FAT, terminated by FAT_EOF
+    void link_chain(const std::vector<uint16_t> &blocks);
+    // appends every block of the chain starting at <first> to <blocks>
+    void collect_chain(uint16_t first, std::vector<uint16_t> &blocks);
+    // the lock of directory <blk>
+    std::shared_mutex &dir_lock(uint16_t blk) { return dir_locks[blk % DIR_LOCKS]; }
+    // locks directories <a> and <b>, which may be the same, exclusively
+    void lock_dirs(uint16_t a, uint16_t b, std::unique_lock<std::shared_mutex> &la,
+                   std::unique_lock<std::shared_mutex> &lb);
+    // opens (or with CREATE creates) <name> in directory <parent>; errors are
+    // reported for command <cmd> on <path>. The caller holds the locks
+    int open_at(const char *cmd, std::string_view path, uint16_t parent,
+                const Name &name, int mode);
+    // open() for command <cmd>, taking the locks it needs
+    int open_path(const char *cmd, std::string_view path, int mode);
+    // returns the open handle <fd>, or nullptr
+    open_file *get_handle(int fd);
+    // true if entry <dir_idx> of directory <dir_blk> is open with any of the
+    // mode bits <mode>; a file is known by its entry, as files share blocks
+    bool is_open(uint16_t dir_blk, uint16_t dir_idx, int mode);
+    // true if a file in one of the directories <dirs> is open
+    bool any_open(const std::vector<uint16_t> &dirs);
+    // read(), write() and close() of a handle, with the locks held
+    int read_handle(open_file &h, uint8_t *buf, uint32_t n);
+    int write_handle(open_file &h, const uint8_t *buf, uint32_t n);
+    int close_handle(open_file &h);
+    // moves the cached chain position of <h> to block <idx> of the file;
+    // returns 1 if that block is a hole, unless <grow> allocates it
+    int seek_chain(open_file &h, uint32_t idx, bool grow);
+    // makes block <idx> of the file the buffered block of <h>; <whole> means
+    // the caller overwrites all of it, so its old content is not read
+    int load_block(open_file &h, uint32_t idx, bool whole);
+    // writes the buffered block of <h> if it was modified; zeros written
+    // into a hole leave it a hole
+    int flush_block(open_file &h);
+    // takes a free handle for the file described by <e>, entry <idx> of
+    // directory <parent>; returns the handle, or -1 if all are in use
+    int new_handle(uint16_t parent, int idx, const dir_entry &e, int mode);
+    // compressed files: decodes chunk <k> into the raw buffer of <h>
+    int load_chunk(open_file &h, uint32_t k);
+    // compressed files: packs the not yet compressed end of the file into
+    // chunk blocks, once the raw buffer is full or with <all> until it is empty
+    int flush_tail(open_file &h, bool all);
+    int read_compressed(open_file &h, uint8_t *buf, uint32_t n);
+    int write_compressed(open_file &h, const uint8_t *buf, uint32_t n);
+    // frees the blocks of <h> from block <keep> of the file on; block 0 is
+    // always kept
+    int cut_chain(open_file &h, uint32_t keep);
+    // sets the size of the file of <h> to <size>: blocks past the new end
+    // are freed, and a longer file ends in a hole
+    int resize(open_file &h, uint32_t size);
+    int resize_compressed(open_file &h, uint32_t size);
+    // writes the rows read from stdin, up to an empty row, at the offset of
+    // <fd>; with <fd> -1 the rows are only consumed
+    int write_rows(const char *cmd, std::string_view filepath, int fd);
+    // number of blocks in the chain starting at <first>
+    unsigned chain_length(uint16_t first);
+    // drops one reference to the chain starting at <first>, freeing the
+    // blocks no other file uses
+    void release_chain(uint16_t first);
+    // counts the references to every file block below directory <blk> and
+    // adds the blocks to the dedup index
+    void scan_refs(uint16_t blk, std::vector<bool> &seen);
+    // deduplication: a block can stand in for another if it has the same
+    // content and the same successor
+    uint64_t dedup_key(uint16_t blk, int16_t next);
+    void index_block(uint16_t blk, int16_t next);
+    int find_duplicate(uint16_t blk, int16_t next);
+    // replaces the blocks of the chain starting at <first>, from the end
+    // back to block <from>, by identical blocks found in the dedup index
+    int dedup_chain(uint16_t &first, uint32_t from);
+    // a shared chain was created: no handle may assume its blocks are private
+    void chains_shared();
+    // the chain of the file of <h> was cut or re-pointed, or its entry
+    // changed: the other handles on the file drop their cached chain
+    // position and block, and take over its first block and size
+    void refresh_handles(open_file &h);
+    // copies shared blocks up to block <idx> of <h> so that they can be
+    // changed; <whole> means block <idx> is overwritten and not copied
+    int make_private(open_file &h, uint32_t idx, bool whole);
+    // copies block src[i] to dst[i] for the first <n> blocks
+    int copy_blocks(const std::vector<uint16_t> &src, const std::vector<uint16_t> &dst, size_t n);
+    // copy_blocks() overlaps reads and writes, see COPY_RING_BLOCKS
+    bool pipelined_copy = true;
+    // fails with an error for command <cmd> on <path> if the file system is
+    // a mounted snapshot
+    int writable(const char *cmd, std::string_view path);
+    // reads the snapshot table and returns the index of snapshot <name>,
+    // or -1 if there is none
+    int find_snapshot(snapshot_entry *table, const Name &name);
+    // fills <frozen> with the FAT entries of a snapshot of the directories
+    // <dirs>, copied to the first blocks of <blocks>, and <frozen_holes>
+    // with its hole table
+    void freeze_fat(const std::vector<std::vector<dir_entry> > &dirs,
+                    const std::vector<uint16_t> &blocks, int16_t *frozen, uint32_t *frozen_holes);
+    // cp and rm of a single file, with the tree lock held
+    int cp_file(std::string_view sourcepath, std::string_view destpath);
+    int rm_file(std::string_view filepath);
+    // blocks of all files added up, and blocks actually used by files
+    void count_blocks(uint32_t &logical, uint32_t &physical);
+    // recursive helpers for cp -r and rm -r
+    int plan_tree(uint16_t blk, std::vector<std::vector<dir_entry> > &dirs, unsigned &nblocks,
+                  bool need_read);
+    int copy_tree(std::vector<std::vector<dir_entry> > &dirs, size_t &next_dir,
+                  uint16_t dest_blk, uint16_t dest_parent,
+                  const std::vector<uint16_t> &blocks, size_t &next_blk);
+    int collect_tree(uint16_t blk, std::vector<uint16_t> &blocks, std::vector<uint16_t> &files);
+    // prints <len> bytes of <filepath> starting at <offset>, or with
+    // <from_end> starting <offset> bytes before the end of the file
+    int print_range(const char *cmd, std::string_view filepath, uint32_t offset,
+                    uint32_t len, bool from_end);
 
 public:
     FS();
+    // mounts snapshot <snapshot> read-only; commands that change anything
+    // fail. The snapshot must not be removed while it is mounted
+    explicit FS(std::string_view snapshot);
     ~FS();
+    // false if the snapshot to mount was not found
+    bool mounted() { return root_blk < disk.get_no_blocks(); }
+    // attach makes the calling thread run commands for session <s>, which
+    // starts in the root directory; detach returns it to the console
+    void attach(fs_session &s);
+    void detach(fs_session &s);
+    // resume makes the calling thread run commands for the attached session
+    // <s> again, in its current directory; suspend returns it to the console
+    void resume(fs_session &s);
+    void suspend();
     // formats the disk, i.e., creates an empty file system
     int format();
     // create <filepath> creates a new file on the disk, the data content is
     // written on the following rows (ended with an empty row)
-    int create(std::string filepath);
+    int create(std::string_view filepath);
     // cat <filepath> reads the content of a file and prints it on the screen
-    int cat(std::string filepath);
+    int cat(std::string_view filepath);
     // ls lists the content in the current directory (files and sub-directories)
     int ls();
+    // head -c <n> <filepath> / tail -c <n> <filepath> print the first / last
+    // <n> bytes of a file, reading only the blocks holding them
+    int head(std::string_view filepath, uint32_t n);
+    int tail(std::string_view filepath, uint32_t n);
+    // read <filepath> <offset> <len> prints <len> bytes of a file starting
+    // at <offset>
+    int read_range(std::string_view filepath, uint32_t offset, uint32_t len);
 
     // cp <sourcepath> <destpath> makes an exact copy of the file
-    // <sourcepath> to a new file <destpath>
-    int cp(std::string sourcepath, std::string destpath);
+    // <sourcepath> to a new file <destpath>, in blocks of its own, so that
+    // either file can be appended to without copying the other's blocks
+    int cp(std::string_view sourcepath, std::string_view destpath);
     // mv <sourcepath> <destpath> renames the file <sourcepath> to the name <destpath>,
     // or moves the file <sourcepath> to the directory <destpath> (if dest is a directory)
-    int mv(std::string sourcepath, std::string destpath);
+    int mv(std::string_view sourcepath, std::string_view destpath);
     // rm <filepath> removes / deletes the file <filepath>
-    int rm(std::string filepath);
+    int rm(std::string_view filepath);
     // append <filepath1> <filepath2> appends the contents of file <filepath1> to
     // the end of file <filepath2>. The file <filepath1> is unchanged.
-    int append(std::string filepath1, std::string filepath2);
+    int append(std::string_view filepath1, std::string_view filepath2);
+    // write <filepath> <offset> writes the following rows (ended with an
+    // empty row) over the file from <offset> on, extending it if they reach
+    // past its end; only the blocks written change
+    int write_at(std::string_view filepath, uint32_t offset);
+    // truncate <filepath> <size> cuts the file to <size> bytes, or extends
+    // it with zeros, which take no blocks
+    int truncate(std::string_view filepath, uint32_t size);
+
+    // cp -r <sourcepath> <destpath> copies the directory tree <sourcepath>
+    // to <destpath>; directory blocks are allocated up front, files are
+    // shared, and the FAT is written once
+    int cp_recursive(std::string_view sourcepath, std::string_view destpath);
+    // rm -r <path> removes the directory tree <path>; all blocks are freed
+    // in one pass and the FAT is written once
+    int rm_recursive(std::string_view path);
 
     // mkdir <dirpath> creates a new sub-directory with the name <dirpath>
     // in the current directory
-    int mkdir(std::string dirpath);
+    int mkdir(std::string_view dirpath);
     // cd <dirpath> changes the current (working) directory to the directory named <dirpath>
-    int cd(std::string dirpath);
+    int cd(std::string_view dirpath);
     // pwd prints the full path, i.e., from the root directory, to the current
     // directory, including the current directory name
     int pwd();
 
     // chmod <accessrights> <filepath> changes the access rights for the
     // file <filepath> to <accessrights>.
-    int chmod(std::string accessrights, std::string filepath);
+    int chmod(std::string_view accessrights, std::string_view filepath);
+
+    // import <hostpath> <filepath> copies the host file <hostpath> into the
+    // new file <filepath>; runs of consecutive blocks are copied in one go
+    int import_file(std::string_view hostpath, std::string_view filepath);
+    // export <filepath> <hostpath> copies the file <filepath> to the host
+    // file <hostpath>, replacing it if it exists
+    int export_file(std::string_view filepath, std::string_view hostpath);
+
+    // compress <filepath> / uncompress <filepath> rewrites the file stored
+    // compressed or plain; the content does not change
+    int compress(std::string_view filepath, bool on);
+
+    // snapshot <name> takes a read-only snapshot of the whole file system;
+    // snapshot -d <name> removes it and snapshot lists them
+    int snapshot(std::string_view name);
+    int rm_snapshot(std::string_view name);
+    int list_snapshots();
+
+    // sync writes back the FAT and waits until every block written so far,
+    // and its checksum, is on the disk
+    int sync();
+    // turns block checksums on or off
+    void set_checksums(bool on) { disk.set_checksums(on); }
+    // turns overlapping reads and writes when shared blocks are copied on
+    // or off
+    void set_pipelined_copy(bool on) { pipelined_copy = on; }
+
+    // stats prints how many blocks are in use and the block I/O done so far
+    int stats();
+    // check walks the whole file system and reports directories, chains,
+    // reference counts and blocks that do not add up; returns -1 if any
+    int check();
+    // number of blocks read from / written to the disk so far
+    unsigned long get_no_reads() { return disk.get_no_reads(); }
+    unsigned long get_no_writes() { return disk.get_no_writes(); }
+    // number of writes to the disk file; adjacent blocks are written together
+    unsigned long get_no_device_writes() { return disk.get_no_device_writes(); }
+    // blocks of all files added up, and blocks actually used by files
+    void dedup_counts(uint32_t &logical, uint32_t &physical);
+
+    // open <filepath> with <mode> (READ and/or WRITE, CREATE to create a new
+    // file) returns a handle >= 0, or -1 on error. A file is open for
+    // writing through one handle at a time
+    int open(std::string_view filepath, int mode);
+    // read reads up to <n> bytes at the current offset of <fd> into <buf>,
+    // returns the number of bytes read (0 at end of file), or -1 on error
+    int read(int fd, void *buf, uint32_t n);
+    // write writes <n> bytes at the current offset of <fd>, extending the
+    // file when writing past its end; returns <n>, or -1 on error
+    int write(int fd, const void *buf, uint32_t n);
+    // seek moves the offset of <fd> to <pos>; data written past the end of
+    // the file leaves a hole, which reads as zeros and takes no blocks
+    int seek(int fd, uint32_t pos);
+    // close writes back buffered data and the file size, replaces written
+    // blocks by identical ones already on the disk, and releases the handle
+    // <fd>; the FAT is written by the flusher or the next sync
+    int close(int fd);
+
+    // find <dirpath> [-name <glob>] [-type f|d] [-perm <accessrights>] prints the
+    // path of every file and sub-directory below <dirpath> matching all filters;
+    // <type> -1 matches any type, <rights> are the access bits that must be set
+    int find(std::string_view dirpath, std::string_view pattern, int type, int rights);
 };
 
 #endif // __FS_H__
@@ -0,0 +1,38 @@
+#include <iostream>
+#include <cstdlib>
+#include <csignal>
+#include <thread>
+#include <pthread.h>
+#include "server.h"
+
+// fsserver [<socket>] [<threads>] serves the file system on the Unix
+// socket <socket> (filesystem.sock by default) until SIGINT or SIGTERM
+int
+main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "filesystem.sock";
+    int threads = argc > 2 ? std::atoi(argv[2]) : SERVER_THREADS;
+    if (argc > 3 || threads <= 0) {
+        std::cerr << "Usage: fsserver [<socket>] [<threads>]\n";
+        return 1;
+    }
+
+    // the signals are taken by sigwait() below, not by any of the threads
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    FS filesystem;
+    Server server(filesystem, path, threads);
+    if (server.start())
+        return 1;
+    std::cout << "Serving on " << path << " with " << threads << " threads\n";
+    std::thread acceptor(&Server::run, &server);
+    int sig;
+    sigwait(&signals, &sig);
+    server.stop();
+    acceptor.join();
+    return 0;
+}
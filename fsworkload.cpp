@@ -0,0 +1,71 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include "workload.h"
+
+static int
+usage()
+{
+    std::cerr << "Usage: fsworkload gen [-s <seed>] [-n <commands>] [-m <mix>] "
+                 "[-z <min>:<max>] [-d <depth>]\n"
+                 "       fsworkload replay <trace>\n"
+                 "<mix> is create=25,cat=25,append=10,cp=10,mv=5,rm=15,mkdir=5,cd=5 by default\n";
+    return 1;
+}
+
+// fsworkload gen [options] writes a reproducible workload to stdout, in the
+// text format the shell reads; fsworkload replay <trace> runs such a trace
+// on the disk and reports throughput and latency of each command
+int
+main(int argc, char **argv)
+{
+    if (argc >= 2 && !std::strcmp(argv[1], "gen")) {
+        workload_params params;
+        for (int i = 2; i < argc; i += 2) {
+            if (i + 1 >= argc)
+                return usage();
+            std::string opt = argv[i], arg = argv[i + 1];
+            char *end;
+            if (opt == "-s") {
+                params.seed = std::strtoul(arg.c_str(), &end, 10);
+            } else if (opt == "-n") {
+                params.ops = std::strtoul(arg.c_str(), &end, 10);
+            } else if (opt == "-d") {
+                params.max_depth = std::strtoul(arg.c_str(), &end, 10);
+            } else if (opt == "-z") {
+                params.min_size = std::strtoul(arg.c_str(), &end, 10);
+                if (*end != ':' || params.min_size == 0)
+                    return usage();
+                params.max_size = std::strtoul(end + 1, &end, 10);
+                if (params.max_size < params.min_size)
+                    return usage();
+            } else if (opt == "-m") {
+                if (parse_mix(arg, params))
+                    return usage();
+                continue;
+            } else {
+                return usage();
+            }
+            if (*end != '\0' || arg.empty())
+                return usage();
+        }
+        generate_workload(params, std::cout);
+        return 0;
+    }
+    if (argc == 3 && !std::strcmp(argv[1], "replay")) {
+        std::ifstream trace(argv[2]);
+        if (!trace) {
+            std::cerr << "fsworkload: " << argv[2] << ": Cannot open trace\n";
+            return 1;
+        }
+        FS filesystem;
+        replay_result result;
+        replay_workload(filesystem, trace, result);
+        print_replay(result, std::cout);
+        filesystem.stats();
+        return filesystem.check() ? 1 : 0;
+    }
+    return usage();
+}
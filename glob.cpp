@@ -0,0 +1,94 @@
+#include <cstring>
+#include "glob.h"
+
+Glob::Glob(std::string_view pattern) : literal(true), pattern(pattern)
+{
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        token t;
+        t.c = pattern[i];
+        if (pattern[i] == '*') {
+            // consecutive stars match the same as a single one
+            if (!tokens.empty() && tokens.back().kind == ANY_STRING)
+                continue;
+            t.kind = ANY_STRING;
+        } else if (pattern[i] == '?') {
+            t.kind = ANY_CHAR;
+        } else if (pattern[i] == '[' && pattern.find(']', i + 2) != std::string::npos) {
+            size_t j = i + 1;
+            bool negate = pattern[j] == '!' || pattern[j] == '^';
+            if (negate)
+                ++j;
+            // a ']' directly after the '[' is a member of the set
+            size_t start = j;
+            for (; j < pattern.size() && (j == start || pattern[j] != ']'); ++j) {
+                unsigned char lo = pattern[j];
+                unsigned char hi = lo;
+                if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+                    hi = pattern[j + 2];
+                    j += 2;
+                }
+                for (unsigned c = lo; c <= hi; ++c)
+                    t.set.set(c);
+            }
+            if (j == pattern.size()) {
+                // unterminated set, treat the '[' as a literal
+                t.kind = LITERAL;
+                tokens.push_back(t);
+                continue;
+            }
+            if (negate)
+                t.set.flip();
+            t.kind = CHAR_SET;
+            i = j;
+        } else {
+            t.kind = LITERAL;
+        }
+        if (t.kind != LITERAL)
+            literal = false;
+        tokens.push_back(t);
+    }
+}
+
+bool
+Glob::match_token(const token &t, char c) const
+{
+    switch (t.kind) {
+    case LITERAL:
+        return t.c == c;
+    case ANY_CHAR:
+        return true;
+    case CHAR_SET:
+        return t.set.test((unsigned char)c);
+    }
+    return false;
+}
+
+// returns true if <name> matches the whole pattern
+bool
+Glob::match(const char *name) const
+{
+    if (literal)
+        return pattern == name;
+
+    // greedy match, backtracking only to the most recent "*"
+    size_t n = std::strlen(name);
+    size_t ti = 0, ni = 0;
+    size_t star_ti = std::string::npos, star_ni = 0;
+    while (ni < n) {
+        if (ti < tokens.size() && tokens[ti].kind == ANY_STRING) {
+            star_ti = ti++;
+            star_ni = ni;
+        } else if (ti < tokens.size() && match_token(tokens[ti], name[ni])) {
+            ++ti;
+            ++ni;
+        } else if (star_ti != std::string::npos) {
+            ti = star_ti + 1;
+            ni = ++star_ni;
+        } else {
+            return false;
+        }
+    }
+    while (ti < tokens.size() && tokens[ti].kind == ANY_STRING)
+        ++ti;
+    return ti == tokens.size();
+}
@@ -0,0 +1,31 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <bitset>
+
+#ifndef __GLOB_H__
+#define __GLOB_H__
+
+// A shell-style glob pattern ("*", "?", "[a-z]", "[!0-9]"), compiled once
+// into a token list so that matching many names does no parsing.
+class Glob {
+private:
+    enum { LITERAL, ANY_CHAR, ANY_STRING, CHAR_SET };
+    struct token {
+        int kind;
+        char c;                 // LITERAL
+        std::bitset<256> set;   // CHAR_SET
+    };
+    std::vector<token> tokens;
+    // true if the pattern has no wildcards, matched with a plain compare
+    bool literal;
+    std::string pattern;
+
+    bool match_token(const token &t, char c) const;
+public:
+    Glob(std::string_view pattern);
+    // returns true if <name> matches the whole pattern
+    bool match(const char *name) const;
+};
+
+#endif // __GLOB_H__
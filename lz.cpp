@@ -0,0 +1,159 @@
+#include <cstring>
+#include "lz.h"
+
+// number of entries in the match finder's hash table
+#define HASH_BITS 12
+
+static inline uint32_t
+read32(const uint8_t *p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t
+hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// bytes needed to store the extra length of a 4 bit length field
+static inline size_t
+length_bytes(size_t n)
+{
+    return n < 15 ? 0 : (n - 15) / 255 + 1;
+}
+
+static inline uint8_t *
+put_length(uint8_t *op, size_t n)
+{
+    if (n < 15)
+        return op;
+    n -= 15;
+    while (n >= 255) {
+        *op++ = 255;
+        n -= 255;
+    }
+    *op++ = n;
+    return op;
+}
+
+// compresses as much of <src> (<len> bytes) as fits into <cap> bytes of
+// <dst>; <used> is set to the number of input bytes consumed. Returns the
+// compressed size.
+size_t
+lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap, size_t &used)
+{
+    // positions are stored plus one, so that 0 means empty
+    uint16_t table[1 << HASH_BITS];
+    std::memset(table, 0, sizeof(table));
+    if (len > LZ_MAX_INPUT)
+        len = LZ_MAX_INPUT;
+
+    uint8_t *op = dst, *end = dst + cap;
+    size_t ip = 0, anchor = 0;
+    while (ip + LZ_MIN_MATCH <= len) {
+        size_t lit = ip - anchor;
+        // the literals alone no longer fit, stop searching
+        if (1 + length_bytes(lit) + lit > (size_t)(end - op))
+            break;
+        uint32_t seq = read32(src + ip);
+        uint32_t h = hash(seq);
+        size_t ref = table[h];
+        table[h] = ip + 1;
+        if (ref == 0 || read32(src + ref - 1) != seq) {
+            ++ip;
+            continue;
+        }
+        --ref;
+        size_t ml = LZ_MIN_MATCH;
+        while (ip + ml < len && src[ref + ml] == src[ip + ml])
+            ++ml;
+        size_t cost = 1 + length_bytes(lit) + lit + 2 + length_bytes(ml - LZ_MIN_MATCH);
+        if (cost > (size_t)(end - op))
+            break;
+        uint8_t *token = op++;
+        *token = (lit < 15 ? lit : 15) << 4;
+        op = put_length(op, lit);
+        std::memcpy(op, src + anchor, lit);
+        op += lit;
+        size_t off = ip - ref;
+        *op++ = off & 0xff;
+        *op++ = off >> 8;
+        size_t mlen = ml - LZ_MIN_MATCH;
+        *token |= mlen < 15 ? mlen : 15;
+        op = put_length(op, mlen);
+        ip += ml;
+        anchor = ip;
+    }
+
+    // the rest goes out as literals, as many as still fit
+    size_t room = end - op;
+    size_t lit = len - anchor;
+    if (lit >= room)
+        lit = room > 0 ? room - 1 : 0;
+    while (lit > 0 && 1 + length_bytes(lit) + lit > room)
+        --lit;
+    if (room > 0 && (lit > 0 || op == dst)) {
+        *op++ = (lit < 15 ? lit : 15) << 4;
+        op = put_length(op, lit);
+        std::memcpy(op, src + anchor, lit);
+        op += lit;
+    }
+    used = anchor + lit;
+    return op - dst;
+}
+
+// decompresses <len> bytes of <src> into at most <cap> bytes of <dst>;
+// returns the decompressed size, or -1 if the data is corrupt
+long
+lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap)
+{
+    const uint8_t *ip = src, *iend = src + len;
+    uint8_t *op = dst, *oend = dst + cap;
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                lit += b;
+            } while (b == 255);
+        }
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op))
+            return -1;
+        std::memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+        // the last sequence has no match
+        if (ip == iend)
+            break;
+        if (iend - ip < 2)
+            return -1;
+        size_t off = ip[0] | ip[1] << 8;
+        ip += 2;
+        size_t ml = token & 15;
+        if (ml == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                ml += b;
+            } while (b == 255);
+        }
+        ml += LZ_MIN_MATCH;
+        if (off == 0 || off > (size_t)(op - dst) || ml > (size_t)(oend - op))
+            return -1;
+        // byte by byte, the match may overlap the bytes it produces
+        const uint8_t *ref = op - off;
+        for (size_t i = 0; i < ml; ++i)
+            op[i] = ref[i];
+        op += ml;
+    }
+    return op - dst;
+}
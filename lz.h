@@ -0,0 +1,26 @@
+#include <cstddef>
+#include <cstdint>
+
+#ifndef __LZ_H__
+#define __LZ_H__
+
+// A small LZ77 codec in the style of LZ4. The compressed data is a list of
+// sequences: a token byte (literal count in the high nibble, match length
+// minus LZ_MIN_MATCH in the low nibble, 15 meaning more length bytes follow),
+// the literals, and a 2 byte little-endian match offset. The last sequence
+// has literals only.
+
+// shortest match worth encoding
+#define LZ_MIN_MATCH 4
+// largest input lz_compress() accepts, so that positions fit in 16 bits
+#define LZ_MAX_INPUT 65535
+
+// compresses as much of <src> (<len> bytes) as fits into <cap> bytes of
+// <dst>; <used> is set to the number of input bytes consumed. Returns the
+// compressed size.
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap, size_t &used);
+// decompresses <len> bytes of <src> into at most <cap> bytes of <dst>;
+// returns the decompressed size, or -1 if the data is corrupt
+long lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+#endif // __LZ_H__
@@ -1,10 +1,27 @@
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 #include "shell.h"
 #include "fs.h"
 #include "disk.h"
 
+// filesystem [-f <script>] runs the commands of <script>, which takes the
+// place of stdin; see Shell for batch mode
 int
 main(int argc, char **argv)
 {
+    if (argc == 3 && std::strcmp(argv[1], "-f") == 0) {
+        int fd = open(argv[2], O_RDONLY);
+        if (fd < 0 || dup2(fd, STDIN_FILENO) < 0) {
+            std::cerr << "filesystem: " << argv[2] << ": Cannot open script\n";
+            return 1;
+        }
+        close(fd);
+    } else if (argc != 1) {
+        std::cerr << "Usage: filesystem [-f <script>]\n";
+        return 1;
+    }
     Shell shell;
     shell.run();
     return 0;
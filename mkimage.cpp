@@ -0,0 +1,332 @@
+/*
+ * mkimage <hostdir> <image> builds a formatted disk image holding a copy of
+ * the host directory tree <hostdir>.
+ *
+ * The whole layout is planned in memory first: every directory gets one
+ * block and every file one contiguous extent, handed out in ascending order
+ * after the checksum, hole and snapshot tables. The image is then written
+ * front to back in one sequential pass through a large buffer, so building
+ * it costs about as much as writing the image file once. Only the checksum
+ * table, filled in on the way, is written last.
+ */
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "fs.h"
+#include "crc32c.h"
+
+// the FAT block holds one entry per disk block
+#define NO_BLOCKS (BLOCK_SIZE / 2)
+// size of the buffer the image is written through
+#define WRITE_BUFFER_SIZE (1 << 20)
+
+// a file or directory of the host tree and where it goes in the image
+struct node {
+    std::string hostpath;
+    std::string name;
+    bool is_dir;
+    uint32_t size;
+    uint8_t access_rights;
+    uint16_t first_blk;
+    uint16_t no_blocks;
+    std::vector<node> children;
+};
+
+// reads the host directory <dir> into <n>, recursively
+static int
+scan(node &n)
+{
+    DIR *d = opendir(n.hostpath.c_str());
+    if (!d) {
+        std::cerr << "mkimage: " << n.hostpath << ": " << std::strerror(errno) << "\n";
+        return -1;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != nullptr) {
+        if (!std::strcmp(de->d_name, ".") || !std::strcmp(de->d_name, ".."))
+            continue;
+        node child;
+        child.hostpath = n.hostpath + "/" + de->d_name;
+        child.name = de->d_name;
+        // links are not followed: they may lead out of the tree or around
+        // in a loop
+        struct stat st;
+        if (lstat(child.hostpath.c_str(), &st)) {
+            std::cerr << "mkimage: " << child.hostpath << ": " << std::strerror(errno) << "\n";
+            closedir(d);
+            return -1;
+        }
+        if (child.name.size() >= NAME_CAPACITY) {
+            std::cerr << "mkimage: " << child.hostpath << ": name longer than "
+                      << NAME_CAPACITY - 1 << " characters\n";
+            closedir(d);
+            return -1;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            child.is_dir = true;
+            child.size = 0;
+            child.access_rights = READ | WRITE | EXECUTE;
+            if (scan(child)) {
+                closedir(d);
+                return -1;
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            if (st.st_size > UINT32_MAX) {
+                std::cerr << "mkimage: " << child.hostpath << ": file too large\n";
+                closedir(d);
+                return -1;
+            }
+            child.is_dir = false;
+            child.size = st.st_size;
+            // the owner's permission bits map onto READ, WRITE and EXECUTE
+            child.access_rights = (st.st_mode >> 6) & 07;
+        } else if (S_ISLNK(st.st_mode)) {
+            std::cerr << "mkimage: skipping " << child.hostpath << " (symbolic link)\n";
+            continue;
+        } else {
+            std::cerr << "mkimage: skipping " << child.hostpath << " (not a file or directory)\n";
+            continue;
+        }
+        n.children.push_back(child);
+    }
+    closedir(d);
+    std::sort(n.children.begin(), n.children.end(),
+              [](const node &a, const node &b) { return a.name < b.name; });
+    return 0;
+}
+
+// hands out the blocks of everything below <n>, in ascending order
+static int
+plan(node &n, unsigned &next)
+{
+    // the root directory has no ".." entry
+    unsigned room = n.first_blk == ROOT_BLOCK ? DIR_ENTRIES : DIR_ENTRIES - 1;
+    if (n.children.size() > room) {
+        std::cerr << "mkimage: " << n.hostpath << ": more than " << room << " entries\n";
+        return -1;
+    }
+    for (size_t i = 0; i < n.children.size(); ++i) {
+        node &c = n.children[i];
+        c.no_blocks = c.is_dir || c.size == 0 ? 1 : (c.size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if (next + c.no_blocks > NO_BLOCKS) {
+            std::cerr << "mkimage: " << c.hostpath << ": image full\n";
+            return -1;
+        }
+        c.first_blk = next;
+        next += c.no_blocks;
+        if (c.is_dir && plan(c, next))
+            return -1;
+    }
+    return 0;
+}
+
+// fills in the FAT chains of everything below <n> and collects the nodes
+// that own blocks
+static void
+build(node &n, int16_t *fat, std::vector<node*> &extents)
+{
+    for (size_t i = 0; i < n.children.size(); ++i) {
+        node &c = n.children[i];
+        for (unsigned b = 0; b < c.no_blocks; ++b)
+            fat[c.first_blk + b] = b + 1 < c.no_blocks ? c.first_blk + b + 1 : FAT_EOF;
+        extents.push_back(&c);
+        if (c.is_dir)
+            build(c, fat, extents);
+    }
+}
+
+// the directory block of <n>
+static void
+make_dir(const node &n, uint16_t parent, dir_entry *dir)
+{
+    std::memset(dir, 0, BLOCK_SIZE);
+    unsigned i = 0;
+    if (n.first_blk != ROOT_BLOCK) {
+        Name("..").copy_to(dir[i].file_name);
+        dir[i].first_blk = parent;
+        dir[i].type = TYPE_DIR;
+        dir[i].access_rights = READ | WRITE | EXECUTE;
+        ++i;
+    }
+    for (size_t c = 0; c < n.children.size(); ++c, ++i) {
+        Name(n.children[c].name).copy_to(dir[i].file_name);
+        dir[i].size = n.children[c].size;
+        dir[i].first_blk = n.children[c].first_blk;
+        dir[i].type = n.children[c].is_dir ? TYPE_DIR : TYPE_FILE;
+        dir[i].access_rights = n.children[c].access_rights;
+    }
+}
+
+// sequential writer: everything goes through one large buffer, in whole
+// blocks, and the checksum of each block is taken on the way
+class ImageWriter {
+private:
+    int fd;
+    std::vector<uint8_t> buf;
+    size_t len;
+    unsigned next_blk;
+public:
+    std::vector<uint32_t> checksums;
+    ImageWriter(int fd) : fd(fd), buf(WRITE_BUFFER_SIZE), len(0), next_blk(0),
+                          checksums(NO_BLOCKS) {}
+    int flush()
+    {
+        size_t done = 0;
+        while (done < len) {
+            ssize_t n = ::write(fd, buf.data() + done, len - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                return -1;
+            done += n;
+        }
+        len = 0;
+        return 0;
+    }
+    // room for up to <n> bytes at the end of the buffer
+    uint8_t *reserve(size_t n)
+    {
+        if (len + n > buf.size() && flush())
+            return nullptr;
+        return buf.data() + len;
+    }
+    void commit(size_t n)
+    {
+        for (size_t off = 0; off < n; off += BLOCK_SIZE)
+            checksums[next_blk++] = crc32c(0, buf.data() + len + off, BLOCK_SIZE);
+        len += n;
+    }
+    int put(const void *data, size_t n)
+    {
+        uint8_t *p = reserve(n);
+        if (!p)
+            return -1;
+        std::memcpy(p, data, n);
+        commit(n);
+        return 0;
+    }
+    // copies the host file <n> into the image, zero filling its last block
+    int put_file(const node &n)
+    {
+        int in = ::open(n.hostpath.c_str(), O_RDONLY);
+        if (in < 0)
+            return -1;
+        size_t left = (size_t)n.no_blocks * BLOCK_SIZE;
+        size_t data = n.size;
+        while (left > 0) {
+            size_t chunk = std::min<size_t>(left, buf.size() / 2);
+            uint8_t *p = reserve(chunk);
+            if (!p) {
+                ::close(in);
+                return -1;
+            }
+            size_t got = 0;
+            while (got < std::min(chunk, data)) {
+                ssize_t r = ::read(in, p + got, std::min(chunk, data) - got);
+                if (r < 0 && errno == EINTR)
+                    continue;
+                if (r <= 0) {
+                    ::close(in);
+                    return -1;
+                }
+                got += r;
+            }
+            std::memset(p + got, 0, chunk - got);
+            commit(chunk);
+            data -= got;
+            left -= chunk;
+        }
+        ::close(in);
+        return 0;
+    }
+};
+
+int
+main(int argc, char **argv)
+{
+    if (argc != 3) {
+        std::cerr << "Usage: mkimage <hostdir> <image>\n";
+        return 1;
+    }
+
+    node root;
+    root.hostpath = argv[1];
+    root.is_dir = true;
+    root.first_blk = ROOT_BLOCK;
+    root.no_blocks = 1;
+    unsigned next = FIRST_DATA_BLOCK;
+    if (scan(root) || plan(root, next))
+        return 1;
+
+    int16_t fat[NO_BLOCKS];
+    std::memset(fat, 0, sizeof(fat));
+    fat[ROOT_BLOCK] = FAT_EOF;
+    fat[FAT_BLOCK] = FAT_EOF;
+    for (int i = 0; i < CHECKSUM_BLOCKS; ++i)
+        fat[CHECKSUM_BLOCK + i] = FAT_EOF;
+    for (int i = 0; i < HOLE_BLOCKS; ++i)
+        fat[HOLE_BLOCK + i] = FAT_EOF;
+    fat[SNAPSHOT_BLOCK] = FAT_EOF;
+    std::vector<node*> extents;
+    build(root, fat, extents);
+    // parents are planned before their children, so this is block order
+    std::vector<uint16_t> parents(NO_BLOCKS, ROOT_BLOCK);
+    for (size_t i = 0; i < extents.size(); ++i) {
+        for (size_t c = 0; c < extents[i]->children.size(); ++c)
+            parents[extents[i]->children[c].first_blk] = extents[i]->first_blk;
+    }
+
+    int fd = ::open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "mkimage: " << argv[2] << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    ImageWriter out(fd);
+    dir_entry dir[DIR_ENTRIES];
+    make_dir(root, ROOT_BLOCK, dir);
+    uint8_t zero[BLOCK_SIZE];
+    std::memset(zero, 0, sizeof(zero));
+    int ret = out.put(dir, BLOCK_SIZE) || out.put(fat, BLOCK_SIZE);
+    // room for the checksum table, an empty hole table, as files are
+    // copied whole, and an empty snapshot table
+    for (int i = 0; i < CHECKSUM_BLOCKS + HOLE_BLOCKS + 1 && ret == 0; ++i)
+        ret = out.put(zero, BLOCK_SIZE);
+    for (size_t i = 0; i < extents.size() && ret == 0; ++i) {
+        node &n = *extents[i];
+        if (n.is_dir) {
+            make_dir(n, parents[n.first_blk], dir);
+            ret = out.put(dir, BLOCK_SIZE);
+        } else {
+            ret = out.put_file(n);
+            if (ret)
+                std::cerr << "mkimage: " << n.hostpath << ": read error\n";
+        }
+    }
+    // the rest of the disk is left as free, zeroed blocks
+    if (ret == 0)
+        ret = out.flush() || ftruncate(fd, (off_t)NO_BLOCKS * BLOCK_SIZE);
+    // free blocks and the table itself have no checksum
+    for (unsigned b = next; b < NO_BLOCKS; ++b)
+        out.checksums[b] = 0;
+    for (int i = 0; i < CHECKSUM_BLOCKS; ++i)
+        out.checksums[CHECKSUM_BLOCK + i] = 0;
+    size_t table_size = NO_BLOCKS * sizeof(uint32_t);
+    if (ret == 0 && pwrite(fd, out.checksums.data(), table_size,
+                           (off_t)CHECKSUM_BLOCK * BLOCK_SIZE) != (ssize_t)table_size)
+        ret = -1;
+    ::close(fd);
+    if (ret) {
+        std::cerr << "mkimage: writing " << argv[2] << " failed\n";
+        return 1;
+    }
+    std::cout << "mkimage: " << argv[2] << ": " << extents.size() << " files and directories, "
+              << next << " of " << NO_BLOCKS << " blocks used\n";
+    return 0;
+}
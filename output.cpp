@@ -0,0 +1,97 @@
+#include <iostream>
+#include <charconv>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include "output.h"
+
+Output::Output(int fd) : fd(fd), sync(&std::cout), len(0)
+{
+
+}
+
+Output::Output(int fd, std::ostream &sync) : fd(fd), sync(&sync), len(0)
+{
+
+}
+
+// returns room for <n> (at most OUTPUT_BUFFER_SIZE) bytes at the end of
+// the buffer, flushing it first if it is too full
+char *
+Output::reserve(size_t n)
+{
+    if (len + n > OUTPUT_BUFFER_SIZE)
+        flush();
+    return buf + len;
+}
+
+void
+Output::write(const void *data, size_t n)
+{
+    // data too large to buffer is written past it, so the buffer and the
+    // stream go first, also when the buffer is empty
+    if (len + n > OUTPUT_BUFFER_SIZE || n >= OUTPUT_BUFFER_SIZE)
+        flush();
+    if (n >= OUTPUT_BUFFER_SIZE && fd < 0) {
+        sync->write((const char*)data, n);
+        return;
+    }
+    if (n >= OUTPUT_BUFFER_SIZE) {
+        // too large to buffer, write it as it is
+        const char *p = (const char*)data;
+        while (n > 0) {
+            ssize_t ret = ::write(fd, p, n);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret < 0)
+                return;
+            p += ret;
+            n -= ret;
+        }
+        return;
+    }
+    std::memcpy(buf + len, data, n);
+    len += n;
+}
+
+void
+Output::put(char c)
+{
+    if (len == OUTPUT_BUFFER_SIZE)
+        flush();
+    buf[len++] = c;
+}
+
+void
+Output::put(uint32_t v)
+{
+    char digits[10];
+    std::to_chars_result res = std::to_chars(digits, digits + sizeof(digits), v);
+    write(digits, res.ptr - digits);
+}
+
+// writes out everything buffered; std::cout (or <sync>) is flushed first
+// so that output written through it keeps its order
+int
+Output::flush()
+{
+    if (fd < 0) {
+        sync->write(buf, len);
+        len = 0;
+        return sync->good() ? 0 : -1;
+    }
+    sync->flush();
+    size_t done = 0;
+    while (done < len) {
+        ssize_t ret = ::write(fd, buf + done, len - done);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret < 0) {
+            len = 0;
+            return -1;
+        }
+        done += ret;
+    }
+    len = 0;
+    return 0;
+}
@@ -0,0 +1,40 @@
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <iosfwd>
+
+#ifndef __OUTPUT_H__
+#define __OUTPUT_H__
+
+// size of the output buffer, room for 16 blocks
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+// Output sink for command output. Everything is collected in one large
+// buffer and written to the file descriptor when the buffer is full or the
+// command is done, instead of once per line. With fd -1 it goes into the
+// stream <sync> instead, which does the writing.
+class Output {
+private:
+    int fd;
+    // stream writing to the same place, flushed before the buffer
+    std::ostream *sync;
+    size_t len;
+    char buf[OUTPUT_BUFFER_SIZE];
+public:
+    Output(int fd);
+    Output(int fd, std::ostream &sync);
+    // returns room for <n> (at most OUTPUT_BUFFER_SIZE) bytes at the end of
+    // the buffer, so that data can be read straight into it; commit() then
+    // adds the bytes actually filled in
+    char *reserve(size_t n);
+    void commit(size_t n) { len += n; }
+    void write(const void *data, size_t n);
+    void put(std::string_view s) { write(s.data(), s.size()); }
+    void put(char c);
+    void put(uint32_t v);
+    // writes out everything buffered; std::cout (or <sync>) is flushed
+    // first so that output written through it keeps its order
+    int flush();
+};
+
+#endif // __OUTPUT_H__
@@ -0,0 +1,76 @@
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#ifndef __PATH_H__
+#define __PATH_H__
+
+// capacity of a name, the same as dir_entry::file_name (including the '\0')
+#define NAME_CAPACITY 56
+
+// A file or directory name stored inline and zero padded exactly like
+// dir_entry::file_name, so names are compared and copied without allocating.
+class Name {
+private:
+    char buf[NAME_CAPACITY];
+    // NAME_CAPACITY marks a name that did not fit
+    uint8_t len;
+public:
+    Name() : len(0) { std::memset(buf, 0, sizeof(buf)); }
+    explicit Name(std::string_view s) { assign(s); }
+    // copies <s>, returns false (leaving an empty, invalid name) if it does not fit
+    bool assign(std::string_view s)
+    {
+        std::memset(buf, 0, sizeof(buf));
+        if (s.size() >= NAME_CAPACITY) {
+            len = NAME_CAPACITY;
+            return false;
+        }
+        std::memcpy(buf, s.data(), s.size());
+        len = s.size();
+        return true;
+    }
+    bool fits() const { return len < NAME_CAPACITY; }
+    // a valid entry name fits, is not empty and is not "." or ".."
+    bool valid() const
+    {
+        return fits() && len > 0 && view() != "." && view() != ".." &&
+            std::memchr(buf, '/', len) == nullptr;
+    }
+    const char *c_str() const { return buf; }
+    std::string_view view() const { return std::string_view(buf, fits() ? len : 0); }
+    // compares with a zero padded dir_entry::file_name
+    bool matches(const char *file_name) const
+    {
+        return fits() && std::memcmp(file_name, buf, len + 1) == 0;
+    }
+    // copies the name into a dir_entry::file_name
+    void copy_to(char *file_name) const { std::memcpy(file_name, buf, NAME_CAPACITY); }
+};
+
+// Splits a path into its components in place; empty components ("a//b",
+// trailing '/') and "." are skipped.
+class PathTokenizer {
+private:
+    std::string_view path;
+    size_t pos;
+public:
+    PathTokenizer(std::string_view path) : path(path), pos(0) {}
+    bool absolute() const { return !path.empty() && path[0] == '/'; }
+    // stores the next component in <comp>, returns false at the end of the path
+    bool next(std::string_view &comp)
+    {
+        while (pos < path.size()) {
+            size_t end = path.find('/', pos);
+            if (end == std::string_view::npos)
+                end = path.size();
+            comp = path.substr(pos, end - pos);
+            pos = end + 1;
+            if (!comp.empty() && comp != ".")
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif // __PATH_H__
@@ -0,0 +1,415 @@
+#include <iostream>
+#include <sstream>
+#include <string_view>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "server.h"
+#include "command.h"
+
+// stream buffer writing to a connection
+class fdbuf : public std::streambuf {
+private:
+    int fd;
+    char obuf[BLOCK_SIZE];
+protected:
+    int overflow(int c) override;
+    int sync() override;
+public:
+    fdbuf(int fd) : fd(fd)
+    {
+        setp(obuf, obuf + sizeof(obuf));
+    }
+};
+
+int
+fdbuf::overflow(int c)
+{
+    if (sync())
+        return traits_type::eof();
+    if (c != traits_type::eof()) {
+        *pptr() = c;
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int
+fdbuf::sync()
+{
+    char *p = pbase();
+    while (p < pptr()) {
+        ssize_t n = ::write(fd, p, pptr() - p);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        p += n;
+    }
+    setp(obuf, obuf + sizeof(obuf));
+    return 0;
+}
+
+// a client connection: its socket, the stream over it and its session,
+// kept while it waits for its next command
+struct connection {
+    int fd;
+    fdbuf buf;
+    std::ostream out;
+    fs_session session;
+    // what the client sent, of which the first <start> bytes have been run
+    // as commands; <at_end> once the client closed its end
+    std::string input;
+    size_t start;
+    bool at_end;
+    // where the row of the next command ends, npos while it has not all
+    // arrived, and how far the input has been searched for the end of the
+    // command, so that rows arriving a block at a time are searched once
+    size_t row_end;
+    size_t searched;
+    // the session is attached and the client has had its first prompt
+    bool attached;
+    connection(int fd)
+        : fd(fd), buf(fd), out(&buf), start(0), at_end(false), row_end(std::string::npos),
+          searched(0), attached(false)
+    {
+        session.in = nullptr;
+        session.out = &out;
+        session.out_fd = fd;
+    }
+};
+
+// the end of the next command of <c>: after its row and, for create and
+// write, after the empty row ending their data rows; npos if the client
+// has not sent all of it yet
+static size_t
+command_end(connection &c)
+{
+    if (c.row_end == std::string::npos) {
+        c.row_end = c.input.find('\n', c.searched);
+        if (c.row_end == std::string::npos) {
+            c.searched = c.input.size();
+            return std::string::npos;
+        }
+        c.searched = c.row_end;
+    }
+    if (!reads_rows(std::string_view(c.input).substr(c.start, c.row_end - c.start)))
+        return c.row_end + 1;
+    // the row of the command may be followed by the empty one right away
+    size_t rows_end = c.input.find("\n\n", c.searched);
+    if (rows_end == std::string::npos) {
+        c.searched = c.input.size() - 1;
+        return std::string::npos;
+    }
+    return rows_end + 2;
+}
+
+// moves the start of the input of <c> past <end>, the end of a command
+static void
+consume(connection &c, size_t end)
+{
+    c.start = end;
+    if (c.start > c.input.size() / 2) {
+        c.input.erase(0, c.start);
+        c.start = 0;
+    }
+    c.row_end = std::string::npos;
+    c.searched = c.start;
+}
+
+// true if connection <c> has a whole command to run, or has ended
+static bool
+has_command(connection &c)
+{
+    return c.at_end || command_end(c) != std::string::npos;
+}
+
+Server::Server(FS &filesystem, const std::string &socket_path, int threads)
+    : filesystem(filesystem), socket_path(socket_path), nthreads(threads),
+      listen_fd(-1), wake_fds{-1, -1}, stopping(false), running(false)
+{
+
+}
+
+Server::~Server()
+{
+    stop();
+}
+
+// binds the socket and starts the workers; returns -1 on error
+int
+Server::start()
+{
+    struct sockaddr_un addr;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "server: " << socket_path << ": Socket path too long\n";
+        return -1;
+    }
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, socket_path.c_str());
+    // a client going away must not end the server
+    signal(SIGPIPE, SIG_IGN);
+    if (pipe2(wake_fds, O_NONBLOCK | O_CLOEXEC)) {
+        std::cerr << "server: pipe: " << std::strerror(errno) << "\n";
+        return -1;
+    }
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path.c_str());
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) ||
+        listen(listen_fd, SOMAXCONN)) {
+        std::cerr << "server: " << socket_path << ": " << std::strerror(errno) << "\n";
+        if (listen_fd >= 0)
+            ::close(listen_fd);
+        listen_fd = -1;
+        ::close(wake_fds[0]);
+        ::close(wake_fds[1]);
+        return -1;
+    }
+    for (int i = 0; i < nthreads; ++i)
+        workers.push_back(std::thread(&Server::work, this));
+    return 0;
+}
+
+// makes run() wait on the connections handed back since it last looked;
+// a full pipe has a wake-up pending already
+void
+Server::wake()
+{
+    char b = 0;
+    ssize_t n = ::write(wake_fds[1], &b, 1);
+    (void)n;
+}
+
+// accepts connections until stop() is called
+int
+Server::run()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (stopping)
+            return 0;
+        running = true;
+    }
+    int ret = poll_loop();
+    std::lock_guard<std::mutex> guard(lock);
+    running = false;
+    stopped.notify_all();
+    return ret;
+}
+
+// accepts connections and queues them, and those that sent a command,
+// for the workers until stop() is called
+int
+Server::poll_loop()
+{
+    std::vector<struct pollfd> fds;
+    std::vector<connection*> watched;
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (stopping)
+                return 0;
+            watched = idle;
+            fds.assign(2 + watched.size(), pollfd());
+            fds[0].fd = listen_fd;
+            fds[1].fd = wake_fds[0];
+            for (size_t i = 0; i < watched.size(); ++i)
+                fds[2 + i].fd = watched[i]->fd;
+            for (size_t i = 0; i < fds.size(); ++i)
+                fds[i].events = POLLIN;
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "server: poll: " << std::strerror(errno) << "\n";
+            return -1;
+        }
+        char drain[64];
+        while (::read(wake_fds[0], drain, sizeof(drain)) > 0)
+            ;
+        // the connections polled belong to this loop until they are queued
+        for (size_t i = 0; i < watched.size(); ++i) {
+            if (fds[2 + i].revents)
+                receive(*watched[i]);
+        }
+        int fd = -1, err = 0;
+        if (fds[0].revents) {
+            fd = accept(listen_fd, nullptr, nullptr);
+            err = errno;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        if (stopping) {
+            if (fd >= 0)
+                ::close(fd);
+            return 0;
+        }
+        if (fds[0].revents && fd < 0 && err != EINTR && err != ECONNABORTED) {
+            std::cerr << "server: accept: " << std::strerror(err) << "\n";
+            return -1;
+        }
+        // a connection the client closed is ready too, its worker finds
+        // the end
+        for (size_t i = 0; i < watched.size(); ++i) {
+            if (fds[2 + i].revents && has_command(*watched[i])) {
+                idle.erase(std::find(idle.begin(), idle.end(), watched[i]));
+                pending.push_back(watched[i]);
+                ready.notify_one();
+            }
+        }
+        if (fd >= 0) {
+            // a client that does not take its output is dropped rather than
+            // keeping a worker
+            struct timeval timeout = { SERVER_SEND_TIMEOUT, 0 };
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            connections.push_back(std::make_unique<connection>(fd));
+            pending.push_back(connections.back().get());
+            ready.notify_one();
+        }
+    }
+}
+
+// reads what connection <c> has sent; a client sending more than
+// SERVER_INPUT_MAX bytes without completing a command is cut off
+void
+Server::receive(connection &c)
+{
+    char buf[BLOCK_SIZE];
+    ssize_t n = ::read(c.fd, buf, sizeof(buf));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return;
+    if (n <= 0) {
+        c.at_end = true;
+        return;
+    }
+    c.input.append(buf, n);
+    if (c.input.size() - c.start > SERVER_INPUT_MAX && !has_command(c)) {
+        const char msg[] = "server: command too long\n";
+        ssize_t ret = ::write(c.fd, msg, sizeof(msg) - 1);
+        (void)ret;
+        consume(c, c.input.size());
+        c.at_end = true;
+    }
+}
+
+// stops accepting, waits for run() and the workers to return and ends
+// the connections
+void
+Server::stop()
+{
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if (listen_fd < 0)
+            return;
+        stopping = true;
+        // run() and the reads of the commands being run return
+        wake();
+        shutdown(listen_fd, SHUT_RDWR);
+        for (size_t i = 0; i < connections.size(); ++i)
+            shutdown(connections[i]->fd, SHUT_RD);
+        ready.notify_all();
+        // nothing run() polls or walks may go away before it returns
+        stopped.wait(guard, [this]() { return !running; });
+    }
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+    workers.clear();
+    for (size_t i = 0; i < connections.size(); ++i) {
+        if (connections[i]->attached)
+            filesystem.detach(connections[i]->session);
+        ::close(connections[i]->fd);
+    }
+    connections.clear();
+    pending.clear();
+    idle.clear();
+    ::close(listen_fd);
+    listen_fd = -1;
+    ::close(wake_fds[0]);
+    ::close(wake_fds[1]);
+    unlink(socket_path.c_str());
+}
+
+// a worker thread: runs one command of each connection it takes from the
+// queue, then hands the connection back to run()
+void
+Server::work()
+{
+    for (;;) {
+        connection *c;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            ready.wait(guard, [this]() { return stopping || !pending.empty(); });
+            if (stopping)
+                return;
+            c = pending.front();
+            pending.pop_front();
+        }
+        bool open = serve(*c);
+        std::lock_guard<std::mutex> guard(lock);
+        if (!open) {
+            close_connection(*c);
+        } else if (has_command(*c)) {
+            // commands received along with this one are not seen by poll()
+            pending.push_back(c);
+            ready.notify_one();
+        } else {
+            idle.push_back(c);
+            wake();
+        }
+    }
+}
+
+// runs the next command of connection <c>, or attaches the session of a
+// new one; returns false when the client closed it or sent quit, or did
+// not take its output
+bool
+Server::serve(connection &c)
+{
+    if (!c.attached) {
+        filesystem.attach(c.session);
+        c.attached = true;
+    } else {
+        // the command has all its data rows, so running it does not wait
+        // for the client; what it leaves unread stays for the next one
+        size_t end = command_end(c);
+        if (end == std::string::npos)
+            end = c.input.size();
+        std::istringstream in(c.input.substr(c.start, end - c.start));
+        c.session.in = &in;
+        filesystem.resume(c.session);
+        std::string line;
+        // the host's files are not the clients' to read or write
+        bool more = std::getline(in, line) && run_command(filesystem, line, c.out, true, false);
+        std::streamoff done = in.tellg();
+        consume(c, done < 0 ? end : c.start + done);
+        if (!more) {
+            c.out.flush();
+            filesystem.detach(c.session);
+            c.attached = false;
+            return false;
+        }
+    }
+    c.out << "filesystem> " << std::flush;
+    filesystem.suspend();
+    if (c.out.good())
+        return true;
+    filesystem.detach(c.session);
+    c.attached = false;
+    return false;
+}
+
+// closes connection <c> and forgets it; called with the lock held
+void
+Server::close_connection(connection &c)
+{
+    ::close(c.fd);
+    connections.erase(std::find_if(connections.begin(), connections.end(),
+                                   [&c](const std::unique_ptr<connection> &p) { return p.get() == &c; }));
+}
@@ -0,0 +1,73 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "fs.h"
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+// default number of worker threads, each running one command at a time
+#define SERVER_THREADS 8
+// a command with its data rows may take up to twice the disk, which has
+// a FAT entry of 2 bytes for each of its blocks; output must be taken by
+// the client within SERVER_SEND_TIMEOUT seconds
+#define SERVER_INPUT_MAX (2 * (BLOCK_SIZE / 2) * BLOCK_SIZE)
+#define SERVER_SEND_TIMEOUT 10
+
+// a client connection, see server.cpp
+struct connection;
+
+// Serves the shell commands over a Unix domain socket. Every connection is a
+// session of the file system with its own current directory, and gets a
+// "filesystem> " prompt when it may send the next command. run() reads
+// from the connections waiting for a command and queues those that sent a
+// whole one, with the data rows of create and write; a pool of worker
+// threads takes them from the queue and runs one command each before
+// handing the connection back. Commands never wait for their client, so any
+// number of clients share the workers. Host files are out of reach of the clients: import, export
+// and trace are the console's only.
+class Server {
+private:
+    FS &filesystem;
+    std::string socket_path;
+    int nthreads;
+    int listen_fd;
+    // run() waits in poll() on the read end; a worker writes a byte to the
+    // other when it hands a connection back
+    int wake_fds[2];
+    std::vector<std::thread> workers;
+    // every open connection; those new or with a command to run, waiting
+    // for a worker, and those waiting for their client
+    std::vector<std::unique_ptr<connection> > connections;
+    std::deque<connection*> pending;
+    std::vector<connection*> idle;
+    std::mutex lock;
+    std::condition_variable ready;
+    bool stopping;
+    // run() is in its loop; stop() waits for it to leave before closing
+    // the descriptors it polls
+    bool running;
+    std::condition_variable stopped;
+    int poll_loop();
+    void receive(connection &c);
+    void wake();
+    void work();
+    bool serve(connection &c);
+    void close_connection(connection &c);
+public:
+    Server(FS &filesystem, const std::string &socket_path, int threads = SERVER_THREADS);
+    ~Server();
+    // binds the socket and starts the workers; returns -1 on error
+    int start();
+    // accepts connections until stop() is called
+    int run();
+    // stops accepting, waits for run() and the workers to return and ends
+    // the connections
+    void stop();
+};
+
+#endif // __SERVER_H__
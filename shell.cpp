@@ -1,17 +1,40 @@
 #include <iostream>
-#include <sstream>
 #include <string>
-#include <vector>
+#include <unistd.h>
 #include "shell.h"
-#include "fs.h"
+#include "command.h"
 
-std::string commands_str[] = {
-    "format", "create", "cat", "ls",
-    "cp", "mv", "rm", "append",
-    "mkdir", "cd", "pwd",
-    "chmod",
-    "help", "quit"
-};
+// true if stdin is not a terminal; then the standard streams are set up
+// for batch mode: nothing is typed, so the output is not flushed for prompts
+static bool
+batch_mode()
+{
+    if (isatty(STDIN_FILENO))
+        return false;
+    std::ios::sync_with_stdio(false);
+    std::cin.tie(nullptr);
+    return true;
+}
+
+// decided when the program starts, before the file system prints anything
+static const bool batch = batch_mode();
+
+// runs the commands from stdin without prompts; data rows of create and
+// write are read from it as well, and all output collects in std::cout
+static void
+run_batch(FS &filesystem)
+{
+    fs_session script;
+    script.in = &std::cin;
+    script.out = &std::cout;
+    script.out_fd = -1;
+    filesystem.attach(script);
+    std::string line;
+    while (std::getline(std::cin, line) && run_command(filesystem, line, std::cout, false))
+        ;
+    filesystem.detach(script);
+    std::cout.flush();
+}
 
 Shell::Shell()
 {
@@ -23,230 +46,17 @@ Shell::~Shell()
     std::cout << "Exiting shell...\n";
 }
 
+// runs the commands from stdin until quit or the end of the input,
+// prompting for each unless in batch mode
 void
 Shell::run()
 {
-    bool running = true;
+    if (batch) {
+        run_batch(filesystem);
+        return;
+    }
     std::string line;
-    std::string str;
-    char c;
-    std::vector<std::string> cmd_line;
-    std::string cmd, arg1, arg2;
-    int ret_val = 0;
-    while (running) {
+    std::cout << "filesystem> ";
+    while (std::getline(std::cin, line) && run_command(filesystem, line, std::cout))
         std::cout << "filesystem> ";
-        std::getline(std::cin, line);
-        std::stringstream linestream(line);
-        cmd_line.clear();
-        str.clear();
-        while (linestream.get(c)) {
-            //std::cout << "parsing cmd line: " << c << "\n";
-            if (c != ' ') {
-                str += c;
-            } else {
-                // strip multiple blanks
-                if (!str.empty()) {
-                    cmd_line.push_back(str);
-                    str.clear();
-                }
-            }
-        }
-        if (!str.empty())
-            cmd_line.push_back(str);
-        if (line.empty())
-            cmd = "";
-        else
-            cmd = cmd_line[0];
-
-        if (DEBUG) {
-            std::cout << "Line: " << line << std::endl;
-            std::cout << "cmd: " << cmd << std::endl;
-            for (unsigned i = 0; i < cmd_line.size(); ++i)
-                std::cout << "cmd/arg: " << cmd_line[i] << "\n";
-        }
-
-        if (cmd == "format") {
-            if (cmd_line.size() != 1) {
-                std::cout << "Usage: format\n";
-                continue;
-            }
-            // check return value so everything is ok
-            ret_val = filesystem.format();
-            if (ret_val) {
-                std::cout << "Error: format failed, error code " << ret_val << std::endl;
-            }
-        }
-
-        else if (cmd == "create") {
-            if (cmd_line.size() != 2) {
-                std::cout << "Usage: create <file>\n";
-                continue;
-            }
-            arg1 = cmd_line[1];
-            std::cout << "Enter data. Empty line to end.\n";
-            // check return value so everything is ok
-            ret_val = filesystem.create(arg1);
-            if (ret_val) {
-                std::cout << "Error: create " << arg1;
-                std::cout << " failed, error code " << ret_val << std::endl;
-            }
-        }
-
-        else if (cmd == "cat") {
-            if (cmd_line.size() != 2) {
-                std::cout << "Usage: cat <file>\n";
-                continue;
-            }
-            arg1 = cmd_line[1];
-            // check return value so everything is ok
-            ret_val = filesystem.cat(arg1);
-            if (ret_val) {
-                std::cout << "Error: cat " << arg1;
-                std::cout << " failed, error code " << ret_val << std::endl;
-            }
-        }
-
-        else if (cmd == "ls") {
-            if (cmd_line.size() != 1) {
-                std::cout << "Usage: ls\n";
-                continue;
-            }
-            // check return value so everything is ok
-            ret_val = filesystem.ls();
-            if (ret_val) {
-                std::cout << "Error: ls failed, error code " << ret_val << std::endl;
-            }
-        }
-
-        else if (cmd == "cp") {
-            if (cmd_line.size() != 3) {
-                std::cout << "Usage: <oldfile> <newfile>\n";
-                continue;
-            }
-            arg1 = cmd_line[1];
-            arg2 = cmd_line[2];
-            // check return value so everything is ok
-            ret_val = filesystem.cp(arg1, arg2);
-            if (ret_val) {
-                std::cout << "Error: cp " << arg1 << " " << arg2;
-                std::cout << " failed, error code " << ret_val << std::endl;
-            }
-        }
-
-        else if (cmd == "mv") {
-            if (cmd_line.size() != 3) {
-                std::cout << "Usage: mv <sourcepath> <destpath>\n";
-                continue;
-            }
-            arg1 = cmd_line[1];
-            arg2 = cmd_line[2];
-            // check return value so everything is ok
-            ret_val = filesystem.mv(arg1, arg2);
-            if (ret_val) {
-                std::cout << "Error: mv " << arg1 << " " << arg2;
-                std::cout << " failed, error code " << ret_val << std::endl;
-            }
-        }
-
-        else if (cmd == "rm") {
-            if (cmd_line.size() != 2) {
-                std::cout << "Usage: rm <file>\n";
-                continue;
-            }
-            arg1 = cmd_line[1];
-            // check return value so everything is ok
-            ret_val = filesystem.rm(arg1);
-            if (ret_val) {
-                std::cout << "Error: rm " << arg1;
-                std::cout << " failed, error code " << ret_val << std::endl;
-            }
-        }
-
-        else if (cmd == "append") {
-            if (cmd_line.size() != 3) {
-                std::cout << "Usage: append <filepath1> <filepath2>\n";
-                continue;
-            }
-            arg1 = cmd_line[1];
-            arg2 = cmd_line[2];
-            // check return value so everything is ok
-            ret_val = filesystem.append(arg1, arg2);
-            if (ret_val) {
-                std::cout << "Error: append " << arg1 << " " << arg2;
-                std::cout << " failed, error code " << ret_val << std::endl;
-            }
-        }
-
-        else if (cmd == "mkdir") {
-            if (cmd_line.size() != 2) {
-                std::cout << "Usage: mkdir <dirpath>\n";
-                continue;
-            }
-            arg1 = cmd_line[1];
-            // check return value so everything is ok
-            ret_val = filesystem.mkdir(arg1);
-            if (ret_val) {
-                std::cout << "Error: mkdir " << arg1;
-                std::cout << " failed, error code " << ret_val << std::endl;
-            }
-        }
-
-        else if (cmd == "cd") {
-            if (cmd_line.size() != 2) {
-                std::cout << "Usage: cd <dirpath>\n";
-                continue;
-            }
-            arg1 = cmd_line[1];
-            // check return value so everything is ok
-            ret_val = filesystem.cd(arg1);
-            if (ret_val) {
-                std::cout << "Error: cd " << arg1;
-                std::cout << " failed, error code " << ret_val << std::endl;
-            }
-        }
-
-        else if (cmd == "pwd") {
-            if (cmd_line.size() != 1) {
-                std::cout << "Usage: pwd\n";
-                continue;
-            }
-            // check return value so everything is ok
-            ret_val = filesystem.pwd();
-            if (ret_val) {
-                std::cout << "Error: pwd failed, error code " << ret_val << std::endl;
-            }
-        }
-
-        else if (cmd == "chmod") {
-            if (cmd_line.size() != 3) {
-                std::cout << "Usage: chmod <accessrights> <filepath>\n";
-                continue;
-            }
-            arg1 = cmd_line[1];
-            arg2 = cmd_line[2];
-            // check return value so everything is ok
-            ret_val = filesystem.chmod(arg1, arg2);
-            if (ret_val) {
-                std::cout << "Error: chmod " << arg1 << " " << arg2;
-                std::cout << " failed, error code " << ret_val << std::endl;
-            }
-        }
-
-        else if (cmd == "quit")
-            running = false;
-
-        else if (cmd == "help") {
-            std::cout << "Available commands:\n";
-            std::cout << "format, create, cat, ls, cp, mv, rm, append, mkdir, cd, pwd, chmod, help, quit\n";
-        }
-
-        else if (cmd == "") {
-            ; // do nothing
-        }
-
-        else {
-            std::cout << "Available commands:\n";
-            std::cout << "format, create, cat, ls, cp, mv, rm, append, mkdir, cd, pwd, chmod, help, quit\n";
-        }
-    }
 }
@@ -4,6 +4,10 @@
 #ifndef __SHELL_H__
 #define __SHELL_H__
 
+// The shell is interactive when stdin is a terminal. Otherwise, with
+// filesystem -f <script> or a pipe, it runs in batch mode: no prompts, and
+// the output is written in large pieces. The test programs define Shell
+// with test_script.h, so the two class definitions must stay the same.
 class Shell {
 private:
     FS filesystem;
@@ -0,0 +1,112 @@
+/******************************************************************************
+ *             File : test_script10.cpp
+ *
+ * Test program for compressed files: a repetitive file must take fewer
+ * blocks to read than its plain copy, and offset reads, append, cp and
+ * compress / uncompress must all give back the same data.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+// reads all of <path> through the handle API
+static std::string
+read_all(FS &filesystem, const char *path)
+{
+    std::string data;
+    char buf[1000];
+    int n, fd = filesystem.open(path, READ);
+    while ((n = filesystem.read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    filesystem.close(fd);
+    return data;
+}
+
+void
+Shell::run()
+{
+    std::string log;
+    for (int i = 0; i < 2000; ++i)
+        log += "request " + std::to_string(i) + " served in " + std::to_string(i % 97) + " ms\n";
+    unsigned long reads;
+    int fd;
+
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 10 ..." << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Writing the same " << log.size() << " bytes to plain and packed (compressed)..." << std::endl;
+    filesystem.format();
+    fd = filesystem.open("plain", WRITE | CREATE);
+    filesystem.write(fd, log.data(), log.size());
+    filesystem.close(fd);
+    fd = filesystem.open("packed", WRITE | CREATE | COMPRESS);
+    for (size_t i = 0; i < log.size(); i += 100)
+        filesystem.write(fd, log.data() + i, std::min<size_t>(100, log.size() - i));
+    filesystem.close(fd);
+    reads = filesystem.get_no_reads();
+    std::string plain = read_all(filesystem, "plain");
+    unsigned long plain_reads = filesystem.get_no_reads() - reads;
+    reads = filesystem.get_no_reads();
+    std::string packed = read_all(filesystem, "packed");
+    unsigned long packed_reads = filesystem.get_no_reads() - reads;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "name\t type\t accessrights\t size" << std::endl;
+    std::cout << "packed\t file\t rw-\t " << log.size() << std::endl;
+    std::cout << "plain\t file\t rw-\t " << log.size() << std::endl;
+    std::cout << "same content: yes" << std::endl;
+    std::cout << "fewer block reads: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.ls();
+    std::cout << "same content: " << (plain == log && packed == log ? "yes" : "no") << std::endl;
+    std::cout << "fewer block reads: " << (2 * packed_reads < plain_reads ? "yes" : "no") << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Reading 40 bytes at offset 50000 of packed..." << std::endl;
+    char part[41] = { 0 };
+    fd = filesystem.open("packed", READ);
+    filesystem.seek(fd, 50000);
+    filesystem.read(fd, part, 40);
+    filesystem.close(fd);
+    std::cout << "Expected output:" << std::endl;
+    std::cout << log.substr(50000, 40) << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << part << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Testing append(plain,packed), cp(packed,copy), uncompress packed, compress plain..." << std::endl;
+    filesystem.append("plain", "packed");
+    filesystem.cp("packed", "copy");
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "copy: same content: yes" << std::endl;
+    std::cout << "packed: same content: yes" << std::endl;
+    std::cout << "plain: same content: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "copy: same content: " << (read_all(filesystem, "copy") == log + log ? "yes" : "no") << std::endl;
+    filesystem.compress("packed", false);
+    filesystem.compress("plain", true);
+    std::cout << "packed: same content: " << (read_all(filesystem, "packed") == log + log ? "yes" : "no") << std::endl;
+    std::cout << "plain: same content: " << (read_all(filesystem, "plain") == log ? "yes" : "no") << std::endl;
+    PRINTDIV2;
+
+    std::cout << "... Task 10 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,139 @@
+/******************************************************************************
+ *             File : test_script11.cpp
+ *
+ * Test program for block checksums: a block changed behind the file
+ * system's back must make cat fail. Also measures cat and cp throughput
+ * with checksums on and off.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// size of the file used for the throughput runs, and the number of runs
+#define BENCH_SIZE (3 * 1024 * 1024)
+#define BENCH_RUNS 5
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+// flips one byte of the disk file where <text> is stored, returns the block
+// it is in, or -1 if it was not found
+static long
+corrupt(const std::string &text)
+{
+    int fd = open(DISKNAME, O_RDWR);
+    std::vector<char> disk(BLOCK_SIZE * 2048);
+    pread(fd, disk.data(), disk.size(), 0);
+    auto it = std::search(disk.begin(), disk.end(), text.begin(), text.end());
+    if (it == disk.end()) {
+        close(fd);
+        return -1;
+    }
+    off_t off = it - disk.begin();
+    char c = *it ^ 0x20;
+    pwrite(fd, &c, 1, off);
+    close(fd);
+    return off / BLOCK_SIZE;
+}
+
+// MB/s of <runs> calls of <op>, with standard output sent to /dev/null
+template <typename F>
+static double
+throughput(F op, int runs)
+{
+    std::cout.flush();
+    int saved = dup(1);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; ++i)
+        op();
+    auto stop = std::chrono::steady_clock::now();
+    dup2(saved, 1);
+    close(saved);
+    close(null);
+    double secs = std::chrono::duration<double>(stop - start).count();
+    return (double)BENCH_SIZE * runs / secs / (1024 * 1024);
+}
+
+void
+Shell::run()
+{
+    std::string text = "checksummed text\n";
+    int ret_val, fd;
+
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 11 ..." << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Writing f1, changing one byte of its block on the disk, then cat(f1)..." << std::endl;
+    filesystem.format();
+    fd = filesystem.open("f1", WRITE | CREATE);
+    filesystem.write(fd, text.data(), text.size());
+    filesystem.close(fd);
+    // written blocks reach the disk file with sync()
+    filesystem.sync();
+    long blk = corrupt(text);
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "Disk::read - ERROR: Checksum mismatch in block " << blk << std::endl;
+    std::cout << "Error: cat f1 failed, error code -1" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    ret_val = filesystem.cat("f1");
+    if (ret_val)
+        std::cout << "Error: cat f1 failed, error code " << ret_val << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Testing cat(f1) with checksums off..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "Checksummed text" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.set_checksums(false);
+    ret_val = filesystem.cat("f1");
+    if (ret_val)
+        std::cout << "Error: cat f1 failed, error code " << ret_val << std::endl;
+    filesystem.set_checksums(true);
+    PRINTDIV2;
+
+    std::cout << "Measuring cat and cp of " << BENCH_SIZE << " bytes..." << std::endl;
+    filesystem.format();
+    for (int on = 1; on >= 0; --on) {
+        filesystem.set_checksums(on);
+        fd = filesystem.open("big", WRITE | CREATE);
+        std::string block(BLOCK_SIZE, 'x');
+        for (int i = 0; i < BENCH_SIZE / BLOCK_SIZE; ++i)
+            filesystem.write(fd, block.data(), block.size());
+        filesystem.close(fd);
+        const char *mode = on ? "on" : "off";
+        double cat = throughput([&]() { filesystem.cat("big"); }, BENCH_RUNS);
+        double cp = throughput([&]() { filesystem.cp("big", "copy"); filesystem.rm("copy"); },
+                               BENCH_RUNS);
+        std::cout << "checksums " << mode << ": cat " << cat << " MB/s, cp " << cp << " MB/s" << std::endl;
+        filesystem.rm("big");
+    }
+    filesystem.set_checksums(true);
+    PRINTDIV2;
+
+    std::cout << "... Task 11 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,131 @@
+/******************************************************************************
+ *             File : test_script12.cpp
+ *
+ * Test program for block deduplication: files written with the same
+ * content share their blocks while copies get their own, a change to a
+ * shared file leaves the others alone, and removing a file frees only
+ * blocks nobody else uses.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// blocks in the test file
+#define NO_BLOCKS_A 8
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+// reads all of <path> through the handle API
+static std::string
+read_all(FS &filesystem, const char *path)
+{
+    std::string data;
+    char buf[BLOCK_SIZE];
+    int n, fd = filesystem.open(path, READ);
+    while ((n = filesystem.read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    filesystem.close(fd);
+    return data;
+}
+
+static void
+write_file(FS &filesystem, const char *path, const std::string &data)
+{
+    int fd = filesystem.open(path, WRITE | CREATE);
+    filesystem.write(fd, data.data(), data.size());
+    filesystem.close(fd);
+}
+
+static void
+print_counts(FS &filesystem)
+{
+    uint32_t logical, physical;
+    filesystem.dedup_counts(logical, physical);
+    std::cout << "file blocks: " << logical << " in files, " << physical << " on disk" << std::endl;
+}
+
+void
+Shell::run()
+{
+    std::string data;
+    for (int i = 0; i < NO_BLOCKS_A; ++i)
+        data += std::string(BLOCK_SIZE, 'a' + i);
+
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 12 ..." << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Writing a (" << NO_BLOCKS_A << " blocks), cp(a,b), writing c with the same content..." << std::endl;
+    filesystem.format();
+    write_file(filesystem, "a", data);
+    filesystem.cp("a", "b");
+    write_file(filesystem, "c", data);
+    std::cout << "Expected output:" << std::endl;
+    // c shares the blocks of a, b has blocks of its own
+    std::cout << "file blocks: " << 3 * NO_BLOCKS_A << " in files, " << 2 * NO_BLOCKS_A << " on disk" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    print_counts(filesystem);
+    PRINTDIV2;
+
+    std::cout << "Appending one byte to b..." << std::endl;
+    int fd = filesystem.open("b", WRITE);
+    filesystem.seek(fd, data.size());
+    filesystem.write(fd, "x", 1);
+    filesystem.close(fd);
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "file blocks: " << 3 * NO_BLOCKS_A + 1 << " in files, " << 2 * NO_BLOCKS_A + 1 << " on disk" << std::endl;
+    std::cout << "a: same content: yes" << std::endl;
+    std::cout << "b: same content: yes" << std::endl;
+    std::cout << "c: same content: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    print_counts(filesystem);
+    std::cout << "a: same content: " << (read_all(filesystem, "a") == data ? "yes" : "no") << std::endl;
+    std::cout << "b: same content: " << (read_all(filesystem, "b") == data + "x" ? "yes" : "no") << std::endl;
+    std::cout << "c: same content: " << (read_all(filesystem, "c") == data ? "yes" : "no") << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Testing rm(a), then rm(c)..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "file blocks: " << 2 * NO_BLOCKS_A + 1 << " in files, " << 2 * NO_BLOCKS_A + 1 << " on disk" << std::endl;
+    std::cout << "file blocks: " << NO_BLOCKS_A + 1 << " in files, " << NO_BLOCKS_A + 1 << " on disk" << std::endl;
+    std::cout << "b: same content: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.rm("a");
+    print_counts(filesystem);
+    filesystem.rm("c");
+    print_counts(filesystem);
+    std::cout << "b: same content: " << (read_all(filesystem, "b") == data + "x" ? "yes" : "no") << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Testing rm of a copy of b, and of b, while b is open..." << std::endl;
+    filesystem.cp("b", "d");
+    fd = filesystem.open("b", READ);
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "rm: b: File is open" << std::endl;
+    std::cout << "rm(d): 0, rm(b): -1" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    int rm_d = filesystem.rm("d");
+    int rm_b = filesystem.rm("b");
+    std::cout << "rm(d): " << rm_d << ", rm(b): " << rm_b << std::endl;
+    filesystem.close(fd);
+    PRINTDIV2;
+
+    std::cout << "... Task 12 done" << std::endl;
+    PRINTDIV;
+}
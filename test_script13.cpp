@@ -0,0 +1,154 @@
+/******************************************************************************
+ *             File : test_script13.cpp
+ *
+ * Test program for sparse files: data written past the end of a file leaves
+ * a hole that takes no blocks and reads as zeros without any block reads,
+ * writing into the hole allocates just the blocks written, and blocks of
+ * zeros are not stored.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// logical size of the sparse file in blocks, far more than the disk holds
+#define SPARSE_BLOCKS 100000
+// block of the sparse file written in the middle
+#define MIDDLE_BLOCK 5000
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+// reads <n> bytes of <path> at offset <pos>
+static std::string
+read_at(FS &filesystem, const char *path, uint32_t pos, uint32_t n)
+{
+    std::string data(n, '?');
+    int fd = filesystem.open(path, READ);
+    filesystem.seek(fd, pos);
+    int len = filesystem.read(fd, &data[0], n);
+    filesystem.close(fd);
+    data.resize(len < 0 ? 0 : len);
+    return data;
+}
+
+static void
+write_at(FS &filesystem, const char *path, uint32_t pos, const std::string &data)
+{
+    int fd = filesystem.open(path, WRITE);
+    filesystem.seek(fd, pos);
+    filesystem.write(fd, data.data(), data.size());
+    filesystem.close(fd);
+}
+
+static uint32_t
+blocks_on_disk(FS &filesystem)
+{
+    uint32_t logical, physical;
+    filesystem.dedup_counts(logical, physical);
+    return physical;
+}
+
+static const char *
+yes_no(bool b)
+{
+    return b ? "yes" : "no";
+}
+
+void
+Shell::run()
+{
+    const uint32_t end = (uint32_t)SPARSE_BLOCKS * BLOCK_SIZE;
+    const uint32_t middle = (uint32_t)MIDDLE_BLOCK * BLOCK_SIZE + 100;
+
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 13 ..." << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Writing \"head\" at 0 and \"tail\" at " << end << "..." << std::endl;
+    filesystem.format();
+    int fd = filesystem.open("s", WRITE | CREATE);
+    filesystem.write(fd, "head", 4);
+    filesystem.close(fd);
+    write_at(filesystem, "s", end, "tail");
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "blocks on disk: 2" << std::endl;
+    std::cout << "head: yes, tail: yes, end of file: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "blocks on disk: " << blocks_on_disk(filesystem) << std::endl;
+    std::cout << "head: " << yes_no(read_at(filesystem, "s", 0, 4) == "head")
+              << ", tail: " << yes_no(read_at(filesystem, "s", end, 8) == "tail")
+              << ", end of file: " << yes_no(read_at(filesystem, "s", end + 4, 8).empty()) << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Reading 64 blocks from the hole..." << std::endl;
+    std::string hole(64 * BLOCK_SIZE, '?');
+    fd = filesystem.open("s", READ);
+    filesystem.seek(fd, BLOCK_SIZE);
+    unsigned long reads = filesystem.get_no_reads();
+    filesystem.read(fd, &hole[0], hole.size());
+    reads = filesystem.get_no_reads() - reads;
+    filesystem.close(fd);
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "zeros: yes, block reads: 0" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "zeros: " << yes_no(hole == std::string(64 * BLOCK_SIZE, '\0'))
+              << ", block reads: " << reads << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Writing \"middle\" at " << middle << "..." << std::endl;
+    write_at(filesystem, "s", middle, "middle");
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "blocks on disk: 3" << std::endl;
+    std::cout << "middle: yes, zeros around it: yes, tail: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "blocks on disk: " << blocks_on_disk(filesystem) << std::endl;
+    std::string around = read_at(filesystem, "s", middle - BLOCK_SIZE, 2 * BLOCK_SIZE + 6);
+    std::cout << "middle: " << yes_no(around.substr(BLOCK_SIZE, 6) == "middle")
+              << ", zeros around it: "
+              << yes_no(around.substr(0, BLOCK_SIZE) == std::string(BLOCK_SIZE, '\0') &&
+                        around.substr(BLOCK_SIZE + 6) == std::string(BLOCK_SIZE, '\0'))
+              << ", tail: " << yes_no(read_at(filesystem, "s", end, 4) == "tail") << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Writing z: one byte, then 32 blocks of zeros, then one byte..." << std::endl;
+    std::string zeros(32 * BLOCK_SIZE, '\0');
+    fd = filesystem.open("z", WRITE | CREATE);
+    filesystem.write(fd, "x", 1);
+    filesystem.write(fd, zeros.data(), zeros.size());
+    filesystem.write(fd, "y", 1);
+    filesystem.close(fd);
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "blocks on disk: 5" << std::endl;
+    std::cout << "same content: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "blocks on disk: " << blocks_on_disk(filesystem) << std::endl;
+    std::cout << "same content: "
+              << yes_no(read_at(filesystem, "z", 0, zeros.size() + 2) == "x" + zeros + "y") << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Testing rm(s)..." << std::endl;
+    filesystem.rm("s");
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "blocks on disk: 2" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "blocks on disk: " << blocks_on_disk(filesystem) << std::endl;
+    PRINTDIV2;
+
+    std::cout << "... Task 13 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,112 @@
+/******************************************************************************
+ *             File : test_script14.cpp
+ *
+ * Test program for partial reads: head, tail and read print a byte range of
+ * a file and read only the blocks holding it.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// blocks in the test file
+#define NO_BLOCKS_LOG 64
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+// the test file: every block filled with its own letter, ending in "END"
+static std::string
+log_data()
+{
+    std::string data;
+    for (int i = 0; i < NO_BLOCKS_LOG; ++i)
+        data += std::string(BLOCK_SIZE, 'a' + i % 26);
+    data.replace(data.size() - 3, 3, "END");
+    return data;
+}
+
+// prints the block reads done since <reads> was taken
+static void
+print_reads(FS &filesystem, unsigned long reads)
+{
+    std::cout << std::endl << "block reads: " << filesystem.get_no_reads() - reads << std::endl;
+}
+
+void
+Shell::run()
+{
+    std::string data = log_data();
+    unsigned long reads;
+
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 14 ..." << std::endl;
+    PRINTDIV2;
+
+    filesystem.format();
+    int fd = filesystem.open("log", WRITE | CREATE);
+    filesystem.write(fd, data.data(), data.size());
+    filesystem.close(fd);
+
+    std::cout << "Testing tail -c 8 log (" << NO_BLOCKS_LOG << " blocks)..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << data.substr(data.size() - 8) << std::endl;
+    // the directory block and the last block
+    std::cout << "block reads: 2" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    reads = filesystem.get_no_reads();
+    filesystem.tail("log", 8);
+    print_reads(filesystem, reads);
+    PRINTDIV2;
+
+    std::cout << "Testing head -c 6 log..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << data.substr(0, 6) << std::endl;
+    std::cout << "block reads: 2" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    reads = filesystem.get_no_reads();
+    filesystem.head("log", 6);
+    print_reads(filesystem, reads);
+    PRINTDIV2;
+
+    uint32_t offset = 30 * BLOCK_SIZE - 4;
+    std::cout << "Testing read log " << offset << " 8, across a block boundary..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << data.substr(offset, 8) << std::endl;
+    std::cout << "block reads: 3" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    reads = filesystem.get_no_reads();
+    filesystem.read_range("log", offset, 8);
+    print_reads(filesystem, reads);
+    PRINTDIV2;
+
+    std::cout << "Testing read past the end, and tail -c 5 of a compressed copy..." << std::endl;
+    filesystem.cp("log", "clog");
+    filesystem.compress("clog", true);
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "ND" << std::endl;
+    std::cout << data.substr(data.size() - 5) << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.read_range("log", data.size() - 2, 100);
+    std::cout << std::endl;
+    filesystem.tail("clog", 5);
+    std::cout << std::endl;
+    PRINTDIV2;
+
+    std::cout << "... Task 14 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,139 @@
+/******************************************************************************
+ *             File : test_script15.cpp
+ *
+ * Test program for in-place writes and truncate: a small write into a large
+ * file costs the blocks written only, truncate frees the blocks past the new
+ * end and extending a file takes no blocks.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// blocks in the test file
+#define NO_BLOCKS_BIG 64
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+// reads all of <path> through the handle API
+static std::string
+read_all(FS &filesystem, const char *path)
+{
+    std::string data;
+    char buf[BLOCK_SIZE];
+    int n, fd = filesystem.open(path, READ);
+    while ((n = filesystem.read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    filesystem.close(fd);
+    return data;
+}
+
+static uint32_t
+blocks_on_disk(FS &filesystem)
+{
+    uint32_t logical, physical;
+    filesystem.dedup_counts(logical, physical);
+    return physical;
+}
+
+static const char *
+yes_no(bool b)
+{
+    return b ? "yes" : "no";
+}
+
+void
+Shell::run()
+{
+    std::string data;
+    for (int i = 0; i < NO_BLOCKS_BIG; ++i)
+        data += std::string(BLOCK_SIZE, 'a' + i % 26);
+
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 15 ..." << std::endl;
+    PRINTDIV2;
+
+    filesystem.format();
+    int fd = filesystem.open("big", WRITE | CREATE);
+    filesystem.write(fd, data.data(), data.size());
+    filesystem.close(fd);
+    filesystem.sync();
+
+    uint32_t offset = 40 * BLOCK_SIZE + 10;
+    std::cout << "Writing 5 bytes at " << offset << " of big (" << NO_BLOCKS_BIG << " blocks)..." << std::endl;
+    unsigned long reads = filesystem.get_no_reads(), writes = filesystem.get_no_writes();
+    fd = filesystem.open("big", WRITE);
+    filesystem.seek(fd, offset);
+    filesystem.write(fd, "HELLO", 5);
+    filesystem.close(fd);
+    filesystem.sync();
+    reads = filesystem.get_no_reads() - reads;
+    writes = filesystem.get_no_writes() - writes;
+    data.replace(offset, 5, "HELLO");
+    std::cout << "Expected output:" << std::endl;
+    // the directory block is read; the block written and the block of the
+    // checksum table holding its checksum are written
+    std::cout << "block reads: 2, block writes: 2" << std::endl;
+    std::cout << "same content: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "block reads: " << reads << ", block writes: " << writes << std::endl;
+    std::cout << "same content: " << yes_no(read_all(filesystem, "big") == data) << std::endl;
+    PRINTDIV2;
+
+    uint32_t size = 10 * BLOCK_SIZE + 100;
+    std::cout << "Testing truncate(big, " << size << ")..." << std::endl;
+    filesystem.truncate("big", size);
+    data.resize(size);
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "blocks on disk: 11" << std::endl;
+    std::cout << "same content: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "blocks on disk: " << blocks_on_disk(filesystem) << std::endl;
+    std::cout << "same content: " << yes_no(read_all(filesystem, "big") == data) << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Testing truncate(big, " << 2 * size << "), the old data must not come back..." << std::endl;
+    filesystem.truncate("big", 2 * size);
+    data.resize(2 * size, '\0');
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "blocks on disk: 11" << std::endl;
+    std::cout << "same content: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "blocks on disk: " << blocks_on_disk(filesystem) << std::endl;
+    std::cout << "same content: " << yes_no(read_all(filesystem, "big") == data) << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Testing cp(big, copy), truncate(copy, 100), then a compressed copy cut to 5000 bytes..." << std::endl;
+    filesystem.cp("big", "copy");
+    filesystem.truncate("copy", 100);
+    filesystem.cp("big", "packed");
+    filesystem.compress("packed", true);
+    filesystem.truncate("packed", 5000);
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "big: same content: yes" << std::endl;
+    std::cout << "copy: same content: yes" << std::endl;
+    std::cout << "packed: same content: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "big: same content: " << yes_no(read_all(filesystem, "big") == data) << std::endl;
+    std::cout << "copy: same content: " << yes_no(read_all(filesystem, "copy") == data.substr(0, 100)) << std::endl;
+    std::cout << "packed: same content: " << yes_no(read_all(filesystem, "packed") == data.substr(0, 5000)) << std::endl;
+    PRINTDIV2;
+
+    std::cout << "... Task 15 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,334 @@
+/******************************************************************************
+ *             File : test_script16.cpp
+ *
+ * Test program for concurrent use: several threads run mixed operations on
+ * their own directories and a shared one at the same time. Every thread
+ * checks its files against what it wrote, and check() must find the file
+ * system consistent, also after it is read back from the disk. A reader
+ * keeps a file open while another thread cuts it and writes it again.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include <map>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+#define NO_THREADS 8
+#define NO_STEPS 300
+// file names used by each thread
+#define NO_NAMES 4
+// times the file a reader keeps open is cut and written again
+#define NO_CUTS 200
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+// a file as the thread wrote it
+struct model_file {
+    std::string data;
+    bool compressed;
+};
+
+// reads all of <path> through the handle API
+static std::string
+read_all(FS &filesystem, const std::string &path)
+{
+    std::string data;
+    char buf[BLOCK_SIZE];
+    int n, fd = filesystem.open(path, READ);
+    if (fd < 0)
+        return "<no such file>";
+    while ((n = filesystem.read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    filesystem.close(fd);
+    return data;
+}
+
+static int
+write_file(FS &filesystem, const std::string &path, const std::string &data, int mode)
+{
+    int fd = filesystem.open(path, mode);
+    if (fd < 0)
+        return -1;
+    int ret = filesystem.write(fd, data.data(), data.size()) < 0 ? -1 : 0;
+    if (filesystem.close(fd))
+        ret = -1;
+    return ret;
+}
+
+// data of up to three blocks; some of it repeats so that blocks are shared
+static std::string
+make_data(std::mt19937 &rng)
+{
+    std::string data(rng() % (3 * BLOCK_SIZE), ' ');
+    bool repeat = rng() % 2;
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = repeat ? 'a' + (i / BLOCK_SIZE) % 3 : 'a' + rng() % 26;
+    return data;
+}
+
+// the operations of thread <t> in directory /t<t>; counts the files that
+// did not read back as written in <mismatches>
+static void
+run_thread(FS &filesystem, int t, std::map<std::string, model_file> &model,
+           const std::string &common, std::atomic<int> &mismatches)
+{
+    std::mt19937 rng(t + 1);
+    std::string dir = "/t" + std::to_string(t) + "/";
+    for (int step = 0; step < NO_STEPS; ++step) {
+        std::string name = "f" + std::to_string(rng() % NO_NAMES);
+        std::string other = "f" + std::to_string(rng() % NO_NAMES);
+        bool exists = model.count(name), other_exists = model.count(other);
+        switch (rng() % 9) {
+        case 0:
+            if (!exists) {
+                model_file f = { make_data(rng), rng() % 4 == 0 };
+                if (write_file(filesystem, dir + name, f.data,
+                               WRITE | CREATE | (f.compressed ? COMPRESS : 0)) == 0)
+                    model[name] = f;
+            }
+            break;
+        case 1:
+            if (exists && read_all(filesystem, dir + name) != model[name].data)
+                ++mismatches;
+            break;
+        case 2:
+            if (exists && !other_exists && filesystem.cp(dir + name, dir + other) == 0)
+                model[other] = model[name];
+            break;
+        case 3:
+            if (exists && other_exists && name != other &&
+                filesystem.append(dir + name, dir + other) == 0)
+                model[other].data += model[name].data;
+            break;
+        case 4:
+            if (exists && !model[name].compressed && !model[name].data.empty()) {
+                std::string data = make_data(rng).substr(0, 2000);
+                uint32_t pos = rng() % model[name].data.size();
+                int fd = filesystem.open(dir + name, WRITE);
+                filesystem.seek(fd, pos);
+                if (filesystem.write(fd, data.data(), data.size()) >= 0) {
+                    std::string &m = model[name].data;
+                    if (pos + data.size() > m.size())
+                        m.resize(pos + data.size());
+                    m.replace(pos, data.size(), data);
+                }
+                filesystem.close(fd);
+            }
+            break;
+        case 5:
+            if (exists) {
+                uint32_t size = rng() % (model[name].data.size() + BLOCK_SIZE);
+                if (filesystem.truncate(dir + name, size) == 0)
+                    model[name].data.resize(size, '\0');
+            }
+            break;
+        case 6:
+            if (exists && filesystem.rm(dir + name) == 0)
+                model.erase(name);
+            break;
+        case 7:
+            // files come and go in the shared directory and are moved
+            // through it, while every thread reads the common file
+            if (read_all(filesystem, "/shared/common") != common)
+                ++mismatches;
+            if (exists) {
+                std::string moved = "/shared/m" + std::to_string(t);
+                if (filesystem.mv(dir + name, moved) == 0 &&
+                    filesystem.mv(moved, dir + name) != 0)
+                    model.erase(name);
+            }
+            break;
+        case 8:
+            {
+                std::string sub = dir + "d";
+                filesystem.mkdir(sub);
+                write_file(filesystem, sub + "/x", make_data(rng), WRITE | CREATE);
+                if (exists)
+                    filesystem.cp(dir + name, sub + "/y");
+                filesystem.rm_recursive(sub);
+            }
+            break;
+        }
+    }
+    for (auto &kv : model) {
+        if (read_all(filesystem, dir + kv.first) != kv.second.data)
+            ++mismatches;
+    }
+}
+
+// opens <path> and sets <turn> to 0, then reads it at a random offset
+// through that handle each time <turn> is odd, and makes it even again;
+// stops at NO_CUTS * 2. Every byte must be the
+// byte of <data> at its offset, or a zero left by a cut. Counts the reads
+// that return anything else in <bad>
+static void
+read_while_cut(FS &filesystem, const std::string &path, const std::string &data,
+               std::atomic<int> &turn, std::atomic<int> &bad)
+{
+    std::mt19937 rng(99);
+    char buf[3 * BLOCK_SIZE];
+    int fd = filesystem.open(path, READ);
+    turn = 0;
+    for (int t = 1; t < NO_CUTS * 2; t += 2) {
+        while (turn != t)
+            std::this_thread::yield();
+        uint32_t pos = rng() % data.size();
+        filesystem.seek(fd, pos);
+        int n = filesystem.read(fd, buf, 1 + rng() % sizeof(buf));
+        if (n < 0 || pos + n > data.size())
+            ++bad;
+        for (int i = 0; i < n; ++i) {
+            if (buf[i] != data[pos + i] && buf[i] != '\0') {
+                ++bad;
+                break;
+            }
+        }
+        turn = t + 1;
+    }
+    filesystem.close(fd);
+}
+
+// MB/s of <threads> threads reading the common file <rounds> times each
+static double
+read_rate(FS &filesystem, int threads, int rounds, size_t size)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(std::thread([&filesystem, rounds]() {
+            for (int r = 0; r < rounds; ++r)
+                read_all(filesystem, "/shared/common");
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    return (double)size * threads * rounds / secs.count() / (1024 * 1024);
+}
+
+void
+Shell::run()
+{
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 16 ..." << std::endl;
+    PRINTDIV2;
+
+    filesystem.format();
+    filesystem.mkdir("/shared");
+    for (int t = 0; t < NO_THREADS; ++t)
+        filesystem.mkdir("/t" + std::to_string(t));
+    std::string common;
+    for (int i = 0; i < 64 * BLOCK_SIZE; ++i)
+        common += 'a' + i % 26;
+    write_file(filesystem, "/shared/common", common, WRITE | CREATE);
+
+    std::cout << "Running " << NO_STEPS << " mixed operations in each of " << NO_THREADS << " threads..." << std::endl;
+    std::map<std::string, model_file> models[NO_THREADS];
+    std::atomic<int> mismatches(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NO_THREADS; ++t)
+        threads.push_back(std::thread(run_thread, std::ref(filesystem), t, std::ref(models[t]),
+                                      std::cref(common), std::ref(mismatches)));
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+    unsigned files = 1;
+    for (int t = 0; t < NO_THREADS; ++t)
+        files += models[t].size();
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "mismatches: 0" << std::endl;
+    std::cout << "check: " << NO_THREADS + 2 << " directories, " << files << " files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "mismatches: " << mismatches << std::endl;
+    filesystem.check();
+    PRINTDIV2;
+
+    std::cout << "Testing check() on the file system read back from the disk..." << std::endl;
+    filesystem.sync();
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "check: " << NO_THREADS + 2 << " directories, " << files << " files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    {
+        FS again;
+        again.check();
+    }
+    PRINTDIV2;
+
+    std::cout << "Opening the common file for writing twice..." << std::endl;
+    int w1 = filesystem.open("/shared/common", WRITE);
+    int r1 = filesystem.open("/shared/common", READ);
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "open: /shared/common: File is open" << std::endl;
+    std::cout << "second writer: -1, reader: yes, after close: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    int w2 = filesystem.open("/shared/common", WRITE);
+    filesystem.close(w1);
+    int w3 = filesystem.open("/shared/common", WRITE);
+    std::cout << "second writer: " << w2 << ", reader: " << (r1 >= 0 ? "yes" : "no")
+              << ", after close: " << (w3 >= 0 ? "yes" : "no") << std::endl;
+    filesystem.close(w3);
+    filesystem.close(r1);
+    PRINTDIV2;
+
+    std::cout << "Reading the common file from 1 and " << NO_THREADS << " threads..." << std::endl;
+    std::cout << "1 thread: " << read_rate(filesystem, 1, 64, common.size()) << " MB/s" << std::endl;
+    std::cout << NO_THREADS << " threads: " << read_rate(filesystem, NO_THREADS, 64, common.size()) << " MB/s" << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Cutting a file " << NO_CUTS << " times while another thread reads it..." << std::endl;
+    filesystem.format();
+    filesystem.mkdir("/shared");
+    std::string big;
+    for (int i = 0; i < 8 * BLOCK_SIZE; ++i)
+        big += 'a' + i / 7 % 26;
+    write_file(filesystem, "/shared/big", big, WRITE | CREATE);
+    std::atomic<int> turn(-1), bad(0);
+    std::thread reader(read_while_cut, std::ref(filesystem), "/shared/big", std::cref(big),
+                       std::ref(turn), std::ref(bad));
+    std::mt19937 rng(16);
+    int failed = 0;
+    // the blocks cut off are taken by another file before the reader reads,
+    // so a reader still following them sees other data
+    std::string fill(8 * BLOCK_SIZE, '#');
+    for (int t = 0; t < NO_CUTS * 2; t += 2) {
+        while (turn != t)
+            std::this_thread::yield();
+        if (filesystem.truncate("/shared/big", rng() % big.size()) ||
+            write_file(filesystem, "/shared/fill", fill, WRITE | CREATE))
+            ++failed;
+        turn = t + 1;
+        while (turn != t + 2)
+            std::this_thread::yield();
+        if (filesystem.rm("/shared/fill") || write_file(filesystem, "/shared/big", big, WRITE))
+            ++failed;
+    }
+    reader.join();
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "failed: 0, bad reads: 0" << std::endl;
+    std::cout << "check: 2 directories, 1 files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "failed: " << failed << ", bad reads: " << bad << std::endl;
+    filesystem.check();
+    PRINTDIV2;
+
+    std::cout << "... Task 16 done" << std::endl;
+    PRINTDIV;
+}
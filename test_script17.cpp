@@ -0,0 +1,237 @@
+/******************************************************************************
+ *             File : test_script17.cpp
+ *
+ * Test program for the server: more clients than worker threads connect to
+ * the Unix socket at the same time, each working in its own current
+ * directory, and get the same output as the shell would print. Clients
+ * that stay connected, more of them than workers, are all served in turn,
+ * also while more clients than workers stall in the middle of the data
+ * rows of a create, and import, export and trace are refused to them.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "test_script.h"
+#include "server.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+#define SOCKET_PATH "test17.sock"
+#define NO_CLIENTS 6
+#define NO_WORKERS 3
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+// reads from <fd> until the prompt or the end of the connection
+static void
+read_reply(int fd, std::string &transcript)
+{
+    char buf[BLOCK_SIZE];
+    std::string prompt = "filesystem> ";
+    for (;;) {
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n <= 0)
+            return;
+        transcript.append(buf, n);
+        if (transcript.size() >= prompt.size() &&
+            transcript.compare(transcript.size() - prompt.size(), prompt.size(), prompt) == 0)
+            return;
+    }
+}
+
+// connects to the server, returns the socket or -1
+static int
+connect_client()
+{
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, SOCKET_PATH);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// sends <command> and collects what the server printed up to the prompt
+static void
+send_command(int fd, const std::string &command, std::string &transcript)
+{
+    if (::write(fd, command.data(), command.size()) == (ssize_t)command.size())
+        read_reply(fd, transcript);
+}
+
+// sends <commands> one at a time and collects everything the server printed
+static std::string
+run_client(const std::vector<std::string> &commands)
+{
+    std::string transcript;
+    int fd = connect_client();
+    if (fd < 0)
+        return "<cannot connect>";
+    read_reply(fd, transcript);
+    for (size_t i = 0; i < commands.size(); ++i)
+        send_command(fd, commands[i], transcript);
+    ::close(fd);
+    return transcript;
+}
+
+void
+Shell::run()
+{
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 17 ..." << std::endl;
+    PRINTDIV2;
+
+    filesystem.format();
+    Server server(filesystem, SOCKET_PATH, NO_WORKERS);
+    if (server.start())
+        return;
+    std::thread acceptor(&Server::run, &server);
+
+    std::cout << NO_CLIENTS << " clients, " << NO_WORKERS << " worker threads; each client runs:" << std::endl;
+    std::cout << "mkdir c<i>, cd c<i>, create f, pwd, cat f, cat missing, quit" << std::endl;
+    std::vector<std::string> transcripts(NO_CLIENTS);
+    std::vector<std::thread> clients;
+    for (int i = 0; i < NO_CLIENTS; ++i) {
+        clients.push_back(std::thread([i, &transcripts]() {
+            std::string dir = "c" + std::to_string(i);
+            std::vector<std::string> commands;
+            commands.push_back("mkdir " + dir + "\n");
+            commands.push_back("cd " + dir + "\n");
+            commands.push_back("create f\nclient " + std::to_string(i) + "\n\n");
+            commands.push_back("pwd\n");
+            commands.push_back("cat f\n");
+            commands.push_back("cat missing\n");
+            commands.push_back("quit\n");
+            transcripts[i] = run_client(commands);
+        }));
+    }
+    for (size_t i = 0; i < clients.size(); ++i)
+        clients[i].join();
+
+    // every one of them holds its connection until all have been served;
+    // a worker kept by each connection would leave the last ones waiting
+    std::vector<int> held(NO_WORKERS + 2);
+    std::vector<std::string> held_transcripts(held.size());
+    for (size_t i = 0; i < held.size(); ++i) {
+        held[i] = connect_client();
+        read_reply(held[i], held_transcripts[i]);
+    }
+    for (size_t i = held.size(); i-- > 0;)
+        send_command(held[i], "cd c" + std::to_string(i) + "\n", held_transcripts[i]);
+    for (size_t i = 0; i < held.size(); ++i)
+        send_command(held[i], "pwd\n", held_transcripts[i]);
+    std::string refused;
+    send_command(held[0], "import " SOCKET_PATH " x\n", refused);
+    send_command(held[0], "export c0/f " SOCKET_PATH ".out\n", refused);
+    send_command(held[0], "trace start\n", refused);
+    for (size_t i = 0; i < held.size(); ++i)
+        ::close(held[i]);
+
+    // a create is not run before its data rows have all arrived
+    std::vector<int> stalled(NO_WORKERS + 1);
+    std::vector<std::string> stalled_transcripts(stalled.size());
+    for (size_t i = 0; i < stalled.size(); ++i) {
+        stalled[i] = connect_client();
+        read_reply(stalled[i], stalled_transcripts[i]);
+        std::string part = "create s" + std::to_string(i) + "\nrow ";
+        if (::write(stalled[i], part.data(), part.size()) != (ssize_t)part.size())
+            stalled_transcripts[i] += "<cannot write>";
+    }
+    std::vector<std::string> commands;
+    commands.push_back("pwd\n");
+    commands.push_back("quit\n");
+    std::string unstalled = run_client(commands);
+    for (size_t i = 0; i < stalled.size(); ++i) {
+        send_command(stalled[i], "of s" + std::to_string(i) + "\n\n", stalled_transcripts[i]);
+        send_command(stalled[i], "cat s" + std::to_string(i) + "\n", stalled_transcripts[i]);
+        ::close(stalled[i]);
+    }
+    server.stop();
+    acceptor.join();
+
+    for (int i = 0; i < NO_CLIENTS; ++i) {
+        PRINTDIV2;
+        std::string n = std::to_string(i);
+        std::cout << "Client " << i << ":" << std::endl;
+        std::cout << "Expected output:" << std::endl;
+        std::cout << "filesystem> filesystem> filesystem> Enter data. Empty line to end." << std::endl;
+        std::cout << "filesystem> /c" << n << std::endl;
+        std::cout << "filesystem> client " << n << std::endl;
+        std::cout << "filesystem> cat: missing: No such file" << std::endl;
+        std::cout << "Error: cat missing failed, error code -1" << std::endl;
+        std::cout << "filesystem> " << std::endl;
+        std::cout << "Actual output:" << std::endl;
+        std::cout << transcripts[i] << std::endl;
+    }
+    PRINTDIV2;
+
+    std::cout << held.size() << " clients connected at once, each running cd c<i> and pwd..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    for (size_t i = 0; i < held.size(); ++i)
+        std::cout << "filesystem> filesystem> /c" << i << std::endl << "filesystem> " << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    for (size_t i = 0; i < held.size(); ++i)
+        std::cout << held_transcripts[i] << std::endl;
+    PRINTDIV2;
+
+    std::cout << stalled.size() << " clients stalled in create s<i>, and a client running pwd..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "filesystem> /" << std::endl << "filesystem> " << std::endl;
+    for (size_t i = 0; i < stalled.size(); ++i) {
+        std::cout << "filesystem> Enter data. Empty line to end." << std::endl;
+        std::cout << "filesystem> row of s" << i << std::endl << "filesystem> " << std::endl;
+    }
+    std::cout << "Actual output:" << std::endl;
+    std::cout << unstalled << std::endl;
+    for (size_t i = 0; i < stalled.size(); ++i)
+        std::cout << stalled_transcripts[i] << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Testing import, export and trace start from a client..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "import: Host files are not available to this session" << std::endl;
+    std::cout << "Error: import failed, error code -1" << std::endl;
+    std::cout << "filesystem> export: Host files are not available to this session" << std::endl;
+    std::cout << "Error: export failed, error code -1" << std::endl;
+    std::cout << "filesystem> trace: Host files are not available to this session" << std::endl;
+    std::cout << "Error: trace failed, error code -1" << std::endl;
+    std::cout << "filesystem> " << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << refused << std::endl;
+    PRINTDIV2;
+
+    std::cout << "The console keeps its own current directory..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "/" << std::endl;
+    std::cout << "check: " << NO_CLIENTS + 1 << " directories, " << NO_CLIENTS + stalled.size()
+              << " files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.pwd();
+    filesystem.check();
+    PRINTDIV2;
+
+    std::cout << "... Task 17 done" << std::endl;
+    PRINTDIV;
+}
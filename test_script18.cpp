@@ -0,0 +1,167 @@
+/******************************************************************************
+ *             File : test_script18.cpp
+ *
+ * Test program for the background flusher: written blocks stay in memory
+ * until sync() or until they have waited DIRTY_AGE_MS, are read back from
+ * memory meanwhile, and adjacent blocks reach the disk file together. The
+ * FAT of a file written through a handle reaches the disk file without
+ * sync() as well.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <fcntl.h>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// blocks in the large file
+#define NO_BLOCKS_BIG 64
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+// true if <text> is stored in the disk file
+static bool
+on_disk(const std::string &text)
+{
+    int fd = open(DISKNAME, O_RDONLY);
+    std::vector<char> disk(BLOCK_SIZE * 2048);
+    pread(fd, disk.data(), disk.size(), 0);
+    close(fd);
+    return std::search(disk.begin(), disk.end(), text.begin(), text.end()) != disk.end();
+}
+
+// number of blocks in use in the FAT stored in the disk file
+static int
+fat_used_on_disk()
+{
+    int16_t fat[BLOCK_SIZE / 2];
+    int fd = open(DISKNAME, O_RDONLY);
+    pread(fd, fat, BLOCK_SIZE, (off_t)FAT_BLOCK * BLOCK_SIZE);
+    close(fd);
+    return std::count_if(fat, fat + BLOCK_SIZE / 2, [](int16_t e) { return e != FAT_FREE; });
+}
+
+static int
+write_file(FS &filesystem, const char *path, const std::string &data)
+{
+    int fd = filesystem.open(path, WRITE | CREATE);
+    int ret = filesystem.write(fd, data.data(), data.size()) < 0 ? -1 : 0;
+    if (filesystem.close(fd))
+        ret = -1;
+    return ret;
+}
+
+static std::string
+read_all(FS &filesystem, const char *path)
+{
+    std::string data;
+    char buf[BLOCK_SIZE];
+    int n, fd = filesystem.open(path, READ);
+    while ((n = filesystem.read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    filesystem.close(fd);
+    return data;
+}
+
+static const char *
+yes_no(bool b)
+{
+    return b ? "yes" : "no";
+}
+
+void
+Shell::run()
+{
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 18 ..." << std::endl;
+    PRINTDIV2;
+
+    filesystem.format();
+    filesystem.sync();
+    std::string text = "not flushed yet\n";
+    std::cout << "Writing f1, reading it back, then sync()..." << std::endl;
+    write_file(filesystem, "f1", text);
+    bool before = on_disk(text);
+    bool same = read_all(filesystem, "f1") == text;
+    filesystem.sync();
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "on the disk file before sync: no" << std::endl;
+    std::cout << "read back before sync: yes" << std::endl;
+    std::cout << "on the disk file after sync: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "on the disk file before sync: " << yes_no(before) << std::endl;
+    std::cout << "read back before sync: " << yes_no(same) << std::endl;
+    std::cout << "on the disk file after sync: " << yes_no(on_disk(text)) << std::endl;
+    PRINTDIV2;
+
+    text = "flushed by age\n";
+    std::cout << "Writing f2 and waiting " << 3 * DIRTY_AGE_MS << " ms without sync()..." << std::endl;
+    write_file(filesystem, "f2", text);
+    std::this_thread::sleep_for(std::chrono::milliseconds(3 * DIRTY_AGE_MS));
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "on the disk file: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "on the disk file: " << yes_no(on_disk(text)) << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Writing f3 of 3 blocks and waiting " << 3 * DIRTY_AGE_MS << " ms without sync()..." << std::endl;
+    filesystem.sync();
+    int used = fat_used_on_disk();
+    text.clear();
+    for (int i = 0; i < 3; ++i)
+        text += std::string(BLOCK_SIZE, 'x' + i);
+    write_file(filesystem, "f3", text);
+    std::this_thread::sleep_for(std::chrono::milliseconds(3 * DIRTY_AGE_MS));
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "new blocks in the FAT on the disk file: 3" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "new blocks in the FAT on the disk file: " << fat_used_on_disk() - used << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Writing a file of " << NO_BLOCKS_BIG << " blocks, then sync()..." << std::endl;
+    std::string data;
+    for (int i = 0; i < NO_BLOCKS_BIG; ++i)
+        data += std::string(BLOCK_SIZE, 'a' + i % 26);
+    unsigned long writes = filesystem.get_no_writes();
+    unsigned long device_writes = filesystem.get_no_device_writes();
+    auto start = std::chrono::steady_clock::now();
+    write_file(filesystem, "big", data);
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    filesystem.sync();
+    writes = filesystem.get_no_writes() - writes;
+    device_writes = filesystem.get_no_device_writes() - device_writes;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "block writes: at least " << NO_BLOCKS_BIG << ": yes" << std::endl;
+    // the data blocks are adjacent; the directory, the FAT and the checksum
+    // table are written apart from them, in at most a few flushes
+    std::cout << "device writes: at most 16: yes" << std::endl;
+    std::cout << "same content: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "block writes: at least " << NO_BLOCKS_BIG << ": " << yes_no(writes >= NO_BLOCKS_BIG) << std::endl;
+    std::cout << "device writes: at most 16: " << yes_no(device_writes <= 16) << std::endl;
+    std::cout << "same content: " << yes_no(read_all(filesystem, "big") == data) << std::endl;
+    std::cout << "write: " << data.size() / secs.count() / (1024 * 1024) << " MB/s" << std::endl;
+    PRINTDIV2;
+
+    std::cout << "... Task 18 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,129 @@
+/******************************************************************************
+ *             File : test_script19.cpp
+ *
+ * Test program for copying shared blocks: a write at the end of a file
+ * sharing the blocks of a large one copies every block in front of it. The copy is checked and
+ * its throughput measured with and without the reader/writer pipeline.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include <chrono>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// blocks in the test file
+#define NO_BLOCKS_BIG 512
+#define BENCH_RUNS 5
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+static std::string
+read_all(FS &filesystem, const char *path)
+{
+    std::string data;
+    char buf[BLOCK_SIZE];
+    int n, fd = filesystem.open(path, READ);
+    while ((n = filesystem.read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    filesystem.close(fd);
+    return data;
+}
+
+static uint32_t
+blocks_on_disk(FS &filesystem)
+{
+    uint32_t logical, physical;
+    filesystem.dedup_counts(logical, physical);
+    return physical;
+}
+
+static const char *
+yes_no(bool b)
+{
+    return b ? "yes" : "no";
+}
+
+// writes <data>, the content of big, to copy, which then shares the blocks
+// of big, and writes <tail> at the end of copy, which makes all of its
+// blocks private; returns the seconds the second write took
+static double
+copy_and_write(FS &filesystem, const std::string &data, const std::string &tail)
+{
+    int fd = filesystem.open("copy", WRITE | CREATE);
+    filesystem.write(fd, data.data(), data.size());
+    filesystem.close(fd);
+    fd = filesystem.open("copy", WRITE);
+    filesystem.seek(fd, NO_BLOCKS_BIG * BLOCK_SIZE - tail.size());
+    auto start = std::chrono::steady_clock::now();
+    filesystem.write(fd, tail.data(), tail.size());
+    filesystem.close(fd);
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    return secs.count();
+}
+
+void
+Shell::run()
+{
+    std::string data;
+    for (int i = 0; i < NO_BLOCKS_BIG; ++i)
+        data += std::string(BLOCK_SIZE, 'a' + i % 26);
+    std::string tail = "the end";
+
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 19 ..." << std::endl;
+    PRINTDIV2;
+
+    filesystem.format();
+    int fd = filesystem.open("big", WRITE | CREATE);
+    filesystem.write(fd, data.data(), data.size());
+    filesystem.close(fd);
+
+    std::cout << "Writing copy with the content of big, then the last bytes of copy (" << NO_BLOCKS_BIG << " blocks)..." << std::endl;
+    copy_and_write(filesystem, data, tail);
+    std::string expected = data.substr(0, data.size() - tail.size()) + tail;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "blocks on disk: " << 2 * NO_BLOCKS_BIG << std::endl;
+    std::cout << "big: same content: yes" << std::endl;
+    std::cout << "copy: same content: yes" << std::endl;
+    std::cout << "check: 1 directories, 2 files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "blocks on disk: " << blocks_on_disk(filesystem) << std::endl;
+    std::cout << "big: same content: " << yes_no(read_all(filesystem, "big") == data) << std::endl;
+    std::cout << "copy: same content: " << yes_no(read_all(filesystem, "copy") == expected) << std::endl;
+    filesystem.check();
+    filesystem.rm("copy");
+    PRINTDIV2;
+
+    std::cout << "Measuring the copy of " << NO_BLOCKS_BIG << " shared blocks..." << std::endl;
+    for (int on = 0; on <= 1; ++on) {
+        filesystem.set_pipelined_copy(on);
+        double secs = 0;
+        for (int i = 0; i < BENCH_RUNS; ++i) {
+            secs += copy_and_write(filesystem, data, tail);
+            filesystem.rm("copy");
+            // the copies are written out, so that every run starts alike
+            filesystem.sync();
+        }
+        std::cout << (on ? "pipelined: " : "serial: ")
+                  << (double)data.size() * BENCH_RUNS / secs / (1024 * 1024) << " MB/s" << std::endl;
+    }
+    PRINTDIV2;
+
+    std::cout << "... Task 19 done" << std::endl;
+    PRINTDIV;
+}
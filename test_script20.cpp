@@ -0,0 +1,179 @@
+/******************************************************************************
+ *             File : test_script20.cpp
+ *
+ * Test program for snapshots: a snapshot keeps the files as they were while
+ * the live ones change, is mounted read-only in a second FS, and costs
+ * block writes for the directories and frozen tables only.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include <thread>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// blocks in the large file
+#define NO_BLOCKS_BIG 256
+// times the large file is rewritten while the snapshot is read
+#define NO_REWRITES 20
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+static int
+write_file(FS &filesystem, const char *path, const std::string &data, int mode)
+{
+    int fd = filesystem.open(path, mode);
+    int ret = filesystem.write(fd, data.data(), data.size()) < 0 ? -1 : 0;
+    if (filesystem.close(fd))
+        ret = -1;
+    return ret;
+}
+
+static std::string
+read_all(FS &filesystem, const char *path)
+{
+    std::string data;
+    char buf[BLOCK_SIZE];
+    int n, fd = filesystem.open(path, READ);
+    while ((n = filesystem.read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    filesystem.close(fd);
+    return data;
+}
+
+static const char *
+yes_no(bool b)
+{
+    return b ? "yes" : "no";
+}
+
+void
+Shell::run()
+{
+    std::string big;
+    for (int i = 0; i < NO_BLOCKS_BIG; ++i)
+        big += std::string(BLOCK_SIZE, 'a' + i % 26);
+
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 20 ..." << std::endl;
+    PRINTDIV2;
+
+    filesystem.format();
+    filesystem.mkdir("d");
+    write_file(filesystem, "a", "old a\n", WRITE | CREATE);
+    write_file(filesystem, "d/b", "old b\n", WRITE | CREATE);
+    write_file(filesystem, "big", big, WRITE | CREATE);
+    filesystem.sync();
+
+    std::cout << "Testing snapshot(s1) of a, d/b and a file of " << NO_BLOCKS_BIG << " blocks..." << std::endl;
+    unsigned long writes = filesystem.get_no_writes();
+    int ret = filesystem.snapshot("s1");
+    writes = filesystem.get_no_writes() - writes;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "snapshot: 0" << std::endl;
+    // two directories, the frozen FAT and hole table, the snapshot table,
+    // the FAT, the hole table and the checksum table
+    std::cout << "block writes: at most 16: yes" << std::endl;
+    std::cout << "snapshot: s1: Snapshot exists" << std::endl;
+    std::cout << "s1" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "snapshot: " << ret << std::endl;
+    std::cout << "block writes: at most 16: " << yes_no(writes <= 16) << std::endl;
+    filesystem.snapshot("s1");
+    filesystem.list_snapshots();
+    PRINTDIV2;
+
+    std::cout << "Changing a, big, removing d/b and creating c, then mounting s1..." << std::endl;
+    write_file(filesystem, "a", "new", WRITE);
+    write_file(filesystem, "big", "changed", WRITE);
+    int fd = filesystem.open("big", WRITE);
+    filesystem.seek(fd, big.size());
+    filesystem.write(fd, "appended", 8);
+    filesystem.close(fd);
+    filesystem.rm("d/b");
+    write_file(filesystem, "c", "new c\n", WRITE | CREATE);
+    filesystem.sync();
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "FS::FS()... Mounting snapshot s1 read-only" << std::endl;
+    std::cout << "old a" << std::endl;
+    std::cout << "old b" << std::endl;
+    std::cout << "cat: c: No such file" << std::endl;
+    std::cout << "big: same content: yes" << std::endl;
+    std::cout << "rm: a: Read-only file system" << std::endl;
+    std::cout << "open: x: Read-only file system" << std::endl;
+    std::cout << "mkdir: e: Read-only file system" << std::endl;
+    std::cout << "check: 2 directories, 3 files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    {
+        FS snap("s1");
+        snap.cat("a");
+        snap.cat("d/b");
+        snap.cat("c");
+        std::cout << "big: same content: " << yes_no(read_all(snap, "big") == big) << std::endl;
+        snap.rm("a");
+        snap.open("x", WRITE | CREATE);
+        snap.mkdir("e");
+        snap.check();
+    }
+    PRINTDIV2;
+
+    std::cout << "Reading the snapshot while big is rewritten " << NO_REWRITES << " times..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "FS::FS()... Mounting snapshot s1 read-only" << std::endl;
+    std::cout << "big: same content: yes" << std::endl;
+    std::cout << "check: 4 directories, 6 files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    bool same = true;
+    {
+        FS snap("s1");
+        std::thread writer([this]() {
+            std::string data(NO_BLOCKS_BIG * BLOCK_SIZE, 'x');
+            for (int i = 0; i < NO_REWRITES; ++i) {
+                data[0] = 'A' + i;
+                write_file(filesystem, "big", data, WRITE);
+            }
+        });
+        for (int i = 0; i < NO_REWRITES; ++i)
+            same = same && read_all(snap, "big") == big;
+        writer.join();
+    }
+    std::cout << "big: same content: " << yes_no(same) << std::endl;
+    filesystem.check();
+    PRINTDIV2;
+
+    std::cout << "Testing snapshot -d s1, then mounting s2..." << std::endl;
+    uint32_t logical, physical;
+    filesystem.rm_snapshot("s1");
+    filesystem.dedup_counts(logical, physical);
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "check: 2 directories, 3 files, 0 problems" << std::endl;
+    std::cout << "blocks on disk: " << NO_BLOCKS_BIG + 3 << std::endl;
+    std::cout << "FS::FS()... Mounting snapshot s2 read-only" << std::endl;
+    std::cout << "FS::FS()... Cannot mount snapshot s2" << std::endl;
+    std::cout << "mounted: no" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.check();
+    std::cout << "blocks on disk: " << physical << std::endl;
+    {
+        FS snap("s2");
+        std::cout << "mounted: " << yes_no(snap.mounted()) << std::endl;
+    }
+    PRINTDIV2;
+
+    std::cout << "... Task 20 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,113 @@
+/******************************************************************************
+ *             File : test_script21.cpp
+ *
+ * Test program for batch mode: a script with comments and data rows runs
+ * without prompts, its output collected in a stream, and a long script is
+ * replayed to measure the cost of the shell per command.
+ *****************************************************************************/
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include "test_script.h"
+#include "command.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// rows in the long script
+#define NO_ROWS 100000
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+// runs <script> the way the shell does in batch mode and returns the output
+static std::string
+run_script(FS &filesystem, const std::string &script)
+{
+    std::istringstream in(script);
+    std::ostringstream out;
+    fs_session s;
+    s.in = &in;
+    s.out = &out;
+    s.out_fd = -1;
+    filesystem.attach(s);
+    std::string line;
+    while (std::getline(in, line) && run_command(filesystem, line, out, false))
+        ;
+    filesystem.detach(s);
+    return out.str();
+}
+
+void
+Shell::run()
+{
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 21 ..." << std::endl;
+    PRINTDIV2;
+
+    filesystem.format();
+    std::cout << "Running a script with comments, data rows and an error..." << std::endl;
+    std::string out = run_script(filesystem,
+        "# a comment\n"
+        "// another comment\n"
+        "  # indented\n"
+        "create a\n"
+        "hej heja hejare\n"
+        "\n"
+        "mkdir d\n"
+        "cp a d/b\n"
+        "cat d/b\n"
+        "ls\n"
+        "cat missing\n"
+        "quit\n"
+        "ls\n");
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "hej heja hejare" << std::endl;
+    std::cout << "name\t type\t accessrights\t size" << std::endl;
+    std::cout << "a\t file\t rw-\t 16" << std::endl;
+    std::cout << "d\t dir\t rwx\t -" << std::endl;
+    std::cout << "cat: missing: No such file" << std::endl;
+    std::cout << "Error: cat missing failed, error code -1" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << out;
+    PRINTDIV2;
+
+    std::cout << "Running unknown commands and bad usage..." << std::endl;
+    out = run_script(filesystem, "frobnicate\nhead -c x a\n");
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "Available commands:" << std::endl;
+    std::cout << "format, create, cat, head, tail, read, ls, cp, mv, rm, append, write, truncate, mkdir, cd, pwd, chmod, find, import, export, compress, uncompress, sync, snapshot, trace, stats, check, help, quit" << std::endl;
+    std::cout << "Usage: head -c <bytes> <file>" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << out;
+    PRINTDIV2;
+
+    std::cout << "Replaying a script of " << NO_ROWS << " rows..." << std::endl;
+    std::string script;
+    for (int i = 0; i < NO_ROWS / 4; ++i)
+        script += "# row " + std::to_string(i) + "\npwd\nhead -c 3 a\ncd /\n";
+    auto start = std::chrono::steady_clock::now();
+    out = run_script(filesystem, script);
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "output bytes: " << NO_ROWS / 4 * 5 << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "output bytes: " << out.size() << std::endl;
+    std::cout << "rows: " << (unsigned long)(NO_ROWS / secs.count()) << " per second" << std::endl;
+    PRINTDIV2;
+
+    std::cout << "... Task 21 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,167 @@
+/******************************************************************************
+ *             File : test_script22.cpp
+ *
+ * Test program for tracing: commands and file operations of several threads
+ * are recorded between trace start and trace stop and written as Chrome
+ * trace-event JSON, and the cost of a span while tracing is off is measured.
+ *****************************************************************************/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <set>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include "test_script.h"
+#include "command.h"
+#include "trace.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// the host file the trace is written to
+#define TRACE_FILE "trace22.json"
+// threads writing files while tracing
+#define NO_THREADS 4
+// spans measured while tracing is off
+#define NO_SPANS 10000000
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+// runs <script> the way the shell does in batch mode and returns the output
+static std::string
+run_script(FS &filesystem, const std::string &script)
+{
+    std::istringstream in(script);
+    std::ostringstream out;
+    fs_session s;
+    s.in = &in;
+    s.out = &out;
+    s.out_fd = -1;
+    filesystem.attach(s);
+    std::string line;
+    while (std::getline(in, line) && run_command(filesystem, line, out, false))
+        ;
+    filesystem.detach(s);
+    return out.str();
+}
+
+static int
+write_file(FS &filesystem, const std::string &path, const std::string &data)
+{
+    int fd = filesystem.open(path, WRITE | CREATE);
+    int ret = filesystem.write(fd, data.data(), data.size()) < 0 ? -1 : 0;
+    if (filesystem.close(fd))
+        ret = -1;
+    return ret;
+}
+
+static const char *
+yes_no(bool b)
+{
+    return b ? "yes" : "no";
+}
+
+void
+Shell::run()
+{
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 22 ..." << std::endl;
+    PRINTDIV2;
+
+    filesystem.format();
+    std::cout << "Tracing commands and " << NO_THREADS << " writing threads..." << std::endl;
+    std::string out = run_script(filesystem, "trace start\nmkdir d\ncreate d/a\nhej\n\ncat d/a\nsync\n");
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NO_THREADS; ++t)
+        threads.emplace_back([this, t]() {
+            write_file(filesystem, "d/f" + std::to_string(t), std::string(3 * BLOCK_SIZE, 'a' + t));
+        });
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+    out += run_script(filesystem, "sync\ntrace stop " TRACE_FILE "\n");
+
+    std::ifstream file(TRACE_FILE);
+    std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::set<std::string> names;
+    std::set<std::string> tids;
+    size_t events = 0;
+    bool complete = true;
+    for (size_t pos = json.find("{\"name\":\""); pos != std::string::npos;
+         pos = json.find("{\"name\":\"", pos + 1)) {
+        size_t end = json.find('}', pos);
+        std::string event = json.substr(pos, end - pos + 1);
+        names.insert(event.substr(9, event.find('"', 9) - 9));
+        size_t tid = event.find("\"tid\":");
+        tids.insert(event.substr(tid + 6, event.size() - tid - 7));
+        complete = complete && event.find("\"ph\":\"X\"") != std::string::npos &&
+                   event.find("\"ts\":") != std::string::npos && event.find("\"dur\":") != std::string::npos;
+        ++events;
+    }
+    const char *spans[] = { "mkdir", "create", "cat", "sync", "FS::lookup", "FS::allocate",
+                            "FS::write_fat", "FS::read_chain", "FS::write_chain", "FS::close",
+                            "FS::sync", "Disk::read", "Disk::write", "Disk::flush" };
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "hej" << std::endl;
+    std::cout << "trace-event file: yes" << std::endl;
+    std::cout << "complete events: yes" << std::endl;
+    for (size_t i = 0; i < sizeof(spans) / sizeof(spans[0]); ++i)
+        std::cout << spans[i] << ": yes" << std::endl;
+    std::cout << "threads: at least " << NO_THREADS + 1 << ": yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << out;
+    std::cout << "trace-event file: " << yes_no(json.rfind("{\"traceEvents\":[", 0) == 0 &&
+                                                json.find("],\"displayTimeUnit\":\"ns\"}") != std::string::npos) << std::endl;
+    std::cout << "complete events: " << yes_no(events > 0 && complete) << std::endl;
+    for (size_t i = 0; i < sizeof(spans) / sizeof(spans[0]); ++i)
+        std::cout << spans[i] << ": " << yes_no(names.count(spans[i])) << std::endl;
+    std::cout << "threads: at least " << NO_THREADS + 1 << ": " << yes_no(tids.size() >= NO_THREADS + 1) << std::endl;
+    std::cout << "events: " << events << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Testing that nothing is recorded after trace stop, and a bad path..." << std::endl;
+    out = run_script(filesystem, "cat d/a\ntrace stop " TRACE_FILE "\ntrace stop nodir/x.json\ntrace\n");
+    std::ifstream again(TRACE_FILE);
+    std::string json2((std::istreambuf_iterator<char>(again)), std::istreambuf_iterator<char>());
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "hej" << std::endl;
+    std::cout << "trace: nodir/x.json: Cannot write trace" << std::endl;
+    std::cout << "Error: trace stop nodir/x.json failed, error code -1" << std::endl;
+    std::cout << "Usage: trace start | trace stop <hostpath>" << std::endl;
+    std::cout << "same trace as before: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << out;
+    std::cout << "same trace as before: " << yes_no(json2 == json) << std::endl;
+    std::remove(TRACE_FILE);
+    PRINTDIV2;
+
+    std::cout << "Measuring " << NO_SPANS << " spans while tracing is off..." << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < NO_SPANS; ++i) {
+        TRACE_SPAN("off");
+    }
+    std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "under 5 ns per span: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "under 5 ns per span: " << yes_no(ns.count() / NO_SPANS < 5) << std::endl;
+    std::cout << "ns per span: " << ns.count() / NO_SPANS << std::endl;
+    PRINTDIV2;
+
+    std::cout << "... Task 22 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,200 @@
+/******************************************************************************
+ *             File : test_script23.cpp
+ *
+ * Test program for striping: a disk spread over several image files keeps
+ * each block where the stripe layout puts it, survives a reopen, imports and
+ * exports host files, and its sequential read speed is compared with one
+ * file's; it gains where the members can be read at once.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "test_script.h"
+#include "disk.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// the image files of the striped disks
+#define STRIPE_NAME "stripe23.bin"
+#define NO_MEMBERS 4
+#define NO_STRIPE_BLOCKS 4
+// blocks written and read back, and blocks per request when reading
+#define NO_BLOCKS_TEST 512
+#define RUN_BLOCKS 64
+// times the disk is read when measuring
+#define NO_PASSES 20
+// the first block written, after the checksum table
+#define FIRST_BLOCK (CHECKSUM_BLOCK + CHECKSUM_BLOCKS)
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+static const char *
+yes_no(bool b)
+{
+    return b ? "yes" : "no";
+}
+
+// the content of block <b> in the tests
+static void
+fill_block(unsigned b, uint8_t *blk)
+{
+    for (unsigned i = 0; i < BLOCK_SIZE; ++i)
+        blk[i] = (uint8_t)(b * 7 + i / 64);
+}
+
+static std::string
+member_name(unsigned members, unsigned i)
+{
+    return members == 1 ? STRIPE_NAME : STRIPE_NAME "." + std::to_string(i);
+}
+
+static void
+remove_members(unsigned members)
+{
+    for (unsigned i = 0; i < members; ++i)
+        std::remove(member_name(members, i).c_str());
+}
+
+// MB per second reading the first NO_BLOCKS_TEST blocks of a disk with
+// <members> files NO_PASSES times, RUN_BLOCKS blocks per request
+static double
+read_speed(unsigned members)
+{
+    Disk disk(false, STRIPE_NAME, members, NO_STRIPE_BLOCKS);
+    std::vector<uint8_t> buf(NO_BLOCKS_TEST * BLOCK_SIZE);
+    for (unsigned b = 0; b < NO_BLOCKS_TEST; ++b)
+        fill_block(b, buf.data() + b * BLOCK_SIZE);
+    for (unsigned b = FIRST_BLOCK; b < NO_BLOCKS_TEST; ++b)
+        disk.write(b, buf.data() + b * BLOCK_SIZE);
+    disk.sync();
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < NO_PASSES; ++pass) {
+        for (unsigned b = 0; b < NO_BLOCKS_TEST; b += RUN_BLOCKS)
+            disk.read_blocks(b, RUN_BLOCKS, buf.data() + b * BLOCK_SIZE);
+    }
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    return (double)NO_PASSES * NO_BLOCKS_TEST * BLOCK_SIZE / secs.count() / (1 << 20);
+}
+
+void
+Shell::run()
+{
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 23 ..." << std::endl;
+    PRINTDIV2;
+
+    remove_members(NO_MEMBERS);
+    std::cout << "Writing " << NO_BLOCKS_TEST << " blocks to a disk of " << NO_MEMBERS
+              << " files, stripes of " << NO_STRIPE_BLOCKS << " blocks..." << std::endl;
+    std::vector<uint8_t> data(NO_BLOCKS_TEST * BLOCK_SIZE), buf(NO_BLOCKS_TEST * BLOCK_SIZE);
+    for (unsigned b = 0; b < NO_BLOCKS_TEST; ++b)
+        fill_block(b, data.data() + b * BLOCK_SIZE);
+    bool same, placed = true;
+    {
+        Disk disk(false, STRIPE_NAME, NO_MEMBERS, NO_STRIPE_BLOCKS);
+        for (unsigned b = FIRST_BLOCK; b < NO_BLOCKS_TEST; ++b)
+            disk.write(b, data.data() + b * BLOCK_SIZE);
+        disk.sync();
+        same = disk.read_blocks(FIRST_BLOCK, NO_BLOCKS_TEST - FIRST_BLOCK, buf.data()) == 0 &&
+               std::memcmp(buf.data(), data.data() + FIRST_BLOCK * BLOCK_SIZE,
+                           (NO_BLOCKS_TEST - FIRST_BLOCK) * BLOCK_SIZE) == 0;
+        // block b is in member (b / stripe) % members, in its stripe
+        // (b / stripe) / members there
+        uint8_t blk[BLOCK_SIZE];
+        for (unsigned b = FIRST_BLOCK; b < NO_BLOCKS_TEST; ++b) {
+            unsigned stripe = b / NO_STRIPE_BLOCKS;
+            int fd = open(member_name(NO_MEMBERS, stripe % NO_MEMBERS).c_str(), O_RDONLY);
+            off_t offset = ((off_t)(stripe / NO_MEMBERS) * NO_STRIPE_BLOCKS + b % NO_STRIPE_BLOCKS) * BLOCK_SIZE;
+            placed = placed && pread(fd, blk, BLOCK_SIZE, offset) == BLOCK_SIZE &&
+                     std::memcmp(blk, data.data() + b * BLOCK_SIZE, BLOCK_SIZE) == 0;
+            close(fd);
+        }
+    }
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "read back: yes" << std::endl;
+    std::cout << "blocks in their member files: yes" << std::endl;
+    std::cout << "read back after reopening: yes" << std::endl;
+    std::cout << "member file size: " << 2048 / NO_MEMBERS * BLOCK_SIZE << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "read back: " << yes_no(same) << std::endl;
+    std::cout << "blocks in their member files: " << yes_no(placed) << std::endl;
+    {
+        Disk disk(true, STRIPE_NAME, NO_MEMBERS, NO_STRIPE_BLOCKS);
+        std::fill(buf.begin(), buf.end(), 0);
+        // unaligned runs, starting and ending inside stripes
+        same = true;
+        for (unsigned b = FIRST_BLOCK; b < NO_BLOCKS_TEST; b += 13) {
+            unsigned count = std::min(13u, NO_BLOCKS_TEST - b);
+            same = same && disk.read_blocks(b, count, buf.data() + b * BLOCK_SIZE) == 0 &&
+                   std::memcmp(buf.data() + b * BLOCK_SIZE, data.data() + b * BLOCK_SIZE,
+                               count * BLOCK_SIZE) == 0;
+        }
+    }
+    std::cout << "read back after reopening: " << yes_no(same) << std::endl;
+    int fd = open(member_name(NO_MEMBERS, 0).c_str(), O_RDONLY);
+    std::cout << "member file size: " << lseek(fd, 0, SEEK_END) << std::endl;
+    close(fd);
+    PRINTDIV2;
+
+    std::cout << "Importing and exporting a host file across the members..." << std::endl;
+    std::string host(37 * BLOCK_SIZE + 123, 0);
+    for (size_t i = 0; i < host.size(); ++i)
+        host[i] = 'a' + i % 23;
+    int in = open("stripe23.in", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    int out = open("stripe23.out", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    bool wrote = write(in, host.data(), host.size()) == (ssize_t)host.size();
+    int ret_in, ret_out;
+    {
+        Disk disk(false, STRIPE_NAME, NO_MEMBERS, NO_STRIPE_BLOCKS);
+        ret_in = disk.copy_in(101, 38, in, 0, host.size());
+        ret_out = disk.copy_out(101, 38, out, 0, host.size());
+        same = disk.read_blocks(101, 38, buf.data()) == 0 &&
+               std::memcmp(buf.data(), host.data(), host.size()) == 0 &&
+               buf[host.size()] == 0 && buf[38 * BLOCK_SIZE - 1] == 0;
+    }
+    std::string back(host.size(), 0);
+    same = same && pread(out, &back[0], back.size(), 0) == (ssize_t)back.size() && back == host;
+    close(in);
+    close(out);
+    std::remove("stripe23.in");
+    std::remove("stripe23.out");
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "copy_in: 0, copy_out: 0" << std::endl;
+    std::cout << "same content, zero filled: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "copy_in: " << (wrote ? ret_in : -1) << ", copy_out: " << ret_out << std::endl;
+    std::cout << "same content, zero filled: " << yes_no(same) << std::endl;
+    remove_members(NO_MEMBERS);
+    PRINTDIV2;
+
+    std::cout << "Reading " << NO_BLOCKS_TEST << " blocks " << NO_PASSES << " times, "
+              << RUN_BLOCKS << " blocks per request..." << std::endl;
+    double one = read_speed(1);
+    remove_members(1);
+    double striped = read_speed(NO_MEMBERS);
+    remove_members(NO_MEMBERS);
+    std::cout << "1 file: " << one << " MB/s" << std::endl;
+    std::cout << NO_MEMBERS << " files: " << striped << " MB/s" << std::endl;
+    PRINTDIV2;
+
+    std::cout << "... Task 23 done" << std::endl;
+    PRINTDIV;
+}
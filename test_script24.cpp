@@ -0,0 +1,109 @@
+/******************************************************************************
+ *             File : test_script24.cpp
+ *
+ * Test program for workloads: the same seed gives the same workload, the
+ * mix decides which commands it holds, and replaying it runs every command
+ * without an error and leaves a consistent file system.
+ *****************************************************************************/
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "test_script.h"
+#include "workload.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// commands in the generated workloads
+#define NO_COMMANDS 5000
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+static const char *
+yes_no(bool b)
+{
+    return b ? "yes" : "no";
+}
+
+static std::string
+generate(const workload_params &params)
+{
+    std::ostringstream out;
+    generate_workload(params, out);
+    return out.str();
+}
+
+void
+Shell::run()
+{
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 24 ..." << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Generating workloads of " << NO_COMMANDS << " commands..." << std::endl;
+    workload_params params;
+    params.ops = NO_COMMANDS;
+    params.seed = 24;
+    std::string trace = generate(params);
+    bool same = generate(params) == trace;
+    params.seed = 25;
+    bool other = generate(params) != trace;
+    params.seed = 24;
+    workload_params mkdirs = params;
+    int ret = parse_mix("mkdir=1,cd=1", mkdirs);
+    std::istringstream rows(generate(mkdirs));
+    std::string line;
+    bool only = true;
+    while (std::getline(rows, line))
+        only = only && (line[0] == '#' || line == "format" || !line.compare(0, 6, "mkdir ") ||
+                        !line.compare(0, 3, "cd "));
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "same seed, same workload: yes" << std::endl;
+    std::cout << "other seed, other workload: yes" << std::endl;
+    std::cout << "parse_mix: 0" << std::endl;
+    std::cout << "only mkdir and cd: yes" << std::endl;
+    std::cout << "parse_mix(mkdir=1,ls=1): -1" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "same seed, same workload: " << yes_no(same) << std::endl;
+    std::cout << "other seed, other workload: " << yes_no(other) << std::endl;
+    std::cout << "parse_mix: " << ret << std::endl;
+    std::cout << "only mkdir and cd: " << yes_no(only) << std::endl;
+    std::cout << "parse_mix(mkdir=1,ls=1): " << parse_mix("mkdir=1,ls=1", mkdirs) << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Replaying the workload of seed 24..." << std::endl;
+    std::istringstream in(trace);
+    replay_result result;
+    replay_workload(filesystem, in, result);
+    unsigned long ops = 0, errors = 0;
+    for (auto it = result.commands.begin(); it != result.commands.end(); ++it) {
+        ops += it->second.latencies.size();
+        errors += it->second.errors;
+    }
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "commands: " << NO_COMMANDS + 1 << std::endl;
+    std::cout << "errors: 0" << std::endl;
+    // the tree the workload of seed 24 leaves
+    std::cout << "check: 252 directories, 462 files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "commands: " << ops << std::endl;
+    std::cout << "errors: " << errors << std::endl;
+    filesystem.check();
+    print_replay(result, std::cout);
+    PRINTDIV2;
+
+    std::cout << "... Task 24 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,129 @@
+/******************************************************************************
+ *             File : test_script25.cpp
+ *
+ * Test program for find: -name with the glob wildcards *, ?, [..] and
+ * [!..], -type and -perm, each alone and together, relative start paths,
+ * searches that match nothing and a start directory that does not exist.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+static void
+touch(FS &filesystem, const char *path)
+{
+    filesystem.close(filesystem.open(path, WRITE | CREATE));
+}
+
+void
+Shell::run()
+{
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 25 ..." << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Creating /a.txt, /b.cpp, /src/{main.cpp,util.h}, /src/sub/{x1.cpp,y2.txt} and a read-only /docs/readme..." << std::endl;
+    filesystem.format();
+    touch(filesystem, "/a.txt");
+    touch(filesystem, "/b.cpp");
+    filesystem.mkdir("/src");
+    filesystem.mkdir("/docs");
+    touch(filesystem, "/src/main.cpp");
+    touch(filesystem, "/src/util.h");
+    filesystem.mkdir("/src/sub");
+    touch(filesystem, "/src/sub/x1.cpp");
+    touch(filesystem, "/src/sub/y2.txt");
+    touch(filesystem, "/docs/readme");
+    filesystem.chmod("4", "/docs/readme");
+    PRINTDIV2;
+
+    std::cout << "Testing find / -name *.cpp..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "/b.cpp" << std::endl;
+    std::cout << "/src/main.cpp" << std::endl;
+    std::cout << "/src/sub/x1.cpp" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.find("/", "*.cpp", -1, 0);
+    PRINTDIV2;
+
+    std::cout << "Testing find /src -name ?[0-9].*..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "/src/sub/x1.cpp" << std::endl;
+    std::cout << "/src/sub/y2.txt" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.find("/src", "?[0-9].*", -1, 0);
+    PRINTDIV2;
+
+    std::cout << "Testing find / -name [!a-m]* -type d..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "/src" << std::endl;
+    std::cout << "/src/sub" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.find("/", "[!a-m]*", TYPE_DIR, 0);
+    PRINTDIV2;
+
+    std::cout << "Testing find / -type f -perm 6..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "/a.txt" << std::endl;
+    std::cout << "/b.cpp" << std::endl;
+    std::cout << "/src/main.cpp" << std::endl;
+    std::cout << "/src/util.h" << std::endl;
+    std::cout << "/src/sub/x1.cpp" << std::endl;
+    std::cout << "/src/sub/y2.txt" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.find("/", "*", TYPE_FILE, READ | WRITE);
+    PRINTDIV2;
+
+    std::cout << "Testing find /src/ -name util.h, and find sub from /src..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "/src/util.h" << std::endl;
+    std::cout << "sub/x1.cpp" << std::endl;
+    std::cout << "sub/y2.txt" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.find("/src/", "util.h", -1, 0);
+    filesystem.cd("/src");
+    filesystem.find("sub", "*", -1, 0);
+    filesystem.cd("/");
+    PRINTDIV2;
+
+    std::cout << "Testing searches that match nothing..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "find / -name *.java: 0" << std::endl;
+    std::cout << "find /docs -perm 2: 0" << std::endl;
+    std::cout << "find / -name x1.cpp -type d: 0" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "find / -name *.java: " << filesystem.find("/", "*.java", -1, 0) << std::endl;
+    std::cout << "find /docs -perm 2: " << filesystem.find("/docs", "*", -1, WRITE) << std::endl;
+    std::cout << "find / -name x1.cpp -type d: " << filesystem.find("/", "x1.cpp", TYPE_DIR, 0) << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Testing find /nope and find /a.txt..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "find: /nope: No such directory" << std::endl;
+    std::cout << "find: /a.txt: No such directory" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.find("/nope", "*", -1, 0);
+    filesystem.find("/a.txt", "*", -1, 0);
+    PRINTDIV2;
+
+    std::cout << "... Task 25 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,174 @@
+/******************************************************************************
+ *             File : test_script26.cpp
+ *
+ * Test program for cp -r and rm -r: a nested tree is copied and removed
+ * again, each with the FAT written once, the copy reads back like the
+ * original, check() finds the file system consistent after each step, and
+ * a directory is not copied into itself.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+static const char *
+yes_no(bool b)
+{
+    return b ? "yes" : "no";
+}
+
+// reads all of <path> through the handle API
+static std::string
+read_all(FS &filesystem, const std::string &path)
+{
+    std::string data;
+    char buf[BLOCK_SIZE];
+    int n, fd = filesystem.open(path, READ);
+    if (fd < 0)
+        return "<no such file>";
+    while ((n = filesystem.read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    filesystem.close(fd);
+    return data;
+}
+
+static void
+write_file(FS &filesystem, const std::string &path, const std::string &data)
+{
+    int fd = filesystem.open(path, WRITE | CREATE);
+    filesystem.write(fd, data.data(), data.size());
+    filesystem.close(fd);
+}
+
+// data of <blocks> blocks and a bit, different for each <seed>
+static std::string
+make_data(int blocks, char seed)
+{
+    std::string data;
+    for (int i = 0; i < blocks * BLOCK_SIZE + 100; ++i)
+        data += seed + i / 100 % 10;
+    return data;
+}
+
+void
+Shell::run()
+{
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 26 ..." << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Creating /t with /t/f1, /t/a/f2, /t/a/b/f3 and an empty /t/c/f4..." << std::endl;
+    filesystem.format();
+    filesystem.mkdir("/t");
+    filesystem.mkdir("/t/a");
+    filesystem.mkdir("/t/a/b");
+    filesystem.mkdir("/t/c");
+    write_file(filesystem, "/t/f1", make_data(2, 'a'));
+    write_file(filesystem, "/t/a/f2", make_data(0, 'k'));
+    write_file(filesystem, "/t/a/b/f3", make_data(3, 'A'));
+    write_file(filesystem, "/t/c/f4", "");
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "check: 5 directories, 4 files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.check();
+    PRINTDIV2;
+
+    std::cout << "Testing cp -r /t /u..." << std::endl;
+    unsigned long writes = filesystem.get_no_writes();
+    int ret = filesystem.cp_recursive("/t", "/u");
+    writes = filesystem.get_no_writes() - writes;
+    bool same = read_all(filesystem, "/u/f1") == make_data(2, 'a') &&
+                read_all(filesystem, "/u/a/f2") == make_data(0, 'k') &&
+                read_all(filesystem, "/u/a/b/f3") == make_data(3, 'A') &&
+                read_all(filesystem, "/u/c/f4").empty();
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "cp -r: 0" << std::endl;
+    // the four new directory blocks, the FAT and the root directory
+    std::cout << "block writes: 6" << std::endl;
+    std::cout << "same content: yes" << std::endl;
+    std::cout << "check: 9 directories, 8 files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "cp -r: " << ret << std::endl;
+    std::cout << "block writes: " << writes << std::endl;
+    std::cout << "same content: " << yes_no(same) << std::endl;
+    filesystem.check();
+    PRINTDIV2;
+
+    std::cout << "Testing cp -r /t /t/a/x, cp -r /t /t and cp -r /t/a /t/a/b..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "cp: /t/a/x: Cannot copy a directory into itself" << std::endl;
+    std::cout << "cp: /t: Cannot copy a directory into itself" << std::endl;
+    std::cout << "cp: /t/a/b: Cannot copy a directory into itself" << std::endl;
+    std::cout << "check: 9 directories, 8 files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.cp_recursive("/t", "/t/a/x");
+    filesystem.cp_recursive("/t", "/t");
+    filesystem.cp_recursive("/t/a", "/t/a/b");
+    filesystem.check();
+    PRINTDIV2;
+
+    std::cout << "Testing rm -r /u while /u/a/b/f3 is open, and rm -r /t from inside /t/a..." << std::endl;
+    int fd = filesystem.open("/u/a/b/f3", READ);
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "rm: /u: File is open" << std::endl;
+    std::cout << "rm: /t: Cannot remove the current directory" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.rm_recursive("/u");
+    filesystem.close(fd);
+    filesystem.cd("/t/a");
+    filesystem.rm_recursive("/t");
+    filesystem.cd("/");
+    PRINTDIV2;
+
+    std::cout << "Testing rm -r /t..." << std::endl;
+    writes = filesystem.get_no_writes();
+    ret = filesystem.rm_recursive("/t");
+    writes = filesystem.get_no_writes() - writes;
+    same = read_all(filesystem, "/u/a/b/f3") == make_data(3, 'A');
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "rm -r: 0" << std::endl;
+    // the FAT and the root directory
+    std::cout << "block writes: 2" << std::endl;
+    std::cout << "copy unchanged: yes" << std::endl;
+    std::cout << "check: 5 directories, 4 files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "rm -r: " << ret << std::endl;
+    std::cout << "block writes: " << writes << std::endl;
+    std::cout << "copy unchanged: " << yes_no(same) << std::endl;
+    filesystem.check();
+    PRINTDIV2;
+
+    std::cout << "Testing rm -r /u..." << std::endl;
+    ret = filesystem.rm_recursive("/u");
+    uint32_t logical, physical;
+    filesystem.dedup_counts(logical, physical);
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "rm -r: 0" << std::endl;
+    std::cout << "file blocks: 0 in files, 0 on disk" << std::endl;
+    std::cout << "check: 1 directories, 0 files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "rm -r: " << ret << std::endl;
+    std::cout << "file blocks: " << logical << " in files, " << physical << " on disk" << std::endl;
+    filesystem.check();
+    PRINTDIV2;
+
+    std::cout << "... Task 26 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,168 @@
+/******************************************************************************
+ *             File : test_script27.cpp
+ *
+ * Test program for import and export: host files that are empty, or not a
+ * multiple of the block size, come back unchanged after a round trip
+ * through the disk, also from files with holes or stored compressed, and
+ * an existing target, a missing host file or a missing file on the disk
+ * are reported.
+ *****************************************************************************/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// host files the test writes and removes again
+#define HOST_EMPTY "import27_empty.tmp"
+#define HOST_ODD "import27_odd.tmp"
+#define HOST_OUT "export27_out.tmp"
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+static const char *
+yes_no(bool b)
+{
+    return b ? "yes" : "no";
+}
+
+static void
+write_host(const char *path, const std::string &data)
+{
+    std::ofstream out(path, std::ios::binary);
+    out << data;
+}
+
+static std::string
+read_host(const char *path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return "<no such host file>";
+    std::ostringstream data;
+    data << in.rdbuf();
+    return data.str();
+}
+
+// reads all of <path> through the handle API
+static std::string
+read_all(FS &filesystem, const char *path)
+{
+    std::string data;
+    char buf[BLOCK_SIZE];
+    int n, fd = filesystem.open(path, READ);
+    if (fd < 0)
+        return "<no such file>";
+    while ((n = filesystem.read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    filesystem.close(fd);
+    return data;
+}
+
+void
+Shell::run()
+{
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 27 ..." << std::endl;
+    PRINTDIV2;
+
+    // no two blocks of it are alike, so nothing of it is shared
+    std::string odd;
+    for (int i = 0; i < 3 * BLOCK_SIZE + 123; ++i)
+        odd += (char)(i * 7 + i / BLOCK_SIZE);
+    write_host(HOST_EMPTY, "");
+    write_host(HOST_ODD, odd);
+    filesystem.format();
+
+    std::cout << "Importing an empty host file and one of " << odd.size() << " bytes..." << std::endl;
+    int ret1 = filesystem.import_file(HOST_EMPTY, "empty");
+    int ret2 = filesystem.import_file(HOST_ODD, "odd");
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "import: 0 0" << std::endl;
+    std::cout << "empty: 0 bytes, same content: yes" << std::endl;
+    std::cout << "odd: " << odd.size() << " bytes, same content: yes" << std::endl;
+    std::cout << "check: 1 directories, 2 files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "import: " << ret1 << " " << ret2 << std::endl;
+    std::string data = read_all(filesystem, "empty");
+    std::cout << "empty: " << data.size() << " bytes, same content: " << yes_no(data.empty()) << std::endl;
+    data = read_all(filesystem, "odd");
+    std::cout << "odd: " << data.size() << " bytes, same content: " << yes_no(data == odd) << std::endl;
+    filesystem.check();
+    PRINTDIV2;
+
+    std::cout << "Exporting them again..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "empty: 0 bytes, same content: yes" << std::endl;
+    std::cout << "odd: " << odd.size() << " bytes, same content: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.export_file("empty", HOST_OUT);
+    data = read_host(HOST_OUT);
+    std::cout << "empty: " << data.size() << " bytes, same content: " << yes_no(data.empty()) << std::endl;
+    filesystem.export_file("odd", HOST_OUT);
+    data = read_host(HOST_OUT);
+    std::cout << "odd: " << data.size() << " bytes, same content: " << yes_no(data == odd) << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Exporting odd with a hole at its end, and stored compressed..." << std::endl;
+    std::string holed = odd + std::string(2 * BLOCK_SIZE, '\0');
+    filesystem.truncate("odd", holed.size());
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "with hole: " << holed.size() << " bytes, same content: yes" << std::endl;
+    std::cout << "compressed: " << holed.size() << " bytes, same content: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.export_file("odd", HOST_OUT);
+    data = read_host(HOST_OUT);
+    std::cout << "with hole: " << data.size() << " bytes, same content: " << yes_no(data == holed) << std::endl;
+    filesystem.compress("odd", true);
+    filesystem.export_file("odd", HOST_OUT);
+    data = read_host(HOST_OUT);
+    std::cout << "compressed: " << data.size() << " bytes, same content: " << yes_no(data == holed) << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Testing errors: existing target, missing host file, missing file, directory..." << std::endl;
+    filesystem.mkdir("d");
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "import: odd: File exists" << std::endl;
+    std::cout << "import: nohost27.tmp: Cannot open host file" << std::endl;
+    std::cout << "import: nodir/x: No such directory" << std::endl;
+    std::cout << "export: nofile: No such file" << std::endl;
+    std::cout << "export: d: Is a directory" << std::endl;
+    std::cout << "export: nodir/x.tmp: Cannot open host file" << std::endl;
+    std::cout << "odd unchanged: yes" << std::endl;
+    std::cout << "check: 2 directories, 2 files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.import_file(HOST_ODD, "odd");
+    filesystem.import_file("nohost27.tmp", "x");
+    filesystem.import_file(HOST_ODD, "nodir/x");
+    filesystem.export_file("nofile", HOST_OUT);
+    filesystem.export_file("d", HOST_OUT);
+    filesystem.export_file("odd", "nodir/x.tmp");
+    std::cout << "odd unchanged: " << yes_no(read_all(filesystem, "odd") == holed) << std::endl;
+    filesystem.check();
+    PRINTDIV2;
+
+    std::remove(HOST_EMPTY);
+    std::remove(HOST_ODD);
+    std::remove(HOST_OUT);
+
+    std::cout << "... Task 27 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,144 @@
+/******************************************************************************
+ *             File : test_script28.cpp
+ *
+ * Test program for mkimage: an image built from a small host tree holding
+ * an empty file, a file of several blocks and a symbolic link that loops
+ * back to its own directory mounts as a consistent file system, lists the
+ * tree, reads back the host files and leaves the link out.
+ *****************************************************************************/
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// host tree the test builds the image from, and removes again
+#define HOST_TREE "mkimage28.tmp"
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+static const char *
+yes_no(bool b)
+{
+    return b ? "yes" : "no";
+}
+
+static void
+write_host(const std::string &path, const std::string &data)
+{
+    std::ofstream out(path, std::ios::binary);
+    out << data;
+}
+
+// reads all of <path> through the handle API
+static std::string
+read_all(FS &filesystem, const char *path)
+{
+    std::string data;
+    char buf[BLOCK_SIZE];
+    int n, fd = filesystem.open(path, READ);
+    if (fd < 0)
+        return "<no such file>";
+    while ((n = filesystem.read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    filesystem.close(fd);
+    return data;
+}
+
+void
+Shell::run()
+{
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 28 ..." << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Creating " HOST_TREE "/{a.txt,sub/{big,empty}} and a link sub/loop to sub..." << std::endl;
+    std::string small = "hello, image\n", big;
+    for (int i = 0; i < 3 * BLOCK_SIZE + 5; ++i)
+        big += (char)('a' + i % 26);
+    std::system("rm -rf " HOST_TREE);
+    ::mkdir(HOST_TREE, 0755);
+    ::mkdir(HOST_TREE "/sub", 0755);
+    write_host(HOST_TREE "/a.txt", small);
+    write_host(HOST_TREE "/sub/big", big);
+    write_host(HOST_TREE "/sub/empty", "");
+    int ret = ::symlink(".", HOST_TREE "/sub/loop");
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "symlink: 0" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "symlink: " << ret << std::endl;
+    PRINTDIV2;
+
+    // mkimage rewrites the disk file under this shell's file system, which
+    // has nothing left to write back after the sync and is not used again
+    std::cout << "Testing mkimage " HOST_TREE " " DISKNAME "..." << std::endl;
+    filesystem.format();
+    filesystem.sync();
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "mkimage: skipping " HOST_TREE "/sub/loop (symbolic link)" << std::endl;
+    std::cout << "mkimage: " DISKNAME ": 4 files and directories, 14 of 2048 blocks used" << std::endl;
+    std::cout << "exit status: 0" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    ret = std::system("./mkimage " HOST_TREE " " DISKNAME " 2>&1");
+    std::cout << "exit status: " << ret << std::endl;
+    PRINTDIV2;
+
+    {
+        std::cout << "Mounting the image..." << std::endl;
+        FS image;
+        PRINTDIV2;
+
+        std::cout << "Testing check, ls / and ls /sub on the image..." << std::endl;
+        std::cout << "Expected output:" << std::endl;
+        std::cout << "check: 2 directories, 3 files, 0 problems" << std::endl;
+        std::cout << "name\t type\t accessrights\t size" << std::endl;
+        std::cout << "a.txt\t file\t rw-\t " << small.size() << std::endl;
+        std::cout << "sub\t dir\t rwx\t -" << std::endl;
+        std::cout << "name\t type\t accessrights\t size" << std::endl;
+        std::cout << "big\t file\t rw-\t " << big.size() << std::endl;
+        std::cout << "empty\t file\t rw-\t 0" << std::endl;
+        std::cout << "Actual output:" << std::endl;
+        image.check();
+        image.ls();
+        image.cd("/sub");
+        image.ls();
+        image.cd("/");
+        PRINTDIV2;
+
+        std::cout << "Reading back the files..." << std::endl;
+        std::cout << "Expected output:" << std::endl;
+        std::cout << "a.txt: same content: yes" << std::endl;
+        std::cout << "sub/big: same content: yes" << std::endl;
+        std::cout << "sub/empty: same content: yes" << std::endl;
+        std::cout << "open: /sub/loop: No such file" << std::endl;
+        std::cout << "Actual output:" << std::endl;
+        std::cout << "a.txt: same content: " << yes_no(read_all(image, "/a.txt") == small) << std::endl;
+        std::cout << "sub/big: same content: " << yes_no(read_all(image, "/sub/big") == big) << std::endl;
+        std::cout << "sub/empty: same content: " << yes_no(read_all(image, "/sub/empty").empty()) << std::endl;
+        image.open("/sub/loop", READ);
+        PRINTDIV2;
+    }
+
+    std::system("rm -rf " HOST_TREE);
+
+    std::cout << "... Task 28 done" << std::endl;
+    PRINTDIV;
+}
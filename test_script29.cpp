@@ -0,0 +1,189 @@
+/******************************************************************************
+ *             File : test_script29.cpp
+ *
+ * Test program for the handle API: reads cut short at the end of a file, a
+ * seek past the end followed by a write leaving a hole, a file reopened and
+ * read back after writes in the middle of it, and handles that are bad or
+ * used against their mode.
+ *****************************************************************************/
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+static const char *
+yes_no(bool b)
+{
+    return b ? "yes" : "no";
+}
+
+// reads all of <path> through the handle API
+static std::string
+read_all(FS &filesystem, const char *path)
+{
+    std::string data;
+    char buf[BLOCK_SIZE];
+    int n, fd = filesystem.open(path, READ);
+    if (fd < 0)
+        return "<no such file>";
+    while ((n = filesystem.read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    filesystem.close(fd);
+    return data;
+}
+
+void
+Shell::run()
+{
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 29 ..." << std::endl;
+    PRINTDIV2;
+
+    std::string data;
+    for (int i = 0; i < 2 * BLOCK_SIZE + 100; ++i)
+        data += (char)('a' + i % 26 + i / BLOCK_SIZE);
+    filesystem.format();
+
+    std::cout << "Writing f, " << data.size() << " bytes in pieces of 1000, and reading it in pieces of 3000..." << std::endl;
+    int fd = filesystem.open("f", WRITE | CREATE);
+    for (size_t done = 0; done < data.size(); done += 1000)
+        filesystem.write(fd, data.data() + done, std::min<size_t>(1000, data.size() - done));
+    filesystem.close(fd);
+    char buf[3 * BLOCK_SIZE];
+    fd = filesystem.open("f", READ);
+    std::string back;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "reads: 3000 3000 2292 0 0" << std::endl;
+    std::cout << "same content: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "reads:";
+    for (int i = 0; i < 5; ++i) {
+        int n = filesystem.read(fd, buf, 3000);
+        std::cout << " " << n;
+        if (n > 0)
+            back.append(buf, n);
+    }
+    std::cout << std::endl;
+    std::cout << "same content: " << yes_no(back == data) << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Testing reads from 10 bytes before the end, at the end and past it..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "read at size - 10: 10, same content: yes" << std::endl;
+    std::cout << "read at size: 0" << std::endl;
+    std::cout << "read at size + 50: 0" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.seek(fd, data.size() - 10);
+    int n = filesystem.read(fd, buf, 100);
+    std::cout << "read at size - 10: " << n << ", same content: "
+              << yes_no(n == 10 && std::string(buf, 10) == data.substr(data.size() - 10)) << std::endl;
+    filesystem.seek(fd, data.size());
+    std::cout << "read at size: " << filesystem.read(fd, buf, 100) << std::endl;
+    filesystem.seek(fd, data.size() + 50);
+    std::cout << "read at size + 50: " << filesystem.read(fd, buf, 100) << std::endl;
+    filesystem.close(fd);
+    PRINTDIV2;
+
+    std::cout << "Testing a write at 5 blocks and 7 bytes into h after 100 bytes at its start..." << std::endl;
+    uint32_t logical, physical_before, physical;
+    filesystem.dedup_counts(logical, physical_before);
+    fd = filesystem.open("h", WRITE | CREATE);
+    filesystem.write(fd, std::string(100, 'x').data(), 100);
+    filesystem.seek(fd, 5 * BLOCK_SIZE + 7);
+    filesystem.write(fd, std::string(100, 'y').data(), 100);
+    filesystem.close(fd);
+    filesystem.dedup_counts(logical, physical);
+    std::string holed = std::string(100, 'x') + std::string(5 * BLOCK_SIZE + 7 - 100, '\0') + std::string(100, 'y');
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "h: " << holed.size() << " bytes, same content: yes" << std::endl;
+    // only the first and the last block are stored
+    std::cout << "new blocks on disk: 2" << std::endl;
+    std::cout << "check: 1 directories, 2 files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    back = read_all(filesystem, "h");
+    std::cout << "h: " << back.size() << " bytes, same content: " << yes_no(back == holed) << std::endl;
+    std::cout << "new blocks on disk: " << physical - physical_before << std::endl;
+    filesystem.check();
+    PRINTDIV2;
+
+    std::cout << "Testing writes into the middle of f and h after reopening them..." << std::endl;
+    fd = filesystem.open("f", WRITE);
+    filesystem.seek(fd, 10);
+    filesystem.write(fd, "ABC", 3);
+    filesystem.seek(fd, BLOCK_SIZE - 1);
+    filesystem.write(fd, "DE", 2);
+    filesystem.close(fd);
+    data.replace(10, 3, "ABC");
+    data.replace(BLOCK_SIZE - 1, 2, "DE");
+    fd = filesystem.open("h", READ | WRITE);
+    filesystem.seek(fd, 2 * BLOCK_SIZE);
+    filesystem.write(fd, "hole", 4);
+    filesystem.close(fd);
+    holed.replace(2 * BLOCK_SIZE, 4, "hole");
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "f: " << data.size() << " bytes, same content: yes" << std::endl;
+    std::cout << "h: " << holed.size() << " bytes, same content: yes" << std::endl;
+    std::cout << "check: 1 directories, 2 files, 0 problems" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    back = read_all(filesystem, "f");
+    std::cout << "f: " << back.size() << " bytes, same content: " << yes_no(back == data) << std::endl;
+    back = read_all(filesystem, "h");
+    std::cout << "h: " << back.size() << " bytes, same content: " << yes_no(back == holed) << std::endl;
+    filesystem.check();
+    PRINTDIV2;
+
+    std::cout << "Testing handles used against their mode, bad and closed handles..." << std::endl;
+    int rfd = filesystem.open("f", READ);
+    int wfd = filesystem.open("h", WRITE);
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "read on a write handle: -1" << std::endl;
+    std::cout << "write on a read handle: -1" << std::endl;
+    std::cout << "read, write, seek, close of -1: -1 -1 -1 -1" << std::endl;
+    std::cout << "read, write, seek, close of " << MAX_OPEN_FILES << ": -1 -1 -1 -1" << std::endl;
+    std::cout << "close: 0 0" << std::endl;
+    std::cout << "read, write, seek, close of a closed handle: -1 -1 -1 -1" << std::endl;
+    std::cout << "open: nofile: No such file" << std::endl;
+    std::cout << "open nofile: -1" << std::endl;
+    std::cout << "f unchanged: yes" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "read on a write handle: " << filesystem.read(wfd, buf, 10) << std::endl;
+    std::cout << "write on a read handle: " << filesystem.write(rfd, "x", 1) << std::endl;
+    std::cout << "read, write, seek, close of -1: " << filesystem.read(-1, buf, 10) << " "
+              << filesystem.write(-1, "x", 1) << " " << filesystem.seek(-1, 0) << " "
+              << filesystem.close(-1) << std::endl;
+    std::cout << "read, write, seek, close of " << MAX_OPEN_FILES << ": "
+              << filesystem.read(MAX_OPEN_FILES, buf, 10) << " " << filesystem.write(MAX_OPEN_FILES, "x", 1)
+              << " " << filesystem.seek(MAX_OPEN_FILES, 0) << " " << filesystem.close(MAX_OPEN_FILES)
+              << std::endl;
+    int ret1 = filesystem.close(rfd);
+    int ret2 = filesystem.close(wfd);
+    std::cout << "close: " << ret1 << " " << ret2 << std::endl;
+    std::cout << "read, write, seek, close of a closed handle: " << filesystem.read(rfd, buf, 10) << " "
+              << filesystem.write(wfd, "x", 1) << " " << filesystem.seek(rfd, 0) << " "
+              << filesystem.close(wfd) << std::endl;
+    int ret = filesystem.open("nofile", READ);
+    std::cout << "open nofile: " << ret << std::endl;
+    std::cout << "f unchanged: " << yes_no(read_all(filesystem, "f") == data) << std::endl;
+    PRINTDIV2;
+
+    std::cout << "... Task 29 done" << std::endl;
+    PRINTDIV;
+}
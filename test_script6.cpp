@@ -0,0 +1,120 @@
+/******************************************************************************
+ *             File : test_script6.cpp
+ *
+ * Test program checking that path lookup does no heap allocation:
+ * cd, ls and cat are run with every operator new counted.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <new>
+#include <unistd.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+static unsigned long allocations = 0;
+
+void *
+operator new(size_t n)
+{
+    ++allocations;
+    void *p = std::malloc(n ? n : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void
+operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void
+operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+// prints the expected and actual number of allocations made since <start>
+static void
+check_allocations(unsigned long start)
+{
+    unsigned long n = allocations - start;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "0 allocations" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << n << " allocations" << std::endl;
+}
+
+void
+Shell::run()
+{
+    unsigned long start;
+    int fw;
+
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 6 ..." << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Creating /d1/d2 with the files f1 and f4129..." << std::endl;
+    filesystem.format();
+    filesystem.mkdir("/d1");
+    filesystem.mkdir("/d1/d2");
+    filesystem.cd("/d1/d2");
+    fw = open("input1.txt", O_RDONLY);
+    dup2(fw, 0);
+    filesystem.create("f1");
+    close(fw);
+    fw = open("input3.txt", O_RDONLY);
+    dup2(fw, 0);
+    filesystem.create("f4129");
+    close(fw);
+    filesystem.cd("/");
+    PRINTDIV2;
+
+    std::cout << "Testing cd with absolute and relative paths..." << std::endl;
+    start = allocations;
+    filesystem.cd("/d1/d2");
+    filesystem.cd("../..");
+    filesystem.cd("d1/./d2/../d2/");
+    check_allocations(start);
+    PRINTDIV2;
+
+    std::cout << "Testing ls..." << std::endl;
+    start = allocations;
+    filesystem.ls();
+    check_allocations(start);
+    PRINTDIV2;
+
+    std::cout << "Testing cat with relative and absolute paths..." << std::endl;
+    start = allocations;
+    filesystem.cat("f1");
+    filesystem.cat("/d1/d2/f1");
+    filesystem.cat("../d2/f4129");
+    std::cout << std::endl;
+    check_allocations(start);
+    PRINTDIV2;
+
+    std::cout << "... Task 6 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,146 @@
+/******************************************************************************
+ *             File : test_script7.cpp
+ *
+ * Test program measuring create throughput: a multi-megabyte input is
+ * piped through stdin into create, and memory use must not grow with it.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+// 64 rows of 63 characters and a newline make one block
+#define ROW_LEN 64
+#define NO_ROWS (4 * 1024 * 1024 / ROW_LEN)
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+// the content of row <i> of the generated input
+static void
+make_row(unsigned i, char *row)
+{
+    for (int j = 0; j < ROW_LEN - 1; ++j)
+        row[j] = 'A' + (i + j) % 26;
+    row[ROW_LEN - 1] = '\n';
+}
+
+// peak resident set size of this process in kB
+static long
+max_rss()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void
+Shell::run()
+{
+    int fd[2];
+    pid_t pid;
+
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 7 ..." << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Formatting disk ..." << std::endl;
+    filesystem.format();
+
+    std::cout << "Piping " << NO_ROWS * ROW_LEN << " bytes into create(f4M)..." << std::endl;
+    if (pipe(fd)) {
+        std::cout << "Error: pipe failed" << std::endl;
+        return;
+    }
+    pid = fork();
+    if (pid == 0) {
+        // the child writes the rows and the terminating empty row
+        ::close(fd[0]);
+        FILE *out = fdopen(fd[1], "w");
+        char row[ROW_LEN];
+        for (unsigned i = 0; i < NO_ROWS; ++i) {
+            make_row(i, row);
+            fwrite(row, 1, ROW_LEN, out);
+        }
+        fputc('\n', out);
+        fclose(out);
+        _exit(0);
+    }
+    ::close(fd[1]);
+    dup2(fd[0], 0);
+    ::close(fd[0]);
+
+    long rss_before = max_rss();
+    auto start = std::chrono::steady_clock::now();
+    int ret_val = filesystem.create("f4M");
+    auto stop = std::chrono::steady_clock::now();
+    long rss_after = max_rss();
+    waitpid(pid, nullptr, 0);
+    if (ret_val) {
+        std::cout << "Error: create f4M failed, error code " << ret_val << std::endl;
+    }
+
+    double secs = std::chrono::duration<double>(stop - start).count();
+    std::cout << "create: " << secs * 1000 << " ms, ";
+    std::cout << NO_ROWS * ROW_LEN / secs / (1024 * 1024) << " MB/s" << std::endl;
+
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "name\t type\t accessrights\t size" << std::endl;
+    std::cout << "f4M\t file\t rw-\t " << NO_ROWS * ROW_LEN << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.ls();
+    PRINTDIV2;
+
+    std::cout << "Checking file contents..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "content ok" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    int f = filesystem.open("f4M", READ);
+    char row[ROW_LEN], expected[ROW_LEN];
+    unsigned i;
+    for (i = 0; i < NO_ROWS; ++i) {
+        make_row(i, expected);
+        if (filesystem.read(f, row, ROW_LEN) != ROW_LEN || std::memcmp(row, expected, ROW_LEN))
+            break;
+    }
+    filesystem.close(f);
+    if (i == NO_ROWS)
+        std::cout << "content ok" << std::endl;
+    else
+        std::cout << "content differs in row " << i << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Checking that create does not buffer the file..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "peak memory grew by less than 1024 kB" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    if (rss_after - rss_before < 1024)
+        std::cout << "peak memory grew by less than 1024 kB" << std::endl;
+    else
+        std::cout << "peak memory grew by " << rss_after - rss_before << " kB" << std::endl;
+    PRINTDIV2;
+
+    std::cout << "... Task 7 done" << std::endl;
+    PRINTDIV;
+}
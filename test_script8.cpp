@@ -0,0 +1,130 @@
+/******************************************************************************
+ *             File : test_script8.cpp
+ *
+ * Test program measuring the output path: cat of a large file and ls of a
+ * full directory are redirected to /dev/null while the write() calls made
+ * to standard output are counted.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+#define FILE_SIZE (4 * 1024 * 1024)
+
+static unsigned long stdout_writes = 0;
+
+// counts the write() calls made to standard output, std::cout itself goes
+// through stdio and is not counted
+extern "C" ssize_t
+write(int fd, const void *buf, size_t n)
+{
+    if (fd == STDOUT_FILENO)
+        ++stdout_writes;
+    return syscall(SYS_write, fd, buf, n);
+}
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+static int saved_stdout;
+
+// sends standard output to /dev/null and resets the write() counter
+static void
+redirect_stdout()
+{
+    std::cout.flush();
+    saved_stdout = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+    stdout_writes = 0;
+}
+
+static void
+restore_stdout()
+{
+    std::cout.flush();
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+}
+
+void
+Shell::run()
+{
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 8 ..." << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Formatting disk and writing a " << FILE_SIZE << " byte file (f4M)..." << std::endl;
+    filesystem.format();
+    int fd = filesystem.open("f4M", WRITE | CREATE);
+    std::string row(63, 'x');
+    row += '\n';
+    for (int i = 0; i < FILE_SIZE / 64; ++i)
+        filesystem.write(fd, row.data(), row.size());
+    filesystem.close(fd);
+    PRINTDIV2;
+
+    std::cout << "Testing cat(f4M) > /dev/null..." << std::endl;
+    redirect_stdout();
+    auto start = std::chrono::steady_clock::now();
+    int ret_val = filesystem.cat("f4M");
+    auto stop = std::chrono::steady_clock::now();
+    unsigned long writes = stdout_writes;
+    restore_stdout();
+    if (ret_val) {
+        std::cout << "Error: cat f4M failed, error code " << ret_val << std::endl;
+    }
+    double secs = std::chrono::duration<double>(stop - start).count();
+    std::cout << "cat: " << secs * 1000 << " ms, ";
+    std::cout << FILE_SIZE / secs / (1024 * 1024) << " MB/s, ";
+    std::cout << writes << " write calls" << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "at most " << FILE_SIZE / OUTPUT_BUFFER_SIZE << " write calls" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    if (writes <= FILE_SIZE / OUTPUT_BUFFER_SIZE)
+        std::cout << "at most " << FILE_SIZE / OUTPUT_BUFFER_SIZE << " write calls" << std::endl;
+    else
+        std::cout << writes << " write calls" << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Testing ls of a full directory > /dev/null..." << std::endl;
+    filesystem.mkdir("full");
+    filesystem.cd("full");
+    for (unsigned i = 1; i < DIR_ENTRIES; ++i) {
+        fd = filesystem.open("f" + std::to_string(i), WRITE | CREATE);
+        filesystem.close(fd);
+    }
+    redirect_stdout();
+    filesystem.ls();
+    writes = stdout_writes;
+    restore_stdout();
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "write calls: 1" << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "write calls: " << writes << std::endl;
+    PRINTDIV2;
+
+    std::cout << "... Task 8 done" << std::endl;
+    PRINTDIV;
+}
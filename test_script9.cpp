@@ -0,0 +1,111 @@
+/******************************************************************************
+ *             File : test_script9.cpp
+ *
+ * Test program checking that append only touches the tail of the
+ * destination: appending a 16 byte file must take the same number of
+ * block reads and writes whether the destination is small, large or a
+ * copy of a large file.
+ *****************************************************************************/
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include "test_script.h"
+#include "fs.h"
+
+#define PRINTDIV std::cout <<  "================================================================================" << std::endl
+#define PRINTDIV2 std::cout << "----------------------------------------" << std::endl
+
+Shell::Shell()
+{
+    std::cout << "Creating and starting shell...\n";
+}
+
+Shell::~Shell()
+{
+    std::cout << "Exiting shell...\n";
+}
+
+void
+Shell::run()
+{
+    std::string input1 = "hej heja hejare\n";
+    unsigned long reads, writes;
+    int fw;
+
+    PRINTDIV;
+    std::cout << "\\ / \\ / \\ / \\ / \\ / \\ / \\     new test session     / \\ / \\ / \\ / \\ / \\ / \\ / \\ /" << std::endl;
+    PRINTDIV;
+    std::cout << "Starting test sequence..." << std::endl;
+    PRINTDIV;
+    std::cout << "Task 9 ..." << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Creating f1 (16 bytes), small (16 bytes) and large (1000 blocks + 10 bytes)..." << std::endl;
+    filesystem.format();
+    fw = open("input1.txt", O_RDONLY);
+    dup2(fw, 0);
+    filesystem.create("f1");
+    close(fw);
+    filesystem.cp("f1", "small");
+    int fd = filesystem.open("large", WRITE | CREATE);
+    std::string block(BLOCK_SIZE, 'x');
+    for (int i = 0; i < 1000; ++i)
+        filesystem.write(fd, block.data(), block.size());
+    filesystem.write(fd, "0123456789", 10);
+    filesystem.close(fd);
+    PRINTDIV2;
+
+    std::cout << "Testing append(f1,small)..." << std::endl;
+    reads = filesystem.get_no_reads();
+    writes = filesystem.get_no_writes();
+    filesystem.append("f1", "small");
+    unsigned long small_reads = filesystem.get_no_reads() - reads;
+    unsigned long small_writes = filesystem.get_no_writes() - writes;
+    std::cout << "block reads: " << small_reads << ", block writes: " << small_writes << std::endl;
+
+    std::cout << "Testing append(f1,large)..." << std::endl;
+    reads = filesystem.get_no_reads();
+    writes = filesystem.get_no_writes();
+    filesystem.append("f1", "large");
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "block reads: " << small_reads << ", block writes: " << small_writes << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "block reads: " << filesystem.get_no_reads() - reads;
+    std::cout << ", block writes: " << filesystem.get_no_writes() - writes << std::endl;
+    PRINTDIV2;
+
+    std::cout << "Testing append(f1,copy) on a copy of large..." << std::endl;
+    filesystem.cp("large", "copy");
+    reads = filesystem.get_no_reads();
+    writes = filesystem.get_no_writes();
+    filesystem.append("f1", "copy");
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "block reads: " << small_reads << ", block writes: " << small_writes << std::endl;
+    std::cout << "Actual output:" << std::endl;
+    std::cout << "block reads: " << filesystem.get_no_reads() - reads;
+    std::cout << ", block writes: " << filesystem.get_no_writes() - writes << std::endl;
+    filesystem.rm("copy");
+    PRINTDIV2;
+
+    std::cout << "Checking the end of large..." << std::endl;
+    std::cout << "Expected output:" << std::endl;
+    std::cout << "name\t type\t accessrights\t size" << std::endl;
+    std::cout << "f1\t file\t rw-\t 16" << std::endl;
+    std::cout << "large\t file\t rw-\t " << 1000 * BLOCK_SIZE + 10 + 16 << std::endl;
+    std::cout << "small\t file\t rw-\t 32" << std::endl;
+    std::cout << "0123456789" << input1;
+    std::cout << "Actual output:" << std::endl;
+    filesystem.ls();
+    fd = filesystem.open("large", READ);
+    char tail[27] = { 0 };
+    filesystem.seek(fd, 1000 * BLOCK_SIZE);
+    filesystem.read(fd, tail, 26);
+    filesystem.close(fd);
+    std::cout << tail;
+    PRINTDIV2;
+
+    std::cout << "... Task 9 done" << std::endl;
+    PRINTDIV;
+}
@@ -0,0 +1,136 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "trace.h"
+
+std::atomic<bool> trace_enabled{false};
+
+// a recorded span
+struct trace_event {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+    uint32_t tid;
+};
+
+// the spans of one thread, the newest TRACE_RING_EVENTS of them
+struct trace_ring {
+    std::mutex lock;
+    size_t next = 0;
+    size_t count = 0;
+    trace_event events[TRACE_RING_EVENTS];
+};
+
+// Every ring ever made; they are kept, with their spans, when their thread
+// ends, and handed to the next new thread. Rings are never freed, so a
+// ring may be read while its thread goes away.
+static std::mutex rings_lock;
+static std::vector<trace_ring*> rings;
+static std::vector<trace_ring*> free_rings;
+static std::atomic<uint32_t> next_tid{1};
+// when recording started, the zero of the exported timestamps
+static std::atomic<uint64_t> trace_epoch{0};
+
+// the ring of the calling thread, given back when the thread ends
+struct ring_holder {
+    trace_ring *ring = nullptr;
+    uint32_t tid = 0;
+    ~ring_holder()
+    {
+        if (ring) {
+            std::lock_guard<std::mutex> guard(rings_lock);
+            free_rings.push_back(ring);
+        }
+    }
+};
+
+static thread_local ring_holder holder;
+
+// records span <name>, which must be a string literal, of the calling thread
+void
+trace_record(const char *name, uint64_t start, uint64_t end)
+{
+    if (!holder.ring) {
+        std::lock_guard<std::mutex> guard(rings_lock);
+        if (free_rings.empty()) {
+            rings.push_back(new trace_ring);
+            holder.ring = rings.back();
+        } else {
+            holder.ring = free_rings.back();
+            free_rings.pop_back();
+        }
+        holder.tid = next_tid++;
+    }
+    trace_ring &r = *holder.ring;
+    std::lock_guard<std::mutex> guard(r.lock);
+    // a span still open at trace stop is dropped, so a second trace stop
+    // writes the same spans
+    if (!trace_enabled)
+        return;
+    r.events[r.next] = trace_event{name, start, end, holder.tid};
+    r.next = (r.next + 1) % TRACE_RING_EVENTS;
+    r.count = std::min<size_t>(r.count + 1, TRACE_RING_EVENTS);
+}
+
+// trace start forgets the spans recorded so far and starts recording
+void
+trace_start()
+{
+    std::lock_guard<std::mutex> guard(rings_lock);
+    for (size_t i = 0; i < rings.size(); ++i) {
+        std::lock_guard<std::mutex> ring_guard(rings[i]->lock);
+        rings[i]->next = 0;
+        rings[i]->count = 0;
+    }
+    trace_epoch = trace_now();
+    trace_enabled = true;
+}
+
+// trace stop <path> stops recording and writes the spans to the host file
+// <path> as Chrome trace-event JSON, in the order they started
+int
+trace_stop(std::string_view path)
+{
+    trace_enabled = false;
+    std::vector<trace_event> events;
+    {
+        std::lock_guard<std::mutex> guard(rings_lock);
+        for (size_t i = 0; i < rings.size(); ++i) {
+            trace_ring &r = *rings[i];
+            std::lock_guard<std::mutex> ring_guard(r.lock);
+            size_t first = (r.next + TRACE_RING_EVENTS - r.count) % TRACE_RING_EVENTS;
+            for (size_t j = 0; j < r.count; ++j)
+                events.push_back(r.events[(first + j) % TRACE_RING_EVENTS]);
+        }
+    }
+    std::sort(events.begin(), events.end(), [](const trace_event &a, const trace_event &b) {
+        return a.start < b.start;
+    });
+
+    std::ofstream out{std::string(path)};
+    if (!out)
+        return -1;
+    uint64_t epoch = trace_epoch;
+    out << "{\"traceEvents\":[";
+    char line[256];
+    for (size_t i = 0; i < events.size(); ++i) {
+        const trace_event &e = events[i];
+        // spans begun before trace start count from its beginning
+        uint64_t start = std::max(e.start, epoch);
+        uint64_t end = std::max(e.end, start);
+        // timestamps are in microseconds
+        std::snprintf(line, sizeof(line),
+                      "%s\n{\"name\":\"%s\",\"cat\":\"fs\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                      "\"pid\":1,\"tid\":%u}",
+                      i ? "," : "", e.name, (start - epoch) / 1000.0, (end - start) / 1000.0,
+                      (unsigned)e.tid);
+        out << line;
+    }
+    out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    out.close();
+    return out.fail() ? -1 : 0;
+}
@@ -0,0 +1,56 @@
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <string_view>
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+// number of spans each thread keeps; older ones are overwritten
+#define TRACE_RING_EVENTS 8192
+
+// true while spans are recorded, see trace_start()
+extern std::atomic<bool> trace_enabled;
+
+// nanoseconds on the clock spans are measured with
+inline uint64_t
+trace_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// records span <name>, which must be a string literal, of the calling thread
+void trace_record(const char *name, uint64_t start, uint64_t end);
+
+// A span from its construction to the end of the scope. While tracing is
+// off it costs one relaxed load.
+class TraceSpan {
+private:
+    const char *name;
+    uint64_t start;
+public:
+    TraceSpan(const char *name) : name(name), start(0)
+    {
+        if (trace_enabled.load(std::memory_order_relaxed))
+            start = trace_now();
+    }
+    ~TraceSpan()
+    {
+        if (start)
+            trace_record(name, start, trace_now());
+    }
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+// traces the rest of the enclosing scope as span <name>
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+// trace start forgets the spans recorded so far and starts recording
+void trace_start();
+// trace stop <path> stops recording and writes the spans to the host file
+// <path> as Chrome trace-event JSON; returns -1 if it cannot be written
+int trace_stop(std::string_view path);
+
+#endif // __TRACE_H__
@@ -0,0 +1,335 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include "workload.h"
+#include "command.h"
+
+// commands of a workload, in the order of workload_params::mix
+enum { W_CREATE, W_CAT, W_APPEND, W_CP, W_MV, W_RM, W_MKDIR, W_CD };
+static const char *command_names[WORKLOAD_COMMANDS] = {
+    "create", "cat", "append", "cp", "mv", "rm", "mkdir", "cd"
+};
+
+// a directory of the generated tree
+struct workload_dir {
+    std::string path;
+    unsigned depth;
+    unsigned entries;
+};
+
+// a file of the generated tree, in directory <dir>
+struct workload_file {
+    std::string path;
+    unsigned dir;
+    uint32_t size;
+};
+
+// the tree as the commands generated so far leave it
+struct workload_state {
+    const workload_params &params;
+    std::ostream &out;
+    std::mt19937 rng;
+    std::vector<workload_dir> dirs;
+    std::vector<workload_file> files;
+    // blocks the files take, counting every copy in full
+    unsigned blocks;
+    unsigned next_name;
+    workload_state(const workload_params &params, std::ostream &out)
+        : params(params), out(out), rng(params.seed), blocks(0), next_name(0) {}
+};
+
+// a directory holds DIR_ENTRIES entries, one of them ".."
+#define WORKLOAD_DIR_ENTRIES (DIR_ENTRIES - 1)
+
+// sets the weights of params.mix from <text>, "create=30,cat=20,..."
+int
+parse_mix(const std::string &text, workload_params &params)
+{
+    std::fill(params.mix, params.mix + WORKLOAD_COMMANDS, 0);
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        size_t eq = item.find('=');
+        int c = 0;
+        while (c < WORKLOAD_COMMANDS && item.compare(0, eq, command_names[c]))
+            ++c;
+        if (eq == std::string::npos || c == WORKLOAD_COMMANDS ||
+            item.find_first_not_of("0123456789", eq + 1) != std::string::npos || eq + 1 == item.size())
+            return -1;
+        params.mix[c] = std::stoul(item.substr(eq + 1));
+    }
+    return 0;
+}
+
+// a number in [0, n); the generator is used directly, as the standard
+// distributions differ between libraries and workloads must not
+static uint32_t
+pick(workload_state &w, uint32_t n)
+{
+    return w.rng() % n;
+}
+
+static unsigned
+blocks_of(uint32_t size)
+{
+    return (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+// the size of a new file: a power of two between min_size and max_size is
+// picked first, then a size within it
+static uint32_t
+file_size(workload_state &w)
+{
+    unsigned lo = 0, hi = 0;
+    while (lo < 31 && (2u << lo) <= w.params.min_size)
+        ++lo;
+    while (hi < 31 && (2u << hi) <= w.params.max_size)
+        ++hi;
+    unsigned p = lo + pick(w, hi - lo + 1);
+    uint32_t size = (1u << p) + pick(w, 1u << p);
+    return std::min(std::max(size, w.params.min_size), w.params.max_size);
+}
+
+// a directory with room for one more entry and at most <depth> deep, -1 if
+// there is none
+static int
+room_dir(workload_state &w, unsigned depth)
+{
+    unsigned start = pick(w, w.dirs.size());
+    for (size_t i = 0; i < w.dirs.size(); ++i) {
+        unsigned d = (start + i) % w.dirs.size();
+        if (w.dirs[d].entries < WORKLOAD_DIR_ENTRIES && w.dirs[d].depth <= depth)
+            return d;
+    }
+    return -1;
+}
+
+// a new name in directory <d>
+static std::string
+new_path(workload_state &w, unsigned d, char kind)
+{
+    std::string name = kind + std::to_string(w.next_name++);
+    return w.dirs[d].path == "/" ? "/" + name : w.dirs[d].path + "/" + name;
+}
+
+// writes data rows of <size> bytes in all, each with its newline, and the
+// empty row ending them
+static void
+write_rows(workload_state &w, uint32_t size)
+{
+    std::string row;
+    while (size > 0) {
+        uint32_t len = std::min<uint32_t>(1 + pick(w, 80), std::max<uint32_t>(1, size - 1));
+        row.resize(len);
+        for (uint32_t i = 0; i < len; ++i)
+            row[i] = 'a' + pick(w, 26);
+        w.out << row << "\n";
+        size -= std::min(size, len + 1);
+    }
+    w.out << "\n";
+}
+
+// writes one command <c> for the tree as it is; returns false if <c> is not
+// possible now
+static bool
+generate_command(workload_state &w, int c)
+{
+    unsigned n = w.files.size();
+    switch (c) {
+    case W_CREATE: {
+        uint32_t size = file_size(w);
+        int d = room_dir(w, w.params.max_depth);
+        if (d < 0 || w.blocks + blocks_of(size) > WORKLOAD_MAX_BLOCKS)
+            return false;
+        std::string path = new_path(w, d, 'f');
+        w.out << "create " << path << "\n";
+        write_rows(w, size);
+        w.files.push_back(workload_file{path, (unsigned)d, size});
+        w.dirs[d].entries++;
+        w.blocks += blocks_of(size);
+        return true;
+    }
+    case W_CAT:
+        if (n == 0)
+            return false;
+        w.out << "cat " << w.files[pick(w, n)].path << "\n";
+        return true;
+    case W_APPEND: {
+        if (n < 2)
+            return false;
+        unsigned src = pick(w, n), dst = pick(w, n - 1);
+        if (dst >= src)
+            ++dst;
+        uint32_t size = w.files[dst].size + w.files[src].size;
+        if (w.blocks - blocks_of(w.files[dst].size) + blocks_of(size) > WORKLOAD_MAX_BLOCKS)
+            return false;
+        w.out << "append " << w.files[src].path << " " << w.files[dst].path << "\n";
+        w.blocks += blocks_of(size) - blocks_of(w.files[dst].size);
+        w.files[dst].size = size;
+        return true;
+    }
+    case W_CP: {
+        if (n == 0)
+            return false;
+        unsigned src = pick(w, n);
+        int d = room_dir(w, w.params.max_depth);
+        if (d < 0 || w.blocks + blocks_of(w.files[src].size) > WORKLOAD_MAX_BLOCKS)
+            return false;
+        std::string path = new_path(w, d, 'f');
+        w.out << "cp " << w.files[src].path << " " << path << "\n";
+        w.files.push_back(workload_file{path, (unsigned)d, w.files[src].size});
+        w.dirs[d].entries++;
+        w.blocks += blocks_of(w.files[src].size);
+        return true;
+    }
+    case W_MV: {
+        if (n == 0)
+            return false;
+        workload_file &f = w.files[pick(w, n)];
+        int d = room_dir(w, w.params.max_depth);
+        if (d < 0)
+            return false;
+        std::string path = new_path(w, d, 'f');
+        w.out << "mv " << f.path << " " << path << "\n";
+        w.dirs[f.dir].entries--;
+        w.dirs[d].entries++;
+        f.path = path;
+        f.dir = d;
+        return true;
+    }
+    case W_RM: {
+        if (n == 0)
+            return false;
+        unsigned i = pick(w, n);
+        w.out << "rm " << w.files[i].path << "\n";
+        w.dirs[w.files[i].dir].entries--;
+        w.blocks -= blocks_of(w.files[i].size);
+        w.files[i] = w.files.back();
+        w.files.pop_back();
+        return true;
+    }
+    case W_MKDIR: {
+        int d = w.params.max_depth ? room_dir(w, w.params.max_depth - 1) : -1;
+        if (d < 0 || w.blocks + 1 > WORKLOAD_MAX_BLOCKS)
+            return false;
+        std::string path = new_path(w, d, 'd');
+        w.out << "mkdir " << path << "\n";
+        w.dirs[d].entries++;
+        w.dirs.push_back(workload_dir{path, w.dirs[d].depth + 1, 0});
+        w.blocks++;
+        return true;
+    }
+    default:
+        w.out << "cd " << w.dirs[pick(w, w.dirs.size())].path << "\n";
+        return true;
+    }
+}
+
+// writes a workload of params.ops commands to <out>, starting with format
+void
+generate_workload(const workload_params &params, std::ostream &out)
+{
+    workload_state w(params, out);
+    w.dirs.push_back(workload_dir{"/", 0, 0});
+    unsigned total = 0;
+    for (int c = 0; c < WORKLOAD_COMMANDS; ++c)
+        total += params.mix[c];
+    out << "# workload: seed " << params.seed << ", " << params.ops << " commands, sizes "
+        << params.min_size << " to " << params.max_size << ", depth " << params.max_depth << "\n";
+    out << "format\n";
+    for (unsigned i = 0; i < params.ops; ++i) {
+        int c = W_CD;
+        if (total > 0) {
+            uint32_t r = pick(w, total);
+            for (c = 0; r >= params.mix[c]; ++c)
+                r -= params.mix[c];
+        }
+        // a command not possible now is replaced by one making progress
+        if (!generate_command(w, c) && !generate_command(w, W_CREATE) &&
+            !generate_command(w, W_RM))
+            generate_command(w, W_CD);
+    }
+}
+
+// runs the commands of <trace> on <filesystem> as the shell does in batch
+// mode, timing each of them
+void
+replay_workload(FS &filesystem, std::istream &trace, replay_result &result)
+{
+    std::ostringstream out;
+    fs_session s;
+    s.in = &trace;
+    s.out = &out;
+    s.out_fd = -1;
+    filesystem.attach(s);
+    unsigned long reads = filesystem.get_no_reads();
+    unsigned long writes = filesystem.get_no_writes();
+    auto begin = std::chrono::steady_clock::now();
+    std::string line;
+    bool more = true;
+    while (more && std::getline(trace, line)) {
+        size_t first = line.find_first_not_of(' ');
+        if (first == std::string::npos || line[first] == '#' || !line.compare(first, 2, "//"))
+            continue;
+        out.str("");
+        auto start = std::chrono::steady_clock::now();
+        more = run_command(filesystem, line, out, false);
+        std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+        replay_stats &stats = result.commands[line.substr(first, line.find(' ', first) - first)];
+        stats.latencies.push_back(ns.count());
+        // the data of the files is lower case only
+        if (out.str().find("Error:") != std::string::npos)
+            stats.errors++;
+    }
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - begin;
+    result.secs = secs.count();
+    result.reads = filesystem.get_no_reads() - reads;
+    result.writes = filesystem.get_no_writes() - writes;
+    filesystem.detach(s);
+}
+
+// prints one row of the replay report: <name>, the throughput <per_sec>
+// and the percentiles of <latencies>
+static void
+print_row(std::ostream &out, const std::string &name, std::vector<double> latencies,
+          double per_sec, unsigned long errors)
+{
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))] / 1000;
+    };
+    char row[256];
+    std::snprintf(row, sizeof(row), "%-8s %8zu %10.0f %9.2f %9.2f %9.2f %9.2f %9.2f %7lu\n",
+                  name.c_str(), latencies.size(), per_sec, percentile(0.5), percentile(0.9),
+                  percentile(0.99), percentile(0.999), latencies.back() / 1000, errors);
+    out << row;
+}
+
+// prints the throughput, the latency percentiles and the failures of each
+// command of <result>, and of all of them together
+void
+print_replay(const replay_result &result, std::ostream &out)
+{
+    out << "command       ops      ops/s    p50 us    p90 us    p99 us  p99.9 us    max us  errors\n";
+    std::vector<double> all;
+    unsigned long errors = 0;
+    for (auto it = result.commands.begin(); it != result.commands.end(); ++it) {
+        const replay_stats &stats = it->second;
+        double busy = 0;
+        for (size_t i = 0; i < stats.latencies.size(); ++i)
+            busy += stats.latencies[i] / 1e9;
+        print_row(out, it->first, stats.latencies, stats.latencies.size() / busy, stats.errors);
+        all.insert(all.end(), stats.latencies.begin(), stats.latencies.end());
+        errors += stats.errors;
+    }
+    if (all.empty())
+        return;
+    print_row(out, "all", all, all.size() / result.secs, errors);
+    out << "blocks read: " << result.reads << ", written: " << result.writes << "\n";
+}
@@ -0,0 +1,64 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include "fs.h"
+
+#ifndef __WORKLOAD_H__
+#define __WORKLOAD_H__
+
+// the commands a workload is made of, in the order of workload_params::mix
+#define WORKLOAD_COMMANDS 8
+// blocks the generated files may take in all, leaving room for directories
+// and for the copies cp and append make private later
+#define WORKLOAD_MAX_BLOCKS 1200
+
+// what a generated workload looks like
+struct workload_params {
+    uint32_t seed = 1;
+    unsigned ops = 10000;
+    // relative weights of create, cat, append, cp, mv, rm, mkdir and cd
+    unsigned mix[WORKLOAD_COMMANDS] = { 25, 25, 10, 10, 5, 15, 5, 5 };
+    // new files are between <min_size> and <max_size> bytes, as many of
+    // them in each power of two
+    uint32_t min_size = 16;
+    uint32_t max_size = 64 * 1024;
+    // directories are made at most <max_depth> levels below the root
+    unsigned max_depth = 4;
+};
+
+// sets the weights of params.mix from <text>, "create=30,cat=20,..."; the
+// commands not named get weight 0. Returns -1 on an unknown command
+int parse_mix(const std::string &text, workload_params &params);
+
+// writes a workload of params.ops commands to <out>, in the text format
+// the shell reads, starting with format. The same <params> give the same
+// workload. Every command is valid when it runs: the files and directories
+// it names exist, and the disk and the directories do not run full
+void generate_workload(const workload_params &params, std::ostream &out);
+
+// the latencies of one command in a replay, in nanoseconds, and how many
+// times it failed
+struct replay_stats {
+    std::vector<double> latencies;
+    unsigned long errors = 0;
+};
+
+// what a replay did
+struct replay_result {
+    // by command name
+    std::map<std::string, replay_stats> commands;
+    // from the first command to the last
+    double secs = 0;
+    unsigned long reads = 0;
+    unsigned long writes = 0;
+};
+
+// runs the commands of <trace> on <filesystem> as the shell does in batch
+// mode, timing each of them; their output is discarded
+void replay_workload(FS &filesystem, std::istream &trace, replay_result &result);
+// prints the throughput, the latency percentiles and the failures of each
+// command of <result>, and of all of them together
+void print_replay(const replay_result &result, std::ostream &out);
+
+#endif // __WORKLOAD_H__